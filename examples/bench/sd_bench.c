@@ -0,0 +1,368 @@
+#include "sd_bench.h"
+
+#include "sd.h"
+#include "sd_defines.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Transfer sizes of the sequential tests, in blocks
+static const uint32_t SEQ_SIZES[] = {1, 8, 32, 128};
+
+// Random and mixed tests move 4K per operation
+#define RANDOM_BLOCKS 8
+
+// Latencies of the test running
+static uint32_t lat[SD_BENCH_MAX_OPS];
+
+/**
+ * @brief Result of one test
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Operations completed
+     */
+    uint32_t ops;
+
+    /**
+     * @brief Operations that failed
+     */
+    uint32_t errors;
+
+    /**
+     * @brief Bytes moved
+     */
+    uint64_t bytes;
+
+    /**
+     * @brief Time taken (us)
+     */
+    uint64_t us;
+
+    /**
+     * @brief Median operation latency (us)
+     */
+    uint32_t p50_us;
+
+    /**
+     * @brief 99th percentile operation latency (us)
+     */
+    uint32_t p99_us;
+
+    /**
+     * @brief Longest operation latency (us)
+     */
+    uint32_t max_us;
+} sd_bench_result_t;
+
+/**
+ * @brief State of one test while it runs
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Card under test
+     */
+    sd_card_t *card;
+
+    /**
+     * @brief Configuration
+     */
+    const sd_bench_config_t *cfg;
+
+    /**
+     * @brief Result so far
+     */
+    sd_bench_result_t res;
+
+    /**
+     * @brief Time the test started (us)
+     */
+    uint64_t start;
+} test_t;
+
+/**
+ * @brief Time source of the card's host
+ *
+ * @param t Test
+ * @return Time in microseconds
+ */
+static uint64_t now_us(test_t *t)
+{
+    return t->card->host->ops->get_time_us();
+}
+
+/**
+ * @brief Next value of a xorshift32 generator
+ *
+ * @param state Generator state
+ * @return Random value
+ */
+static uint32_t next_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * @brief Starts a test
+ *
+ * @param t Test to start
+ * @param card SD card
+ * @param cfg Configuration
+ */
+static void test_begin(test_t *t, sd_card_t *card, const sd_bench_config_t *cfg)
+{
+    memset(t, 0, sizeof(*t));
+    t->card = card;
+    t->cfg = cfg;
+    t->start = now_us(t);
+}
+
+/**
+ * @brief Runs and times one operation of a test
+ *
+ * @param t Test
+ * @param write Whether to write
+ * @param lba Start block
+ * @param count Number of blocks
+ */
+static void test_op(test_t *t, bool write, uint32_t lba, uint32_t count)
+{
+    uint64_t t0 = now_us(t);
+    sd_status_t ret = write ? sd_write_blocks(t->card, lba, t->cfg->buf, count)
+                            : sd_read_blocks(t->card, lba, t->cfg->buf, count);
+    uint64_t us = now_us(t) - t0;
+
+    if (t->res.ops < SD_BENCH_MAX_OPS)
+        lat[t->res.ops] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+
+    t->res.ops++;
+    if (ret)
+        t->res.errors++;
+    else
+        t->res.bytes += (uint64_t)count * SD_DEFAULT_BLOCK_LEN;
+}
+
+/**
+ * @brief Orders latencies for qsort
+ *
+ * @param a Latency
+ * @param b Latency
+ * @return Comparison result
+ */
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Ends a test and prints its line
+ *
+ * @param t Test
+ * @param name Test name
+ * @param xfer_blocks Blocks per operation
+ */
+static void test_end(test_t *t, const char *name, uint32_t xfer_blocks)
+{
+    sd_bench_result_t *r = &t->res;
+    uint32_t n = r->ops < SD_BENCH_MAX_OPS ? r->ops : SD_BENCH_MAX_OPS;
+
+    r->us = now_us(t) - t->start;
+    if (n)
+    {
+        qsort(lat, n, sizeof(lat[0]), cmp_u32);
+        r->p50_us = lat[(n - 1) * 50 / 100];
+        r->p99_us = lat[(n - 1) * 99 / 100];
+        r->max_us = lat[n - 1];
+    }
+
+    // Integer only, some targets print without float support
+    uint64_t us = r->us ? r->us : 1;
+    uint64_t mbps_x100 = r->bytes * 100 / us;
+    uint64_t iops = (uint64_t)r->ops * 1000000 / us;
+
+    printf("%-16s %6lu %6lu %5lu.%02lu %8lu %8lu %8lu %8lu %4lu\n",
+           name,
+           (unsigned long)(xfer_blocks * SD_DEFAULT_BLOCK_LEN),
+           (unsigned long)r->ops,
+           (unsigned long)(mbps_x100 / 100),
+           (unsigned long)(mbps_x100 % 100),
+           (unsigned long)iops,
+           (unsigned long)r->p50_us,
+           (unsigned long)r->p99_us,
+           (unsigned long)r->max_us,
+           (unsigned long)r->errors);
+}
+
+/**
+ * @brief Sequential test, moves seq_bytes from the start of the region
+ *
+ * @param card SD card
+ * @param cfg Configuration
+ * @param name Test name
+ * @param write Whether to write
+ * @param xfer Blocks per operation
+ * @return Failed operations
+ */
+static uint32_t run_seq(sd_card_t *card,
+                        const sd_bench_config_t *cfg,
+                        const char *name,
+                        bool write,
+                        uint32_t xfer)
+{
+    test_t t;
+    uint32_t blocks = cfg->seq_bytes / SD_DEFAULT_BLOCK_LEN;
+
+    if (blocks > cfg->region_blocks)
+        blocks = cfg->region_blocks;
+
+    test_begin(&t, card, cfg);
+    for (uint32_t done = 0; done + xfer <= blocks; done += xfer)
+        test_op(&t, write, cfg->start_lba + done, xfer);
+    test_end(&t, name, xfer);
+
+    return t.res.errors;
+}
+
+/**
+ * @brief Random 4K test, a share of the operations read and the rest write
+ *
+ * @param card SD card
+ * @param cfg Configuration
+ * @param name Test name
+ * @param read_pct Percentage of reads
+ * @return Failed operations
+ */
+static uint32_t run_random(sd_card_t *card,
+                           const sd_bench_config_t *cfg,
+                           const char *name,
+                           uint32_t read_pct)
+{
+    test_t t;
+    uint32_t slots = cfg->region_blocks / RANDOM_BLOCKS;
+    uint32_t rng = cfg->seed ? cfg->seed : 1;
+
+    test_begin(&t, card, cfg);
+    for (uint32_t i = 0; i < cfg->random_ops; i++)
+    {
+        uint32_t lba = cfg->start_lba + (next_rand(&rng) % slots) * RANDOM_BLOCKS;
+        bool write = next_rand(&rng) % 100 >= read_pct;
+
+        test_op(&t, write, lba, RANDOM_BLOCKS);
+    }
+    test_end(&t, name, RANDOM_BLOCKS);
+
+    return t.res.errors;
+}
+
+/**
+ * @brief Erases the start of the region, then writes it twice: the first pass goes to erased
+ * flash, the second overwrites it
+ *
+ * @param card SD card
+ * @param cfg Configuration
+ * @return Failed operations
+ */
+static uint32_t run_erased(sd_card_t *card, const sd_bench_config_t *cfg)
+{
+    test_t t;
+    uint32_t blocks = cfg->seq_bytes / SD_DEFAULT_BLOCK_LEN;
+    uint32_t errors;
+
+    if (blocks > cfg->region_blocks)
+        blocks = cfg->region_blocks;
+    if (!blocks)
+        return 0;
+
+    // The erase row reports the rate blocks are erased at, one operation
+    test_begin(&t, card, cfg);
+    if (sd_erase_range(card, cfg->start_lba, cfg->start_lba + blocks - 1))
+        t.res.errors++;
+    else
+        t.res.bytes = (uint64_t)blocks * SD_DEFAULT_BLOCK_LEN;
+    t.res.ops = 1;
+    lat[0] = (uint32_t)(now_us(&t) - t.start);
+    test_end(&t, "erase", blocks);
+    errors = t.res.errors;
+
+    errors += run_seq(card, cfg, "write erased", true, RANDOM_BLOCKS);
+    errors += run_seq(card, cfg, "overwrite", true, RANDOM_BLOCKS);
+
+    return errors;
+}
+
+// ========== Benchmark API ==========
+
+void sd_bench_defaults(sd_bench_config_t *cfg, sd_card_t *card, void *buf, uint32_t buf_blocks)
+{
+    uint32_t card_blocks = (uint32_t)(card->capacity_bytes / SD_DEFAULT_BLOCK_LEN);
+
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->buf = buf;
+    cfg->buf_blocks = buf_blocks;
+    cfg->seq_bytes = 1u << 20;
+    cfg->random_ops = 1000;
+    cfg->seed = 0x5D5D5D5D;
+
+    // 8 MiB in the middle of the card, away from the filesystem structures at its start
+    cfg->region_blocks = 16384;
+    if (cfg->region_blocks > card_blocks / 2)
+        cfg->region_blocks = card_blocks / 2;
+    cfg->start_lba = card_blocks / 2;
+}
+
+int sd_bench_run(sd_card_t *card, const sd_bench_config_t *cfg)
+{
+    if (!card || !card->host || !cfg || !cfg->buf || cfg->region_blocks < RANDOM_BLOCKS)
+        return -1;
+
+    // Latencies need a time source
+    if (!card->host->ops || !card->host->ops->get_time_us)
+        return -1;
+
+    uint32_t errors = 0;
+
+    memset(cfg->buf, 0xA5, (size_t)cfg->buf_blocks * SD_DEFAULT_BLOCK_LEN);
+
+    printf("%-16s %6s %6s %8s %8s %8s %8s %8s %4s\n",
+           "test", "xfer", "ops", "MB/s", "IOPS", "p50 us", "p99 us", "max us", "err");
+
+    // Writes first, so the reads find data
+    for (size_t i = 0; i < sizeof(SEQ_SIZES) / sizeof(SEQ_SIZES[0]); i++)
+    {
+        if (SEQ_SIZES[i] > cfg->buf_blocks)
+            break;
+        errors += run_seq(card, cfg, "seq write", true, SEQ_SIZES[i]);
+    }
+
+    for (size_t i = 0; i < sizeof(SEQ_SIZES) / sizeof(SEQ_SIZES[0]); i++)
+    {
+        if (SEQ_SIZES[i] > cfg->buf_blocks)
+            break;
+        errors += run_seq(card, cfg, "seq read", false, SEQ_SIZES[i]);
+    }
+
+    if (cfg->buf_blocks >= RANDOM_BLOCKS)
+    {
+        errors += run_random(card, cfg, "rand read", 100);
+        errors += run_random(card, cfg, "rand write", 0);
+        errors += run_random(card, cfg, "mixed 70/30", 70);
+        errors += run_random(card, cfg, "mixed 50/50", 50);
+        errors += run_erased(card, cfg);
+    }
+
+    return (int)errors;
+}
@@ -0,0 +1,77 @@
+#ifndef SD_BENCH_H
+#define SD_BENCH_H
+
+#include "sd.h"
+
+#include <stdint.h>
+
+/**
+ * @brief Most latencies kept per test, the percentiles of longer tests cover their first ones
+ */
+#define SD_BENCH_MAX_OPS 4096
+
+/**
+ * @brief Benchmark configuration. The test region is overwritten
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief First block of the test region
+     */
+    uint32_t start_lba;
+
+    /**
+     * @brief Size of the test region in blocks
+     */
+    uint32_t region_blocks;
+
+    /**
+     * @brief Transfer buffer
+     */
+    uint8_t *buf;
+
+    /**
+     * @brief Size of the transfer buffer in blocks, the longest transfer tested
+     */
+    uint32_t buf_blocks;
+
+    /**
+     * @brief Bytes moved by each sequential test
+     */
+    uint32_t seq_bytes;
+
+    /**
+     * @brief Operations of each random and mixed test
+     */
+    uint32_t random_ops;
+
+    /**
+     * @brief Seed of the random offsets
+     */
+    uint32_t seed;
+} sd_bench_config_t;
+
+/**
+ * @brief Fills in a configuration: a region at the middle of the card, 1 MiB per sequential
+ * test and 1000 random operations
+ *
+ * @param cfg Configuration to fill in
+ * @param card Initialized SD card
+ * @param buf Transfer buffer
+ * @param buf_blocks Size of the transfer buffer in blocks
+ */
+void sd_bench_defaults(sd_bench_config_t *cfg, sd_card_t *card, void *buf, uint32_t buf_blocks);
+
+/**
+ * @brief Runs the suite and prints a line per test: sequential read and write at each transfer
+ * size, 4K random read and write, mixed read/write ratios, and writes to erased blocks against
+ * overwrites. Needs the host's get_time_us
+ *
+ * @param card Initialized SD card
+ * @param cfg Configuration
+ * @return Number of failed operations, negative if the suite couldn't run
+ */
+int sd_bench_run(sd_card_t *card, const sd_bench_config_t *cfg);
+
+#endif
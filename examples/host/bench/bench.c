@@ -0,0 +1,115 @@
+#include "libsd_mcu_defs.h"
+#include "sd.h"
+#include "sd_bench.h"
+#include "sd_emu.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest transfer tested, 64K
+#define BUF_BLOCKS 128
+
+static uint8_t buf[BUF_BLOCKS * 512];
+
+/**
+ * @brief Prints the options and the card latency profiles
+ *
+ * @param prog Program name
+ */
+static void usage(const char *prog)
+{
+    printf("usage: %s [options]\n"
+           "  --sd              native SD bus (4 bit) instead of SPI\n"
+           "  --clock HZ        bus clock once in operating mode (default 25000000)\n"
+           "  --profile NAME    card latency profile (default class10)\n"
+           "  --overhead-ns N   fixed cost of every port transfer (default 0)\n"
+           "  --image PATH      card image (default sd_bench.img)\n"
+           "  --size MB         card size (default 64)\n"
+           "  --real-time       measure wall clock time instead of modeling it\n"
+           "  --quick           256K sequential tests and 200 random operations\n"
+           "profiles:",
+           prog);
+    for (const sd_emu_profile_t *p = sd_emu_profiles; p->name; p++)
+        printf(" %s", p->name);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    sd_host_t host;
+    sd_card_t card;
+    sd_host_ctx_t host_ctx = {
+        .image_path = "sd_bench.img",
+        .image_size = 64ull << 20,
+        .profile = sd_emu_find_profile("class10"),
+        .virtual_time = true,
+    };
+    bool quick = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *opt = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!strcmp(opt, "--sd"))
+            host_ctx.sd_bus = true;
+        else if (!strcmp(opt, "--real-time"))
+            host_ctx.virtual_time = false;
+        else if (!strcmp(opt, "--quick"))
+            quick = true;
+        else if (val && !strcmp(opt, "--clock"))
+            host_ctx.fast_hz = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (val && !strcmp(opt, "--overhead-ns"))
+            host_ctx.xfer_overhead_ns = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (val && !strcmp(opt, "--image"))
+            host_ctx.image_path = argv[++i];
+        else if (val && !strcmp(opt, "--size"))
+            host_ctx.image_size = strtoull(argv[++i], NULL, 0) << 20;
+        else if (val && !strcmp(opt, "--profile"))
+        {
+            host_ctx.profile = sd_emu_find_profile(argv[++i]);
+            if (!host_ctx.profile)
+            {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    SD_HOST_SET_CTX(&host, &host_ctx);
+    if (init_host(&host) || sd_init(&host, &card))
+    {
+        puts("card init failed");
+        return 1;
+    }
+
+    printf("%s bus at %lu Hz, %s card, %lu ns per transfer, %s time\n\n",
+           host_ctx.sd_bus ? "SD" : "SPI",
+           (unsigned long)host_ctx.clock_hz,
+           host_ctx.profile ? host_ctx.profile->name : "default",
+           (unsigned long)host_ctx.xfer_overhead_ns,
+           host_ctx.virtual_time ? "modeled" : "wall clock");
+
+    sd_bench_config_t cfg;
+    sd_bench_defaults(&cfg, &card, buf, BUF_BLOCKS);
+    if (quick)
+    {
+        cfg.seq_bytes = 256u << 10;
+        cfg.random_ops = 200;
+    }
+
+    int errors = sd_bench_run(&card, &cfg);
+    sd_emu_close(&host_ctx.card);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include "libsd_mcu_defs.h"
+#include "sd.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Writers each own a region of the card, readers stream through a region filled up front
+#define WRITERS 2
+#define READERS 2
+#define REGION_BLOCKS 256
+#define ROUNDS 200
+
+static sd_card_t card;
+
+/**
+ * @brief Fills a block with a pattern identifying its address and write round
+ *
+ * @param buf Block buffer
+ * @param lba Block address
+ * @param round Write round
+ */
+static void fill(uint8_t *buf, uint32_t lba, uint32_t round)
+{
+    for (uint32_t i = 0; i < 512; i++)
+        buf[i] = (uint8_t)(lba * 7 + round * 13 + i);
+}
+
+/**
+ * @brief Writes runs of blocks to its region and reads each back, like a logger task
+ *
+ * @param arg Index of the writer
+ * @return Number of mismatches or errors
+ */
+static void *writer(void *arg)
+{
+    uint32_t base = (uint32_t)(uintptr_t)arg * REGION_BLOCKS;
+    uintptr_t bad = 0;
+    static _Thread_local uint8_t wbuf[8 * 512], rbuf[8 * 512];
+
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        uint32_t count = 1 + round % 8;
+        uint32_t lba = base + (round * 8) % (REGION_BLOCKS - 8);
+
+        for (uint32_t i = 0; i < count; i++)
+            fill(wbuf + i * 512, lba + i, round);
+
+        if (sd_write_blocks(&card, lba, wbuf, count) ||
+            sd_read_blocks(&card, lba, rbuf, count) || memcmp(wbuf, rbuf, count * 512))
+            bad++;
+    }
+
+    return (void *)bad;
+}
+
+/**
+ * @brief Reads its region sequentially one block at a time, keeping a CMD18 stream open between
+ * reads, like a telemetry task
+ *
+ * @param arg Index of the reader
+ * @return Number of mismatches or errors
+ */
+static void *reader(void *arg)
+{
+    uint32_t base = (WRITERS + (uint32_t)(uintptr_t)arg) * REGION_BLOCKS;
+    uintptr_t bad = 0;
+    uint8_t want[512], got[512];
+
+    for (uint32_t round = 0; round < ROUNDS / 40; round++)
+    {
+        for (uint32_t i = 0; i < REGION_BLOCKS; i++)
+        {
+            fill(want, base + i, 0);
+            if (sd_read_blocks(&card, base + i, got, 1) || memcmp(want, got, 512))
+                bad++;
+        }
+    }
+
+    return (void *)bad;
+}
+
+int main(void)
+{
+    sd_host_t host;
+    sd_host_ctx_t host_ctx = {.image_path = "stress.img", .image_size = 64ull << 20};
+
+    SD_HOST_SET_CTX(&host, &host_ctx);
+    if (init_host(&host) || sd_init(&host, &card))
+    {
+        puts("card init failed");
+        return 1;
+    }
+
+    // Sequential reads are served from open CMD18 streams, other threads have to stop them
+    sd_set_read_ahead(&card, true);
+
+    // The readers' regions hold round 0 of the pattern
+    uint8_t block[512];
+    for (uint32_t lba = WRITERS * REGION_BLOCKS; lba < (WRITERS + READERS) * REGION_BLOCKS; lba++)
+    {
+        fill(block, lba, 0);
+        sd_write_blocks(&card, lba, block, 1);
+    }
+
+    pthread_t threads[WRITERS + READERS];
+    for (uintptr_t i = 0; i < WRITERS; i++)
+        pthread_create(&threads[i], NULL, writer, (void *)i);
+    for (uintptr_t i = 0; i < READERS; i++)
+        pthread_create(&threads[WRITERS + i], NULL, reader, (void *)i);
+
+    uintptr_t bad = 0;
+    for (int i = 0; i < WRITERS + READERS; i++)
+    {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        bad += (uintptr_t)ret;
+    }
+
+    printf("%s: %lu failed transfers\n", bad ? "FAIL" : "PASS", (unsigned long)bad);
+    sd_emu_close(&host_ctx.card);
+
+    return bad ? 1 : 0;
+}
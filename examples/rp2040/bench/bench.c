@@ -0,0 +1,60 @@
+#include "hardware/spi.h"
+
+#include "libsd_mcu_defs.h"
+#include "pico/stdlib.h"
+#include "sd.h"
+#include "sd_bench.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <boards/pico.h>
+#include <stdio.h>
+
+// Longest transfer tested, 16K of the RP2040's 264K of RAM
+#define BUF_BLOCKS 32
+
+static uint8_t buf[BUF_BLOCKS * 512];
+
+int main()
+{
+    stdio_init_all();
+
+#if !defined(spi_default) || !defined(PICO_DEFAULT_SPI_SCK_PIN) ||                                 \
+    !defined(PICO_DEFAULT_SPI_TX_PIN) || !defined(PICO_DEFAULT_SPI_RX_PIN) ||                      \
+    !defined(PICO_DEFAULT_SPI_CSN_PIN)
+#warning bench example requires a board with SPI pins
+    puts("Default SPI pins were not defined");
+#else
+    sd_host_t host;
+    sd_card_t card;
+
+    // Configure the host context for the controller
+    sd_host_ctx_t host_ctx = {.spi = spi_default,
+                              .rx_pin = PICO_DEFAULT_SPI_RX_PIN,
+                              .tx_pin = PICO_DEFAULT_SPI_TX_PIN,
+                              .sck_pin = PICO_DEFAULT_SPI_SCK_PIN,
+                              .cs_pin = PICO_DEFAULT_SPI_CSN_PIN};
+
+    SD_HOST_SET_CTX(&host, &host_ctx);
+
+    // Give a USB serial terminal time to connect
+    sleep_ms(2000);
+
+    if (init_host(&host) || sd_init(&host, &card))
+    {
+        puts("card init failed");
+    }
+    else
+    {
+        // Overwrites 8 MiB in the middle of the card
+        sd_bench_config_t cfg;
+        sd_bench_defaults(&cfg, &card, buf, BUF_BLOCKS);
+        printf("%d failed operations\n", sd_bench_run(&card, &cfg));
+    }
+
+    while (true)
+    {
+        ;
+    }
+#endif
+}
@@ -0,0 +1,9 @@
+cmake_minimum_required(VERSION 3.15..3.25.1)
+include_guard(GLOBAL)
+
+# The host port needs no SDK, the card is emulated on top of a disk image
+add_library(libsd_backend OBJECT ${CMAKE_CURRENT_LIST_DIR}/sd_host.c
+                                 ${CMAKE_CURRENT_LIST_DIR}/sd_emu.c)
+
+# libsd_mcu_defs.h pulls in the emulator, ship it alongside in the generated dir
+configure_file("${CMAKE_CURRENT_LIST_DIR}/sd_emu.h" "${GEN_DIR}/sd_emu.h" COPYONLY)
@@ -0,0 +1,109 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file libsd_mcu_defs.h
+ * @brief Hosted (Linux) Port Definitions
+ */
+
+#ifndef LIBSD_MCU_DEFS_H
+#define LIBSD_MCU_DEFS_H
+#include "bus/sd_sdmmc.h"
+#include "bus/sd_spi.h"
+#include "sd_emu.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Platform specific private data context used by host controller
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Path to the disk image backing the emulated card
+     */
+    const char *image_path;
+
+    /**
+     * @brief If non-zero, the image is created/grown to this many bytes
+     */
+    uint64_t image_size;
+
+    /**
+     * @brief Wire the card to the native SD bus instead of SPI
+     */
+    bool sd_bus;
+
+    /**
+     * @brief OPTIONAL: SPI bus shared with the other cards on it, NULL for a bus of its own
+     */
+    sd_spi_bus_t *shared_bus;
+
+    /**
+     * @brief Clock rate to use for identification
+     */
+    uint32_t slow_hz; // ≤400 kHz for identification
+
+    /**
+     * @brief Fastest bus clock rate once in operating mode
+     */
+    uint32_t fast_hz;
+
+    /**
+     * @brief Current (emulated) bus clock rate
+     */
+    uint32_t clock_hz;
+
+    /**
+     * @brief DAT lines in use on the native SD bus, 1 or 4
+     */
+    uint8_t width;
+
+    /**
+     * @brief OPTIONAL: Card latency profile (sd_emu_profiles), applied at every clock change. NULL
+     * keeps the emulator's defaults
+     */
+    const sd_emu_profile_t *profile;
+
+    /**
+     * @brief Model time instead of measuring it: get_time_us returns the bus and card time spent,
+     * and delays advance it without sleeping. Shared by every host of the process, for single
+     * threaded benchmarks
+     */
+    bool virtual_time;
+
+    /**
+     * @brief With virtual_time: fixed cost (ns) of every transfer the bus driver asks the port
+     * for, the CPU and DMA setup time a real port spends on top of the clocked bits
+     */
+    uint32_t xfer_overhead_ns;
+
+    /**
+     * @brief With virtual_time: modeled time (ns) the card was last clocked at
+     */
+    uint64_t card_ns;
+
+    /**
+     * @brief The emulated card on the other end of the bus
+     */
+    sd_emu_t card;
+
+    /**
+     * @brief SPI bus driver state of this host
+     */
+    spi_ctx_t spi_ctx;
+
+    /**
+     * @brief Native SD bus driver state of this host
+     */
+    sdmmc_ctx_t sdmmc_ctx;
+
+    /**
+     * @brief Recursive mutex behind the host lock hooks, lets several threads share the card
+     */
+    pthread_mutex_t lock;
+} sd_host_ctx_t;
+#endif
@@ -0,0 +1,1811 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_emu.c
+ * @brief Emulation of a SD card backed by a disk image file, byte-level in SPI mode and
+ * cycle-level on the native SD bus
+ */
+
+#include "sd_emu.h"
+
+#include "../../include/sd_defines.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ========== Helper Functions ==========
+
+uint8_t sd_emu_crc7(const uint8_t *buf, size_t n)
+{
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t b = buf[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc <<= 1;
+            if ((b ^ crc) & 0x80)
+                crc ^= 0x09;
+            b <<= 1;
+        }
+    }
+
+    return crc & 0x7F;
+}
+
+uint16_t sd_emu_crc16(const uint8_t *buf, size_t n)
+{
+    uint16_t crc = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        crc ^= (uint16_t)buf[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+
+    return crc;
+}
+
+/**
+ * @brief Sets a bit field of a big endian register, numbered as in the SD specification
+ *
+ * @param reg Register
+ * @param len Register length in bytes
+ * @param msb Most significant bit of the field
+ * @param lsb Least significant bit of the field
+ * @param v Field value
+ */
+static void reg_set(uint8_t *reg, size_t len, unsigned msb, unsigned lsb, uint32_t v)
+{
+    for (unsigned bit = lsb; bit <= msb; bit++, v >>= 1)
+    {
+        uint8_t mask = 1u << (bit % 8);
+        if (v & 1)
+            reg[len - 1 - bit / 8] |= mask;
+        else
+            reg[len - 1 - bit / 8] &= ~mask;
+    }
+}
+
+/**
+ * @brief Builds the CSD register, version 2.0 for SDHC and version 1.0 for SDSC
+ *
+ * @param emu Emulated card
+ * @param csd Register to populate
+ */
+static void build_csd(sd_emu_t *emu, uint8_t csd[16])
+{
+    // High speed cards report 50MHz
+    uint8_t tran_speed = emu->high_speed ? 0x5A : emu->tran_speed;
+
+    memset(csd, 0, 16);
+
+    reg_set(csd, 16, 119, 112, 0x0E);            // TAAC
+    reg_set(csd, 16, 103, 96, tran_speed);       // TRAN_SPEED
+    reg_set(csd, 16, 95, 84, 0x5B5);             // CCC
+    reg_set(csd, 16, 83, 80, 9);                 // READ_BL_LEN, 512
+    reg_set(csd, 16, 46, 46, 1);                 // ERASE_BLK_EN
+    reg_set(csd, 16, 45, 39, 0x7F);              // SECTOR_SIZE
+    reg_set(csd, 16, 28, 26, 2);                 // R2W_FACTOR
+    reg_set(csd, 16, 25, 22, 9);                 // WRITE_BL_LEN, 512
+
+    if (emu->high_capacity)
+    {
+        // Capacity is (C_SIZE + 1) * 512KiB
+        uint32_t c_size = emu->blocks / 1024;
+        reg_set(csd, 16, 127, 126, 1);
+        reg_set(csd, 16, 69, 48, c_size ? c_size - 1 : 0);
+    }
+    else
+    {
+        // Capacity is (C_SIZE + 1) * 2^(C_SIZE_MULT + 2) blocks, pick the smallest multiplier
+        uint32_t mult = 0;
+        while (mult < 7 && (emu->blocks >> (mult + 2)) > 4096)
+            mult++;
+
+        uint32_t c_size = emu->blocks >> (mult + 2);
+        reg_set(csd, 16, 73, 62, c_size ? c_size - 1 : 0);
+        reg_set(csd, 16, 49, 47, mult);
+    }
+
+    reg_set(csd, 16, 7, 1, sd_emu_crc7(csd, 15));
+    reg_set(csd, 16, 0, 0, 1);
+}
+
+/**
+ * @brief Builds the CID register
+ *
+ * @param emu Emulated card
+ * @param cid Register to populate
+ */
+static void build_cid(sd_emu_t *emu, uint8_t cid[16])
+{
+    static const char pnm[5] = {'E', 'M', 'U', 'S', 'D'};
+
+    memset(cid, 0, 16);
+
+    reg_set(cid, 16, 127, 120, 0x7E);       // MID
+    reg_set(cid, 16, 119, 104, 0x4C53);     // OID, "LS"
+    for (unsigned i = 0; i < sizeof(pnm); i++)
+        cid[3 + i] = pnm[i];                // PNM
+    reg_set(cid, 16, 63, 56, 0x10);         // PRV, 1.0
+    reg_set(cid, 16, 55, 24, emu->serial);  // PSN
+    reg_set(cid, 16, 19, 8, (25 << 4) | 1); // MDT, 2025-01
+
+    reg_set(cid, 16, 7, 1, sd_emu_crc7(cid, 15));
+    reg_set(cid, 16, 0, 0, 1);
+}
+
+/**
+ * @brief Builds the SD Status, returned by ACMD13
+ *
+ * @param emu Emulated card
+ * @param ssr Register to populate
+ */
+static void build_sd_status(sd_emu_t *emu, uint8_t ssr[64])
+{
+    memset(ssr, 0, 64);
+
+    reg_set(ssr, 64, 447, 440, 4);            // SPEED_CLASS, class 10
+    reg_set(ssr, 64, 431, 428, emu->au_size); // AU_SIZE
+    reg_set(ssr, 64, 423, 408, 1);            // ERASE_SIZE, one AU
+    reg_set(ssr, 64, 407, 402, 1);            // ERASE_TIMEOUT, 1s
+    reg_set(ssr, 64, 401, 400, 1);            // ERASE_OFFSET, 1s
+    reg_set(ssr, 64, 399, 396, 1);            // UHS_SPEED_GRADE, U1
+    reg_set(ssr, 64, 395, 392, emu->au_size); // UHS_AU_SIZE
+    reg_set(ssr, 64, 391, 384, 10);           // VIDEO_SPEED_CLASS, V10
+    reg_set(ssr, 64, 339, 336, 1);            // APP_PERF_CLASS, A1
+}
+
+/**
+ * @brief Builds the SCR, returned by ACMD51
+ *
+ * @param scr Register to populate
+ */
+static void build_scr(uint8_t scr[8])
+{
+    memset(scr, 0, 8);
+
+    reg_set(scr, 8, 59, 56, 2);   // SD_SPEC, 2.00
+    reg_set(scr, 8, 51, 48, 0x5); // SD_BUS_WIDTHS, 1-bit and 4-bit
+    reg_set(scr, 8, 47, 47, 1);   // SD_SPEC3, 3.0x
+}
+
+/**
+ * @brief Builds the switch status returned by CMD6, and switches the access mode in set mode
+ *
+ * @param emu Emulated card
+ * @param arg CMD6 argument
+ * @param status Register to populate
+ */
+static void build_switch_status(sd_emu_t *emu, uint32_t arg, uint8_t status[64])
+{
+    uint32_t access = arg & 0xF;
+    bool ok = access == 0xF || access <= 1;
+
+    memset(status, 0, 64);
+
+    reg_set(status, 64, 511, 496, ok ? 100 : 0); // Maximum current, 100mA
+    reg_set(status, 64, 415, 400, 0x8003);       // Group 1: default and high speed
+    reg_set(status, 64, 375, 368, 1);            // Data structure version
+
+    // Groups 2-6 only support their default function
+    for (unsigned g = 1; g < 6; g++)
+        reg_set(status, 64, 415 + 16 * g, 400 + 16 * g, 0x8001);
+
+    // Function group 1 result, the current function for no change, 0xF if unsupported
+    if (access == 0xF)
+        access = emu->high_speed;
+    else if (!ok)
+        access = 0xF;
+    reg_set(status, 64, 379, 376, access);
+
+    if ((arg & 0x80000000) && ok)
+        emu->high_speed = access == 1;
+}
+
+/**
+ * @brief Converts a timing field to the unit of the current bus
+ *
+ * @param emu Emulated card
+ * @param n SPI byte times
+ * @return Bytes in SPI mode, clock cycles on the SD bus
+ */
+static uint32_t byte_times(sd_emu_t *emu, uint32_t n)
+{
+    return emu->spi_mode ? n : n * 8;
+}
+
+/**
+ * @brief Converts a time to SPI byte times (8 clock cycles) at a clock
+ *
+ * @param us Time in microseconds
+ * @param clock_hz Bus clock
+ * @return Byte times, rounded up and at least one
+ */
+static uint32_t us_to_bytes(uint32_t us, uint32_t clock_hz)
+{
+    uint64_t n = ((uint64_t)us * clock_hz + 7999999) / 8000000;
+    return n ? (uint32_t)n : 1;
+}
+
+/**
+ * @brief Marks a range of blocks erased
+ *
+ * @param emu Emulated card
+ * @param start First block
+ * @param end Last block, inclusive
+ */
+static void mark_erased(sd_emu_t *emu, uint32_t start, uint32_t end)
+{
+    if (!emu->erased)
+        return;
+
+    for (uint32_t lba = start; lba <= end; lba++)
+        emu->erased[lba / 8] |= (uint8_t)(1u << (lba % 8));
+}
+
+/**
+ * @brief Busy time of a block being programmed. A block going to flash erased by CMD38 takes the
+ * write time. An overwrite takes the overwrite time on its own, but a CMD25 pays it once, for
+ * its first block: the blocks ACMD23 announced were pre-erased along with it and take the write
+ * time, any further ones the midpoint of the two
+ *
+ * @param emu Emulated card
+ * @param lba Block programmed
+ * @return SPI byte times
+ */
+static uint32_t program_bytes(sd_emu_t *emu, uint32_t lba)
+{
+    uint8_t bit = (uint8_t)(1u << (lba % 8));
+    uint32_t done = emu->wr_done++;
+
+    if (emu->erased && (emu->erased[lba / 8] & bit))
+    {
+        emu->erased[lba / 8] &= (uint8_t)~bit;
+        return emu->busy_bytes;
+    }
+
+    if (!emu->wr_multi || !done)
+        return emu->overwrite_busy_bytes;
+
+    if (done < emu->pre_erase)
+        return emu->busy_bytes;
+
+    return (uint32_t)(((uint64_t)emu->busy_bytes + emu->overwrite_busy_bytes) / 2);
+}
+
+/**
+ * @brief Queues a register to be sent as a data block after the read access time
+ *
+ * @param emu Emulated card
+ * @param len Register length, contents already placed in reg
+ */
+static void queue_reg_read(sd_emu_t *emu, uint32_t len)
+{
+    emu->reg_len = len;
+    emu->rd_remaining = 1;
+    emu->gap = byte_times(emu, emu->nac_bytes);
+}
+
+/**
+ * @brief Appends a byte to the MISO FIFO
+ *
+ * @param emu Emulated card
+ * @param b Byte to queue
+ */
+static void fifo_put(sd_emu_t *emu, uint8_t b)
+{
+    if (emu->fifo_head + emu->fifo_len >= SD_EMU_FIFO_LEN)
+    {
+        // Compact the FIFO back to the start of the buffer
+        memmove(emu->fifo, emu->fifo + emu->fifo_head, emu->fifo_len);
+        emu->fifo_head = 0;
+    }
+
+    if (emu->fifo_len < SD_EMU_FIFO_LEN)
+        emu->fifo[emu->fifo_head + emu->fifo_len++] = b;
+}
+
+/**
+ * @brief Discards everything queued for MISO
+ *
+ * @param emu Emulated card
+ */
+static void fifo_clear(sd_emu_t *emu)
+{
+    emu->fifo_head = 0;
+    emu->fifo_len = 0;
+    emu->busy = 0;
+    emu->gap = 0;
+    emu->rd_remaining = 0;
+    emu->reg_len = 0;
+}
+
+/**
+ * @brief Queues a data block, start block token followed by the data and its CRC16
+ *
+ * @param emu Emulated card
+ * @param data Block contents
+ * @param n Block length
+ */
+static void queue_block(sd_emu_t *emu, const uint8_t *data, size_t n)
+{
+    uint16_t crc = sd_emu_crc16(data, n);
+
+    fifo_put(emu, TOKEN_START_BLOCK);
+    for (size_t i = 0; i < n; i++)
+        fifo_put(emu, data[i]);
+    fifo_put(emu, crc >> 8);
+    fifo_put(emu, crc & 0xFF);
+}
+
+/**
+ * @brief Queues a R1 response, preceded by the NCR delay
+ *
+ * @param emu Emulated card
+ * @param r1 R1 error bits, the idle bit is added from the card state
+ */
+static void queue_r1(sd_emu_t *emu, uint8_t r1)
+{
+    for (uint32_t i = 0; i < emu->ncr_bytes; i++)
+        fifo_put(emu, 0xFF);
+
+    fifo_put(emu, r1 | (emu->idle ? R1_IDLE_MASK : 0));
+}
+
+/**
+ * @brief Queues a 32 bit big endian response trailer (R3/R7)
+ *
+ * @param emu Emulated card
+ * @param v Value to queue
+ */
+static void queue_u32(sd_emu_t *emu, uint32_t v)
+{
+    fifo_put(emu, v >> 24);
+    fifo_put(emu, v >> 16);
+    fifo_put(emu, v >> 8);
+    fifo_put(emu, v);
+}
+
+/**
+ * @brief Converts a command address argument to a block number
+ *
+ * @param emu Emulated card
+ * @param arg Command argument
+ * @param lba Block number
+ * @return R1 error bits, 0 if the address is valid
+ */
+static uint8_t arg_to_lba(sd_emu_t *emu, uint32_t arg, uint32_t *lba)
+{
+    if (emu->high_capacity)
+        *lba = arg;
+    else if (arg % SD_EMU_BLOCK_LEN)
+        return R1_ADDRESS_MASK;
+    else
+        *lba = arg / SD_EMU_BLOCK_LEN;
+
+    if (*lba >= emu->blocks)
+    {
+        emu->status |= R2_OUT_OF_RANGE_MASK;
+        return R1_PARAM_MASK;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Puts the card back into its power-on state
+ *
+ * @param emu Emulated card
+ */
+static void reset_card(sd_emu_t *emu)
+{
+    fifo_clear(emu);
+    emu->idle = true;
+    emu->if_cond = false;
+    emu->app_cmd = false;
+    emu->crc_on = false;
+    emu->high_speed = false;
+    emu->op_cond_polls = 0;
+    emu->pre_erase = 0;
+    emu->status = 0;
+    emu->erase_start = UINT32_MAX;
+    emu->erase_end = UINT32_MAX;
+    emu->rx = SD_EMU_RX_CMD;
+
+    emu->rca = 0;
+    emu->cs_state = CS_STATE_IDLE;
+    emu->cs = 0;
+    emu->bus_width = 1;
+    emu->cmd_in_bits = 0;
+    emu->cmd_out_bits = 0;
+    emu->cmd_out_pos = 0;
+    emu->cmd_delay = 0;
+    emu->dat_head = 0;
+    emu->dat_len = 0;
+}
+
+/**
+ * @brief Executes an application command (the command after a CMD55)
+ *
+ * @param emu Emulated card
+ * @param cmd Command index
+ * @param arg Command argument
+ */
+static void exec_acmd(sd_emu_t *emu, uint8_t cmd, uint32_t arg)
+{
+    switch (cmd)
+    {
+    case ACMD_SD_SEND_OP_COND:
+        // A SDHC card never leaves idle unless the host declared HCS after a CMD8
+        if (emu->idle && (!emu->high_capacity || (emu->if_cond && (arg & 0x40000000))))
+        {
+            if (++emu->op_cond_polls >= emu->init_polls)
+                emu->idle = false;
+        }
+        queue_r1(emu, 0);
+        break;
+    case ACMD_SD_STATUS:
+        if (emu->idle)
+        {
+            queue_r1(emu, R1_ILLEGAL_CMD_MASK);
+            break;
+        }
+        // R2, then the status as a data block
+        queue_r1(emu, 0);
+        fifo_put(emu, emu->status);
+        emu->status = 0;
+        build_sd_status(emu, emu->reg);
+        queue_reg_read(emu, 64);
+        break;
+    case ACMD_SEND_SCR:
+        if (emu->idle)
+        {
+            queue_r1(emu, R1_ILLEGAL_CMD_MASK);
+            break;
+        }
+        queue_r1(emu, 0);
+        build_scr(emu->reg);
+        queue_reg_read(emu, 8);
+        break;
+    case ACMD_SET_WR_BLK_ERASE_COUNT:
+        if (emu->idle)
+        {
+            queue_r1(emu, R1_ILLEGAL_CMD_MASK);
+            break;
+        }
+        emu->pre_erase = arg & 0x7FFFFF;
+        queue_r1(emu, 0);
+        break;
+    default:
+        queue_r1(emu, R1_ILLEGAL_CMD_MASK);
+        break;
+    }
+}
+
+/**
+ * @brief Executes a complete command frame
+ *
+ * @param emu Emulated card
+ */
+static void exec_cmd(sd_emu_t *emu)
+{
+    uint8_t cmd = emu->frame[0] & 0x3F;
+    uint32_t arg = ((uint32_t)emu->frame[1] << 24) | ((uint32_t)emu->frame[2] << 16) |
+                   ((uint32_t)emu->frame[3] << 8) | emu->frame[4];
+    bool app = emu->app_cmd;
+    uint32_t lba;
+    uint8_t err;
+
+    // The card only answers on DO once CMD0 switched it to SPI mode
+    if (!emu->spi_mode && cmd != CMD_GO_IDLE_STATE)
+        return;
+
+    // CMD12 terminates a CMD18 stream. The byte following the command is a stuff byte
+    if (cmd == CMD_STOP_TRANSMISSION && emu->rd_remaining)
+    {
+        uint8_t stuff = emu->fifo_len ? emu->fifo[emu->fifo_head] : 0xFF;
+        fifo_clear(emu);
+        fifo_put(emu, stuff);
+    }
+    else
+    {
+        fifo_clear(emu);
+    }
+
+    // CMD0 and CMD8 are always CRC checked, everything else only once enabled by CMD59
+    bool check_crc = emu->crc_on || cmd == CMD_GO_IDLE_STATE || cmd == CMD_SEND_IF_COND;
+    if (check_crc && (emu->frame[5] >> 1) != sd_emu_crc7(emu->frame, 5))
+    {
+        queue_r1(emu, R1_COM_CRC_MASK);
+        return;
+    }
+
+    emu->app_cmd = false;
+    if (app)
+    {
+        exec_acmd(emu, cmd, arg);
+        return;
+    }
+
+    // Only the identification commands are accepted while idle
+    if (emu->idle && cmd != CMD_GO_IDLE_STATE && cmd != CMD_SEND_IF_COND && cmd != CMD_APP_CMD &&
+        cmd != CMD_READ_OCR && cmd != CMD_CRC_ON_OFF)
+    {
+        queue_r1(emu, R1_ILLEGAL_CMD_MASK);
+        return;
+    }
+
+    switch (cmd)
+    {
+    case CMD_GO_IDLE_STATE:
+        reset_card(emu);
+        emu->spi_mode = true;
+        queue_r1(emu, 0);
+        break;
+
+    case CMD_SEND_IF_COND:
+        // R7 echoes the voltage and check pattern if the voltage is supported
+        if (((arg >> 8) & 0xF) != 0x1)
+        {
+            queue_r1(emu, R1_ILLEGAL_CMD_MASK);
+            break;
+        }
+        emu->if_cond = true;
+        queue_r1(emu, 0);
+        queue_u32(emu, arg & 0xFFF);
+        break;
+
+    case CMD_APP_CMD:
+        emu->app_cmd = true;
+        queue_r1(emu, 0);
+        break;
+
+    case CMD_READ_OCR:
+    {
+        // Voltage window 2.7-3.6V, power up status and CCS once initialized
+        uint32_t ocr = 0x00FF8000;
+        if (!emu->idle)
+            ocr |= 0x80000000 | (emu->high_capacity ? 0x40000000 : 0);
+        queue_r1(emu, 0);
+        queue_u32(emu, ocr);
+    }
+    break;
+
+    case CMD_CRC_ON_OFF:
+        emu->crc_on = arg & 0x01;
+        queue_r1(emu, 0);
+        break;
+
+    case CMD_SET_BLOCKLEN:
+        // SDHC/SDXC ignore the block length, SDSC cards only support 512 here
+        queue_r1(emu, (emu->high_capacity || arg == SD_EMU_BLOCK_LEN) ? 0 : R1_PARAM_MASK);
+        break;
+
+    case CMD_SEND_CSD:
+        queue_r1(emu, 0);
+        build_csd(emu, emu->reg);
+        queue_reg_read(emu, 16);
+        break;
+
+    case CMD_SEND_CID:
+        queue_r1(emu, 0);
+        build_cid(emu, emu->reg);
+        queue_reg_read(emu, 16);
+        break;
+
+    case CMD_SEND_STATUS:
+        queue_r1(emu, 0);
+        fifo_put(emu, emu->status);
+        emu->status = 0;
+        break;
+
+    case CMD_STOP_TRANSMISSION:
+        queue_r1(emu, 0);
+        emu->busy = 2;
+        break;
+
+    case CMD_SWITCH_FUNC:
+        queue_r1(emu, 0);
+        build_switch_status(emu, arg, emu->reg);
+        queue_reg_read(emu, 64);
+        break;
+
+    case CMD_READ_SINGLE_BLOCK:
+    case CMD_READ_MULTIPLE_BLOCK:
+        err = arg_to_lba(emu, arg, &lba);
+        queue_r1(emu, err);
+        if (err)
+            break;
+
+        // Data blocks are produced as the FIFO drains
+        emu->rd_lba = lba;
+        emu->rd_remaining = cmd == CMD_READ_SINGLE_BLOCK ? 1 : UINT32_MAX;
+        emu->gap = emu->nac_bytes;
+        break;
+
+    case CMD_WRITE_BLOCK:
+    case CMD_WRITE_MULTIPLE_BLOCK:
+        err = arg_to_lba(emu, arg, &lba);
+        queue_r1(emu, err);
+        if (err)
+            break;
+
+        emu->wr_lba = lba;
+        emu->wr_done = 0;
+        emu->wr_multi = cmd == CMD_WRITE_MULTIPLE_BLOCK;
+        if (!emu->wr_multi)
+            emu->pre_erase = 0;
+        emu->rx = SD_EMU_RX_WR_TOKEN;
+        break;
+
+    case CMD_ERASE_WR_BLK_START:
+    case CMD_ERASE_WR_BLK_END:
+        err = arg_to_lba(emu, arg, &lba);
+        queue_r1(emu, err);
+        if (err)
+            break;
+
+        if (cmd == CMD_ERASE_WR_BLK_START)
+            emu->erase_start = lba;
+        else
+            emu->erase_end = lba;
+        break;
+
+    case CMD_ERASE:
+        if (emu->erase_start == UINT32_MAX || emu->erase_end == UINT32_MAX ||
+            emu->erase_end < emu->erase_start)
+        {
+            emu->erase_start = UINT32_MAX;
+            emu->erase_end = UINT32_MAX;
+            queue_r1(emu, R1_ERASE_SEQ_MASK);
+            break;
+        }
+
+        // Erased blocks read back as zeroes (SCR DATA_STAT_AFTER_ERASE = 0)
+        memset(emu->image + (uint64_t)emu->erase_start * SD_EMU_BLOCK_LEN,
+               0,
+               (uint64_t)(emu->erase_end - emu->erase_start + 1) * SD_EMU_BLOCK_LEN);
+        mark_erased(emu, emu->erase_start, emu->erase_end);
+        emu->erase_start = UINT32_MAX;
+        emu->erase_end = UINT32_MAX;
+        queue_r1(emu, 0);
+        emu->busy = emu->erase_busy_bytes;
+        break;
+
+    default:
+        queue_r1(emu, R1_ILLEGAL_CMD_MASK);
+        break;
+    }
+}
+
+/**
+ * @brief Handles a byte received while a write is in progress
+ *
+ * @param emu Emulated card
+ * @param mosi Byte received
+ */
+static void rx_write(sd_emu_t *emu, uint8_t mosi)
+{
+    if (emu->rx == SD_EMU_RX_WR_TOKEN)
+    {
+        if (mosi == (emu->wr_multi ? TOKEN_START_BLOCK_MULTI : TOKEN_START_BLOCK))
+        {
+            emu->rx = SD_EMU_RX_WR_DATA;
+            emu->wr_len = 0;
+        }
+        else if (emu->wr_multi && mosi == TOKEN_STOP_TRAN)
+        {
+            emu->pre_erase = 0;
+            // One byte gap, then busy while the card finishes programming
+            emu->rx = SD_EMU_RX_CMD;
+            fifo_put(emu, 0xFF);
+            emu->busy = emu->busy_bytes;
+        }
+        return;
+    }
+
+    emu->wr_buf[emu->wr_len++] = mosi;
+    if (emu->wr_len < sizeof(emu->wr_buf))
+        return;
+
+    // Full block and CRC received, answer with a data response token
+    uint8_t resp = DATA_RESP_ACCEPTED;
+    uint32_t busy = emu->busy_bytes;
+    uint16_t crc =
+        ((uint16_t)emu->wr_buf[SD_EMU_BLOCK_LEN] << 8) | emu->wr_buf[SD_EMU_BLOCK_LEN + 1];
+
+    if (emu->crc_on && crc != sd_emu_crc16(emu->wr_buf, SD_EMU_BLOCK_LEN))
+    {
+        resp = DATA_RESP_CRC_ERR;
+    }
+    else if (emu->wr_lba >= emu->blocks)
+    {
+        emu->status |= R2_OUT_OF_RANGE_MASK;
+        resp = DATA_RESP_WRITE_ERR;
+    }
+    else
+    {
+        memcpy(
+            emu->image + (uint64_t)emu->wr_lba * SD_EMU_BLOCK_LEN, emu->wr_buf, SD_EMU_BLOCK_LEN);
+        busy = program_bytes(emu, emu->wr_lba);
+        emu->wr_lba++;
+    }
+
+    // The upper bits of the token are undefined, real cards commonly drive them high
+    fifo_put(emu, 0xE0 | resp);
+    emu->busy = busy;
+
+    // A rejected block ends a multi-block write, the host is expected to stop it
+    emu->rx = (emu->wr_multi && resp == DATA_RESP_ACCEPTED) ? SD_EMU_RX_WR_TOKEN : SD_EMU_RX_CMD;
+}
+
+/**
+ * @brief Produces the next MISO byte
+ *
+ * @param emu Emulated card
+ * @return Byte driven by the card
+ */
+static uint8_t tx_next(sd_emu_t *emu)
+{
+    if (emu->fifo_len)
+    {
+        emu->fifo_len--;
+        return emu->fifo[emu->fifo_head++];
+    }
+
+    if (emu->busy)
+    {
+        emu->busy--;
+        return 0x00;
+    }
+
+    if (emu->gap)
+    {
+        emu->gap--;
+        return 0xFF;
+    }
+
+    if (emu->rd_remaining)
+    {
+        emu->fifo_head = 0;
+        if (emu->reg_len)
+        {
+            // Register reads are a single short data block
+            queue_block(emu, emu->reg, emu->reg_len);
+            emu->reg_len = 0;
+            emu->rd_remaining = 0;
+        }
+        else if (emu->rd_lba >= emu->blocks)
+        {
+            // Streamed past the end of the card
+            emu->status |= R2_OUT_OF_RANGE_MASK;
+            emu->rd_remaining = 0;
+            fifo_put(emu, TOKEN_ERR_OUT_OF_RANGE);
+        }
+        else
+        {
+            queue_block(
+                emu, emu->image + (uint64_t)emu->rd_lba * SD_EMU_BLOCK_LEN, SD_EMU_BLOCK_LEN);
+            emu->rd_lba++;
+            if (emu->rd_remaining != UINT32_MAX)
+                emu->rd_remaining--;
+            emu->gap = emu->nac_bytes;
+        }
+
+        emu->fifo_len--;
+        return emu->fifo[emu->fifo_head++];
+    }
+
+    return 0xFF;
+}
+
+// ========== Native SD Bus ==========
+
+/**
+ * @brief Bit mask of a card state, for state_in
+ */
+#define ST(X) (1u << CS_STATE_##X)
+
+/**
+ * @brief Whether the card is in one of a set of states
+ *
+ * @param emu Emulated card
+ * @param states Mask of ST() states
+ * @return Whether the current state is in the set
+ */
+static bool state_in(sd_emu_t *emu, uint32_t states)
+{
+    return (states >> emu->cs_state) & 1;
+}
+
+/**
+ * @brief Lines of one clock cycle in a packed DAT buffer
+ *
+ * @param buf Packed cycles
+ * @param width Bus width, 1 or 4
+ * @param i Cycle index
+ * @return DAT3..DAT0, the unused lines of a 1-bit bus read high
+ */
+static unsigned get_cycle(const uint8_t *buf, int width, size_t i)
+{
+    if (width == 4)
+        return (buf[i / 2] >> ((i % 2) ? 0 : 4)) & 0xF;
+
+    return 0xE | ((buf[i / 8] >> (7 - i % 8)) & 1);
+}
+
+/**
+ * @brief Stores the lines of one clock cycle into a packed DAT buffer
+ *
+ * @param buf Packed cycles
+ * @param width Bus width, 1 or 4
+ * @param i Cycle index
+ * @param lines DAT3..DAT0
+ */
+static void put_cycle(uint8_t *buf, int width, size_t i, unsigned lines)
+{
+    if (width == 4)
+    {
+        unsigned shift = (i % 2) ? 0 : 4;
+        buf[i / 2] = (uint8_t)((buf[i / 2] & ~(0xF << shift)) | ((lines & 0xF) << shift));
+        return;
+    }
+
+    uint8_t mask = 0x80 >> (i % 8);
+    buf[i / 8] = (lines & 1) ? (buf[i / 8] | mask) : (buf[i / 8] & ~mask);
+}
+
+/**
+ * @brief Feeds one bit into a CRC16-CCITT
+ *
+ * @param crc CRC so far
+ * @param bit Bit to add
+ * @return Updated CRC
+ */
+static uint16_t crc16_bit(uint16_t crc, unsigned bit)
+{
+    bool feedback = ((crc >> 15) ^ bit) & 1;
+
+    crc = (uint16_t)(crc << 1);
+    return feedback ? crc ^ 0x1021 : crc;
+}
+
+/**
+ * @brief CRC16 of a data block per DAT line, as sent after the block
+ *
+ * @param data Block contents
+ * @param n Block length
+ * @param width Bus width, 1 or 4
+ * @param crc Output, the CRC of DATk in crc[k]
+ */
+static void line_crcs(const uint8_t *data, size_t n, int width, uint16_t crc[4])
+{
+    memset(crc, 0, 4 * sizeof(crc[0]));
+
+    for (size_t i = 0; i < n * 8 / width; i++)
+    {
+        unsigned lines = get_cycle(data, width, i);
+        for (int k = 0; k < width; k++)
+            crc[k] = crc16_bit(crc[k], (lines >> k) & 1);
+    }
+}
+
+/**
+ * @brief Appends a cycle to the DAT FIFO
+ *
+ * @param emu Emulated card
+ * @param lines DAT3..DAT0
+ */
+static void dat_put(sd_emu_t *emu, unsigned lines)
+{
+    if (emu->dat_head + emu->dat_len >= SD_EMU_DAT_FIFO_LEN)
+    {
+        memmove(emu->dat_fifo, emu->dat_fifo + emu->dat_head, emu->dat_len);
+        emu->dat_head = 0;
+    }
+
+    if (emu->dat_len < SD_EMU_DAT_FIFO_LEN)
+        emu->dat_fifo[emu->dat_head + emu->dat_len++] = lines & 0xF;
+}
+
+/**
+ * @brief Queues a data block on the DAT lines: start bit, data, CRC16 per line and end bit
+ *
+ * @param emu Emulated card
+ * @param data Block contents
+ * @param n Block length
+ */
+static void dat_queue_block(sd_emu_t *emu, const uint8_t *data, size_t n)
+{
+    int w = emu->bus_width;
+    unsigned idle = (w == 4) ? 0x0 : 0xE; // Lines the card doesn't drive stay high
+    uint16_t crc[4];
+
+    line_crcs(data, n, w, crc);
+
+    dat_put(emu, idle);
+    for (size_t i = 0; i < n * 8 / w; i++)
+        dat_put(emu, get_cycle(data, w, i));
+
+    for (unsigned c = 0; c < 16; c++)
+    {
+        unsigned lines = idle;
+        for (int k = 0; k < w; k++)
+            lines |= ((crc[k] >> (15 - c)) & 1) << k;
+        dat_put(emu, lines);
+    }
+
+    dat_put(emu, 0xF);
+}
+
+/**
+ * @brief Queues the CRC status of a written block on DAT0: start bit, 3 status bits, end bit
+ *
+ * @param emu Emulated card
+ * @param token Status, 010 accepted, 101 CRC error, 110 write error
+ */
+static void dat_queue_crc_status(sd_emu_t *emu, uint8_t token)
+{
+    // Two cycles after the end bit of the block
+    dat_put(emu, 0xF);
+    dat_put(emu, 0xF);
+
+    dat_put(emu, 0xE);
+    for (int bit = 2; bit >= 0; bit--)
+        dat_put(emu, 0xE | ((token >> bit) & 1));
+    dat_put(emu, 0xF);
+}
+
+/**
+ * @brief Queues a response on the CMD line, after the NCR delay
+ *
+ * @param emu Emulated card
+ * @param r Response, start bit first
+ * @param len Response length in bytes
+ */
+static void cmd_queue(sd_emu_t *emu, const uint8_t *r, size_t len)
+{
+    memcpy(emu->cmd_out, r, len);
+    emu->cmd_out_bits = (uint32_t)len * 8;
+    emu->cmd_out_pos = 0;
+    emu->cmd_delay = byte_times(emu, emu->ncr_bytes);
+}
+
+/**
+ * @brief Queues a 48 bit response (R1, R3, R6, R7)
+ *
+ * @param emu Emulated card
+ * @param index Command index field, 0x3F for R3
+ * @param payload 32 bit payload
+ * @param crc Whether the response carries a CRC7, R3 has all ones instead
+ */
+static void native_resp48(sd_emu_t *emu, uint8_t index, uint32_t payload, bool crc)
+{
+    uint8_t r[6] = {index & 0x3F, payload >> 24, payload >> 16, payload >> 8, payload, 0xFF};
+
+    if (crc)
+        r[5] = (uint8_t)((sd_emu_crc7(r, 5) << 1) | 0x01);
+
+    cmd_queue(emu, r, sizeof(r));
+}
+
+/**
+ * @brief Queues a R2 response carrying a CID or CSD, whose last byte holds its own CRC7
+ *
+ * @param emu Emulated card
+ * @param reg Register
+ */
+static void native_r2(sd_emu_t *emu, const uint8_t reg[16])
+{
+    uint8_t r[17];
+
+    r[0] = 0x3F;
+    memcpy(r + 1, reg, 16);
+    cmd_queue(emu, r, sizeof(r));
+}
+
+/**
+ * @brief Card status as reported by a R1, in the state the command was received in
+ *
+ * @param emu Emulated card
+ * @param extra Error bits of the command itself
+ * @return Card status, pending error bits are cleared
+ */
+static uint32_t native_status(sd_emu_t *emu, uint32_t extra)
+{
+    uint32_t cs = emu->cs | extra | ((uint32_t)emu->cs_state << 9);
+
+    if (!emu->busy && emu->cs_state != CS_STATE_PRG)
+        cs |= CS_READY_FOR_DATA;
+    if (emu->app_cmd)
+        cs |= CS_APP_CMD;
+
+    emu->cs = 0;
+    return cs;
+}
+
+/**
+ * @brief Queues a R1 (or R1b) response
+ *
+ * @param emu Emulated card
+ * @param cmd Command index
+ * @param extra Error bits of the command itself
+ */
+static void native_r1(sd_emu_t *emu, uint8_t cmd, uint32_t extra)
+{
+    native_resp48(emu, cmd, native_status(emu, extra), true);
+}
+
+/**
+ * @brief Rejects a command, the card doesn't answer and flags it in the next response
+ *
+ * @param emu Emulated card
+ */
+static void native_illegal(sd_emu_t *emu)
+{
+    emu->cs |= CS_ILLEGAL_COMMAND;
+}
+
+/**
+ * @brief Converts a command address argument to a block number
+ *
+ * @param emu Emulated card
+ * @param arg Command argument
+ * @param lba Block number
+ * @return Card status error bits, 0 if the address is valid
+ */
+static uint32_t native_lba(sd_emu_t *emu, uint32_t arg, uint32_t *lba)
+{
+    uint8_t err = arg_to_lba(emu, arg, lba);
+
+    // arg_to_lba flags the SPI R2 as well
+    emu->status = 0;
+
+    if (err & R1_ADDRESS_MASK)
+        return CS_ADDRESS_ERROR;
+
+    return err ? CS_OUT_OF_RANGE : 0;
+}
+
+/**
+ * @brief Starts sending a register as a data block
+ *
+ * @param emu Emulated card
+ * @param len Register length, contents already placed in reg
+ */
+static void native_reg_read(sd_emu_t *emu, uint32_t len)
+{
+    queue_reg_read(emu, len);
+    emu->cs_state = CS_STATE_DATA;
+}
+
+/**
+ * @brief Executes an application command received on the SD bus
+ *
+ * @param emu Emulated card
+ * @param cmd Command index
+ * @param arg Command argument
+ */
+static void exec_native_acmd(sd_emu_t *emu, uint8_t cmd, uint32_t arg)
+{
+    switch (cmd)
+    {
+    case ACMD_SD_SEND_OP_COND:
+    {
+        if (!state_in(emu, ST(IDLE)))
+        {
+            native_illegal(emu);
+            break;
+        }
+
+        // Same as SPI mode, then the OCR reports the card busy until it's ready
+        if (!emu->high_capacity || (emu->if_cond && (arg & 0x40000000)))
+            emu->op_cond_polls++;
+
+        uint32_t ocr = 0x00FF8000;
+        if (emu->op_cond_polls >= emu->init_polls)
+        {
+            ocr |= 0x80000000 | (emu->high_capacity ? 0x40000000 : 0);
+            emu->idle = false;
+            emu->cs_state = CS_STATE_READY;
+        }
+        native_resp48(emu, 0x3F, ocr, false);
+    }
+    break;
+
+    case ACMD_SET_BUS_WIDTH:
+        if (!state_in(emu, ST(TRAN)) || ((arg & 3) != 0 && (arg & 3) != 2))
+        {
+            native_illegal(emu);
+            break;
+        }
+        native_r1(emu, cmd, CS_APP_CMD);
+        emu->bus_width = (arg & 3) ? 4 : 1;
+        break;
+
+    case ACMD_SD_STATUS:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        native_r1(emu, cmd, CS_APP_CMD);
+        build_sd_status(emu, emu->reg);
+        native_reg_read(emu, 64);
+        break;
+
+    case ACMD_SEND_SCR:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        native_r1(emu, cmd, CS_APP_CMD);
+        build_scr(emu->reg);
+        native_reg_read(emu, 8);
+        break;
+
+    case ACMD_SET_WR_BLK_ERASE_COUNT:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        emu->pre_erase = arg & 0x7FFFFF;
+        native_r1(emu, cmd, CS_APP_CMD);
+        break;
+
+    default:
+        native_illegal(emu);
+        break;
+    }
+}
+
+/**
+ * @brief Executes a command received on the SD bus. Unlike SPI mode, rejected commands get no
+ * response at all
+ *
+ * @param emu Emulated card
+ */
+static void exec_native(sd_emu_t *emu)
+{
+    uint8_t cmd = emu->cmd_in[0] & 0x3F;
+    uint32_t arg = ((uint32_t)emu->cmd_in[1] << 24) | ((uint32_t)emu->cmd_in[2] << 16) |
+                   ((uint32_t)emu->cmd_in[3] << 8) | emu->cmd_in[4];
+    bool addressed = (arg >> 16) == emu->rca;
+    bool app = emu->app_cmd;
+    uint32_t lba, err;
+
+    // Transmission bit (host to card), CRC7 and end bit are always checked on the SD bus
+    if (!(emu->cmd_in[0] & 0x40) || emu->cmd_in[5] != ((sd_emu_crc7(emu->cmd_in, 5) << 1) | 1))
+    {
+        emu->cs |= CS_COM_CRC_ERROR;
+        return;
+    }
+
+    emu->app_cmd = false;
+    if (app && cmd != CMD_GO_IDLE_STATE)
+    {
+        exec_native_acmd(emu, cmd, arg);
+        return;
+    }
+
+    switch (cmd)
+    {
+    case CMD_GO_IDLE_STATE:
+        // No response
+        reset_card(emu);
+        break;
+
+    case CMD_SEND_IF_COND:
+        // R7 echoes the voltage and check pattern, an unsupported voltage gets no response
+        if (!state_in(emu, ST(IDLE)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        if (((arg >> 8) & 0xF) != 0x1)
+            break;
+        emu->if_cond = true;
+        native_resp48(emu, cmd, arg & 0xFFF, true);
+        break;
+
+    case CMD_APP_CMD:
+        // Addressed, except before the card has an RCA
+        if (!state_in(emu, ST(IDLE)) && !addressed)
+            break;
+        emu->app_cmd = true;
+        native_r1(emu, cmd, 0);
+        break;
+
+    case CMD_ALL_SEND_CID:
+        if (!state_in(emu, ST(READY)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        build_cid(emu, emu->reg);
+        native_r2(emu, emu->reg);
+        emu->cs_state = CS_STATE_IDENT;
+        break;
+
+    case CMD_SEND_RELATIVE_ADDR:
+    {
+        if (!state_in(emu, ST(IDENT) | ST(STBY)))
+        {
+            native_illegal(emu);
+            break;
+        }
+
+        // R6: RCA, then card status bits 23, 22, 19 and 12:0
+        uint32_t cs = native_status(emu, 0);
+        emu->rca = SD_EMU_RCA;
+        native_resp48(emu,
+                      cmd,
+                      ((uint32_t)emu->rca << 16) | ((cs >> 8) & 0xC000) | ((cs >> 6) & 0x2000) |
+                          (cs & 0x1FFF),
+                      true);
+        emu->cs_state = CS_STATE_STBY;
+    }
+    break;
+
+    case CMD_SEND_CSD:
+    case CMD_SEND_CID:
+        if (!addressed)
+            break;
+        if (!state_in(emu, ST(STBY)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        if (cmd == CMD_SEND_CSD)
+            build_csd(emu, emu->reg);
+        else
+            build_cid(emu, emu->reg);
+        native_r2(emu, emu->reg);
+        break;
+
+    case CMD_SELECT_CARD:
+        // Any other address deselects the card, without a response
+        if (!addressed)
+        {
+            if (state_in(emu, ST(TRAN)))
+                emu->cs_state = CS_STATE_STBY;
+            break;
+        }
+        if (!state_in(emu, ST(STBY) | ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        native_r1(emu, cmd, 0);
+        emu->cs_state = CS_STATE_TRAN;
+        break;
+
+    case CMD_SEND_STATUS:
+        if (!addressed)
+            break;
+        if (!state_in(emu, ST(STBY) | ST(TRAN) | ST(DATA) | ST(RCV) | ST(PRG)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        native_r1(emu, cmd, 0);
+        break;
+
+    case CMD_STOP_TRANSMISSION:
+        if (!state_in(emu, ST(DATA) | ST(RCV)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        native_r1(emu, cmd, 0);
+
+        if (emu->cs_state == CS_STATE_DATA)
+        {
+            // Ends the read stream, a block in flight is cut off
+            emu->dat_len = 0;
+            emu->gap = 0;
+            emu->rd_remaining = 0;
+            emu->reg_len = 0;
+            emu->cs_state = CS_STATE_TRAN;
+            break;
+        }
+
+        // A partially received block is dropped, then busy while the card finishes programming
+        emu->rx = SD_EMU_RX_CMD;
+        emu->pre_erase = 0;
+        emu->cs_state = CS_STATE_PRG;
+        if (!emu->busy)
+            emu->busy = byte_times(emu, emu->busy_bytes);
+        break;
+
+    case CMD_SWITCH_FUNC:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        native_r1(emu, cmd, 0);
+        build_switch_status(emu, arg, emu->reg);
+        native_reg_read(emu, 64);
+        break;
+
+    case CMD_SET_BLOCKLEN:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        // SDHC/SDXC ignore the block length, SDSC cards only support 512 here
+        native_r1(emu,
+                  cmd,
+                  (emu->high_capacity || arg == SD_EMU_BLOCK_LEN) ? 0 : CS_BLOCK_LEN_ERROR);
+        break;
+
+    case CMD_READ_SINGLE_BLOCK:
+    case CMD_READ_MULTIPLE_BLOCK:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        err = native_lba(emu, arg, &lba);
+        native_r1(emu, cmd, err);
+        if (err)
+            break;
+
+        // Data blocks are produced as the DAT lines are clocked
+        emu->rd_lba = lba;
+        emu->rd_remaining = cmd == CMD_READ_SINGLE_BLOCK ? 1 : UINT32_MAX;
+        emu->gap = byte_times(emu, emu->nac_bytes);
+        emu->cs_state = CS_STATE_DATA;
+        break;
+
+    case CMD_WRITE_BLOCK:
+    case CMD_WRITE_MULTIPLE_BLOCK:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        err = native_lba(emu, arg, &lba);
+        native_r1(emu, cmd, err);
+        if (err)
+            break;
+
+        emu->wr_lba = lba;
+        emu->wr_done = 0;
+        emu->wr_multi = cmd == CMD_WRITE_MULTIPLE_BLOCK;
+        if (!emu->wr_multi)
+            emu->pre_erase = 0;
+        emu->rx = SD_EMU_RX_WR_TOKEN;
+        emu->cs_state = CS_STATE_RCV;
+        break;
+
+    case CMD_ERASE_WR_BLK_START:
+    case CMD_ERASE_WR_BLK_END:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        err = native_lba(emu, arg, &lba);
+        native_r1(emu, cmd, err);
+        if (err)
+            break;
+
+        if (cmd == CMD_ERASE_WR_BLK_START)
+            emu->erase_start = lba;
+        else
+            emu->erase_end = lba;
+        break;
+
+    case CMD_ERASE:
+        if (!state_in(emu, ST(TRAN)))
+        {
+            native_illegal(emu);
+            break;
+        }
+        if (emu->erase_start == UINT32_MAX || emu->erase_end == UINT32_MAX ||
+            emu->erase_end < emu->erase_start)
+        {
+            emu->erase_start = UINT32_MAX;
+            emu->erase_end = UINT32_MAX;
+            native_r1(emu, cmd, CS_ERASE_SEQ_ERROR);
+            break;
+        }
+
+        memset(emu->image + (uint64_t)emu->erase_start * SD_EMU_BLOCK_LEN,
+               0,
+               (uint64_t)(emu->erase_end - emu->erase_start + 1) * SD_EMU_BLOCK_LEN);
+        mark_erased(emu, emu->erase_start, emu->erase_end);
+        emu->erase_start = UINT32_MAX;
+        emu->erase_end = UINT32_MAX;
+        native_r1(emu, cmd, 0);
+        emu->cs_state = CS_STATE_PRG;
+        emu->busy = byte_times(emu, emu->erase_busy_bytes);
+        break;
+
+    default:
+        native_illegal(emu);
+        break;
+    }
+}
+
+/**
+ * @brief Handles a DAT cycle driven by the host while a write is in progress
+ *
+ * @param emu Emulated card
+ * @param lines DAT3..DAT0 driven by the host
+ */
+static void rx_native_write(sd_emu_t *emu, unsigned lines)
+{
+    int w = emu->bus_width;
+    uint32_t data_cycles = SD_EMU_BLOCK_LEN * 8 / w;
+
+    // The block starts with DAT0 pulled low
+    if (emu->rx == SD_EMU_RX_WR_TOKEN)
+    {
+        if (!(lines & 1))
+        {
+            emu->rx = SD_EMU_RX_WR_DATA;
+            emu->dat_in_cycles = 0;
+            memset(emu->crc_in, 0, sizeof(emu->crc_in));
+        }
+        return;
+    }
+
+    uint32_t i = emu->dat_in_cycles++;
+    if (i < data_cycles)
+    {
+        put_cycle(emu->wr_buf, w, i, lines);
+        return;
+    }
+
+    if (i < data_cycles + 16)
+    {
+        for (int k = 0; k < w; k++)
+            emu->crc_in[k] = (uint16_t)((emu->crc_in[k] << 1) | ((lines >> k) & 1));
+        return;
+    }
+
+    // End bit, answer with the CRC status then stay busy while programming
+    uint16_t crc[4];
+    uint8_t token = 0x2;
+    uint32_t busy = emu->busy_bytes;
+
+    line_crcs(emu->wr_buf, SD_EMU_BLOCK_LEN, w, crc);
+    if (memcmp(crc, emu->crc_in, w * sizeof(crc[0])) || !(lines & 1))
+    {
+        token = 0x5;
+    }
+    else if (emu->wr_lba >= emu->blocks)
+    {
+        emu->cs |= CS_OUT_OF_RANGE;
+        token = 0x6;
+    }
+    else
+    {
+        memcpy(
+            emu->image + (uint64_t)emu->wr_lba * SD_EMU_BLOCK_LEN, emu->wr_buf, SD_EMU_BLOCK_LEN);
+        busy = program_bytes(emu, emu->wr_lba);
+        emu->wr_lba++;
+    }
+
+    dat_queue_crc_status(emu, token);
+    emu->busy = byte_times(emu, busy);
+    emu->cs_state = CS_STATE_PRG;
+
+    // A multi-block write waits for the next block, or CMD12, even after a rejected one
+    emu->rx = emu->wr_multi ? SD_EMU_RX_WR_TOKEN : SD_EMU_RX_CMD;
+}
+
+/**
+ * @brief Produces the next DAT cycle driven by the card
+ *
+ * @param emu Emulated card
+ * @return DAT3..DAT0, high where the card doesn't drive
+ */
+static unsigned tx_native_dat(sd_emu_t *emu)
+{
+    if (emu->dat_len)
+    {
+        emu->dat_len--;
+        return emu->dat_fifo[emu->dat_head++];
+    }
+
+    if (emu->busy)
+    {
+        // Programming finished, back to receiving the next block or to transfer
+        if (!--emu->busy && emu->cs_state == CS_STATE_PRG)
+            emu->cs_state = emu->rx == SD_EMU_RX_CMD ? CS_STATE_TRAN : CS_STATE_RCV;
+        return 0xE;
+    }
+
+    if (emu->gap)
+    {
+        emu->gap--;
+        return 0xF;
+    }
+
+    if (!emu->rd_remaining)
+        return 0xF;
+
+    emu->dat_head = 0;
+    if (emu->reg_len)
+    {
+        dat_queue_block(emu, emu->reg, emu->reg_len);
+        emu->reg_len = 0;
+        emu->rd_remaining = 0;
+    }
+    else if (emu->rd_lba >= emu->blocks)
+    {
+        // Streamed past the end of the card, stays in the data state until CMD12
+        emu->cs |= CS_OUT_OF_RANGE;
+        emu->rd_remaining = 0;
+        return 0xF;
+    }
+    else
+    {
+        dat_queue_block(
+            emu, emu->image + (uint64_t)emu->rd_lba * SD_EMU_BLOCK_LEN, SD_EMU_BLOCK_LEN);
+        emu->rd_lba++;
+        if (emu->rd_remaining != UINT32_MAX)
+            emu->rd_remaining--;
+        emu->gap = byte_times(emu, emu->nac_bytes);
+    }
+
+    if (!emu->rd_remaining)
+        emu->cs_state = CS_STATE_TRAN;
+
+    emu->dat_len--;
+    return emu->dat_fifo[emu->dat_head++];
+}
+
+// ========== Latency Profiles ==========
+
+// Rough figures for a few classes of card. Overwrites include the garbage collection a card
+// does before reprogramming a block
+const sd_emu_profile_t sd_emu_profiles[] = {
+    {.name = "ideal", .read_us = 0, .write_us = 0, .overwrite_us = 0, .erase_us = 0},
+    {.name = "a1", .read_us = 20, .write_us = 40, .overwrite_us = 200, .erase_us = 2000},
+    {.name = "class10", .read_us = 50, .write_us = 80, .overwrite_us = 400, .erase_us = 5000},
+    {.name = "budget", .read_us = 200, .write_us = 300, .overwrite_us = 2000, .erase_us = 20000},
+    {.name = NULL},
+};
+
+// ========== Emulator API ==========
+
+bool sd_emu_open(sd_emu_t *emu, const char *path, uint64_t size)
+{
+    struct stat st;
+
+    memset(emu, 0, sizeof(*emu));
+    emu->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (emu->fd < 0)
+        return false;
+
+    if (fstat(emu->fd, &st) < 0)
+        goto fail;
+
+    // Grow the image if requested
+    if (size && (uint64_t)st.st_size < size)
+    {
+        if (ftruncate(emu->fd, (off_t)size) < 0)
+            goto fail;
+        st.st_size = (off_t)size;
+    }
+
+    emu->blocks = (uint32_t)((uint64_t)st.st_size / SD_EMU_BLOCK_LEN);
+    emu->image_size = (uint64_t)emu->blocks * SD_EMU_BLOCK_LEN;
+    if (!emu->blocks)
+        goto fail;
+
+    emu->image = mmap(NULL, emu->image_size, PROT_READ | PROT_WRITE, MAP_SHARED, emu->fd, 0);
+    if (emu->image == MAP_FAILED)
+    {
+        emu->image = NULL;
+        goto fail;
+    }
+
+    // Defaults resemble a small SDHC card
+    emu->high_capacity = true;
+    emu->tran_speed = 0x32;
+    emu->serial = 0x5D000001;
+    emu->ncr_bytes = 1;
+    emu->nac_bytes = 16;
+    emu->busy_bytes = 64;
+    emu->overwrite_busy_bytes = 64;
+    emu->erase_busy_bytes = 1024;
+    emu->au_size = 9;
+    emu->init_polls = 4;
+
+    // Nothing counts as erased until the first CMD38
+    emu->erased = calloc(emu->blocks / 8 + 1, 1);
+
+    emu->spi_mode = false;
+    reset_card(emu);
+
+    return true;
+
+fail:
+    close(emu->fd);
+    emu->fd = -1;
+    return false;
+}
+
+void sd_emu_close(sd_emu_t *emu)
+{
+    if (emu->image)
+    {
+        msync(emu->image, emu->image_size, MS_SYNC);
+        munmap(emu->image, emu->image_size);
+        emu->image = NULL;
+    }
+
+    free(emu->erased);
+    emu->erased = NULL;
+
+    if (emu->fd >= 0)
+        close(emu->fd);
+    emu->fd = -1;
+}
+
+void sd_emu_select(sd_emu_t *emu, bool select)
+{
+    // Deselecting drops any partially received command frame
+    if (!select)
+        emu->frame_len = 0;
+
+    emu->selected = select;
+}
+
+uint8_t sd_emu_xchg(sd_emu_t *emu, uint8_t mosi)
+{
+    // Busy time elapses with the clock even while the card is deselected
+    if (!emu->selected)
+    {
+        if (emu->busy && !emu->fifo_len)
+            emu->busy--;
+        return 0xFF;
+    }
+
+    // Full duplex, the output byte is determined before the input byte is processed
+    uint8_t miso = tx_next(emu);
+
+    if (emu->rx != SD_EMU_RX_CMD)
+    {
+        rx_write(emu, mosi);
+        return miso;
+    }
+
+    // Command frames start with a 01 prefix, everything else between frames is ignored
+    if (emu->frame_len == 0 && (mosi & 0xC0) != 0x40)
+        return miso;
+
+    emu->frame[emu->frame_len++] = mosi;
+    if (emu->frame_len == sizeof(emu->frame))
+    {
+        emu->frame_len = 0;
+        exec_cmd(emu);
+    }
+
+    return miso;
+}
+
+void sd_emu_cmd_line(sd_emu_t *emu, const uint8_t *tx, uint8_t *rx, size_t bits)
+{
+    for (size_t i = 0; i < bits; i++)
+    {
+        unsigned host = tx ? (tx[i / 8] >> (7 - i % 8)) & 1 : 1;
+        unsigned card = 1;
+        bool sending = false;
+
+        // A card in SPI mode leaves the CMD line alone
+        if (!emu->spi_mode)
+        {
+            if (emu->cmd_delay)
+            {
+                emu->cmd_delay--;
+                sending = true;
+            }
+            else if (emu->cmd_out_pos < emu->cmd_out_bits)
+            {
+                card = (emu->cmd_out[emu->cmd_out_pos / 8] >> (7 - emu->cmd_out_pos % 8)) & 1;
+                emu->cmd_out_pos++;
+                sending = true;
+            }
+        }
+
+        if (rx)
+            put_cycle(rx, 1, i, host & card);
+
+        // Commands start with a start bit, ones between them are ignored
+        if (emu->spi_mode || sending || (!emu->cmd_in_bits && host))
+            continue;
+
+        put_cycle(emu->cmd_in, 1, emu->cmd_in_bits++, host);
+        if (emu->cmd_in_bits == 48)
+        {
+            emu->cmd_in_bits = 0;
+            exec_native(emu);
+        }
+    }
+}
+
+void sd_emu_dat_lines(sd_emu_t *emu, int width, const uint8_t *tx, uint8_t *rx, size_t cycles)
+{
+    for (size_t i = 0; i < cycles; i++)
+    {
+        unsigned host = tx ? get_cycle(tx, width, i) : 0xF;
+        unsigned card = 0xF;
+        bool idle = !emu->dat_len && !emu->busy;
+
+        if (!emu->spi_mode)
+        {
+            card = tx_native_dat(emu);
+
+            // Blocks are only taken while the card isn't driving the lines itself
+            if (idle && emu->rx != SD_EMU_RX_CMD)
+                rx_native_write(emu, host);
+        }
+
+        if (rx)
+            put_cycle(rx, width, i, host & card);
+    }
+}
+
+void sd_emu_set_timing(sd_emu_t *emu, const sd_emu_profile_t *profile, uint32_t clock_hz)
+{
+    emu->nac_bytes = us_to_bytes(profile->read_us, clock_hz);
+    emu->busy_bytes = us_to_bytes(profile->write_us, clock_hz);
+    emu->overwrite_busy_bytes = us_to_bytes(profile->overwrite_us, clock_hz);
+    emu->erase_busy_bytes = us_to_bytes(profile->erase_us, clock_hz);
+}
+
+const sd_emu_profile_t *sd_emu_find_profile(const char *name)
+{
+    for (const sd_emu_profile_t *p = sd_emu_profiles; name && p->name; p++)
+    {
+        if (!strcmp(p->name, name))
+            return p;
+    }
+
+    return NULL;
+}
+
+void sd_emu_elapse(sd_emu_t *emu, uint64_t cycles)
+{
+    // Counters are in bytes in SPI mode, in clock cycles on the SD bus
+    uint64_t n = emu->spi_mode ? cycles / 8 : cycles;
+
+    // Queued output waits for the host to clock it out, the time behind it doesn't start yet
+    if (emu->fifo_len || emu->dat_len)
+        return;
+
+    if (emu->busy)
+    {
+        uint32_t step = n < emu->busy ? (uint32_t)n : emu->busy;
+        emu->busy -= step;
+        n -= step;
+
+        // Programming finished, back to receiving the next block or to transfer
+        if (!emu->busy && !emu->spi_mode && emu->cs_state == CS_STATE_PRG)
+            emu->cs_state = emu->rx == SD_EMU_RX_CMD ? CS_STATE_TRAN : CS_STATE_RCV;
+    }
+
+    if (emu->gap)
+        emu->gap -= n < emu->gap ? (uint32_t)n : emu->gap;
+}
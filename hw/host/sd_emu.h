@@ -0,0 +1,501 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_emu.h
+ * @brief Emulation of a SD card backed by a disk image file, byte-level in SPI mode and
+ * cycle-level on the native SD bus
+ */
+
+#ifndef LIBSD_SD_EMU_H
+#define LIBSD_SD_EMU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of the emulated card's output FIFO, large enough for a token, a block and its CRC
+ */
+#define SD_EMU_FIFO_LEN 1024
+
+/**
+ * @brief Block size of the emulated card
+ */
+#define SD_EMU_BLOCK_LEN 512
+
+/**
+ * @brief Size of the emulated card's DAT FIFO in clock cycles, large enough for a 1-bit data block
+ * with its start bit, CRC and end bit
+ */
+#define SD_EMU_DAT_FIFO_LEN (SD_EMU_BLOCK_LEN * 8 + 32)
+
+/**
+ * @brief RCA the emulated card publishes with CMD3
+ */
+#define SD_EMU_RCA 0x59B4
+
+/**
+ * @brief Card latency profile, times in microseconds. Turned into the byte time fields of
+ * sd_emu_t for a given bus clock by sd_emu_set_timing
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Name to select the profile by
+     */
+    const char *name;
+
+    /**
+     * @brief Read access time, from a read command (or the previous block) to the data
+     */
+    uint32_t read_us;
+
+    /**
+     * @brief Busy time of a block written to erased flash
+     */
+    uint32_t write_us;
+
+    /**
+     * @brief Busy time of a block overwriting data
+     */
+    uint32_t overwrite_us;
+
+    /**
+     * @brief Busy time of CMD38 (ERASE)
+     */
+    uint32_t erase_us;
+} sd_emu_profile_t;
+
+/**
+ * @brief Built in latency profiles, ended by an entry without a name
+ */
+extern const sd_emu_profile_t sd_emu_profiles[];
+
+/**
+ * @brief What the emulated card expects the next MOSI byte (DAT cycle on the SD bus) to be
+ *
+ */
+typedef enum
+{
+    SD_EMU_RX_CMD,      // Parsing command frames
+    SD_EMU_RX_WR_TOKEN, // Waiting for a start block/stop tran token (start bit) of a write
+    SD_EMU_RX_WR_DATA,  // Receiving a data block and its CRC
+} sd_emu_rx_t;
+
+/**
+ * @brief State of an emulated SD card. Timing fields may be tuned after sd_emu_open
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Memory mapped disk image
+     */
+    uint8_t *image;
+
+    /**
+     * @brief Size of the disk image in bytes
+     */
+    uint64_t image_size;
+
+    /**
+     * @brief Number of 512 byte blocks in the image
+     */
+    uint32_t blocks;
+
+    /**
+     * @brief File descriptor of the disk image
+     */
+    int fd;
+
+    /**
+     * @brief Whether the card is SDHC/SDXC (block addressed), otherwise SDSC (byte addressed)
+     */
+    bool high_capacity;
+
+    /**
+     * @brief CSD TRAN_SPEED, maximum transfer rate in default speed mode
+     */
+    uint8_t tran_speed;
+
+    /**
+     * @brief Product serial number reported in the CID
+     */
+    uint32_t serial;
+
+    // ===== Timing, in SPI byte times (8 clock cycles each on the SD bus) =====
+
+    /**
+     * @brief Bytes between the end of a command frame and its response (NCR, 1-8)
+     */
+    uint32_t ncr_bytes;
+
+    /**
+     * @brief Bytes between a read command response and its data token (NAC)
+     */
+    uint32_t nac_bytes;
+
+    /**
+     * @brief Bytes the card stays busy after a block written to erased flash
+     */
+    uint32_t busy_bytes;
+
+    /**
+     * @brief Bytes the card stays busy after a block that overwrote data
+     */
+    uint32_t overwrite_busy_bytes;
+
+    /**
+     * @brief Bytes the card stays busy after CMD38 (ERASE)
+     */
+    uint32_t erase_busy_bytes;
+
+    /**
+     * @brief Allocation unit size reported in the SD Status (AU_SIZE code, 9 is 4MiB)
+     */
+    uint8_t au_size;
+
+    /**
+     * @brief Number of ACMD41 polls before the card leaves the idle state
+     */
+    uint32_t init_polls;
+
+    // ===== Card state =====
+
+    /**
+     * @brief Whether chip select is asserted
+     */
+    bool selected;
+
+    /**
+     * @brief Whether CMD0 put the card into SPI mode, otherwise it talks on the native SD bus
+     */
+    bool spi_mode;
+
+    /**
+     * @brief Whether the card is in the idle state
+     */
+    bool idle;
+
+    /**
+     * @brief Whether a valid CMD8 was received since the last reset
+     */
+    bool if_cond;
+
+    /**
+     * @brief Whether the previous command was CMD55 (APP_CMD)
+     */
+    bool app_cmd;
+
+    /**
+     * @brief Whether CRC checking is enabled
+     */
+    bool crc_on;
+
+    /**
+     * @brief Whether CMD6 switched the card to high speed
+     */
+    bool high_speed;
+
+    /**
+     * @brief Number of ACMD41 received while idle
+     */
+    uint32_t op_cond_polls;
+
+    /**
+     * @brief Blocks to pre-erase for the next multi-block write (ACMD23)
+     */
+    uint32_t pre_erase;
+
+    /**
+     * @brief Error bits reported in the second byte of the next R2 (CMD13)
+     */
+    uint8_t status;
+
+    /**
+     * @brief Bitmap of the blocks erased and not written since, NULL if it couldn't be allocated
+     */
+    uint8_t *erased;
+
+    /**
+     * @brief First block of the erase range (CMD32), UINT32_MAX if unset
+     */
+    uint32_t erase_start;
+
+    /**
+     * @brief Last block of the erase range (CMD33), UINT32_MAX if unset
+     */
+    uint32_t erase_end;
+
+    // ===== Receive state =====
+
+    /**
+     * @brief Receive phase
+     */
+    sd_emu_rx_t rx;
+
+    /**
+     * @brief Command frame being received
+     */
+    uint8_t frame[6];
+
+    /**
+     * @brief Bytes of the command frame received
+     */
+    uint32_t frame_len;
+
+    /**
+     * @brief Data block being received, plus CRC
+     */
+    uint8_t wr_buf[SD_EMU_BLOCK_LEN + 2];
+
+    /**
+     * @brief Bytes of the data block received
+     */
+    uint32_t wr_len;
+
+    /**
+     * @brief Block being written
+     */
+    uint32_t wr_lba;
+
+    /**
+     * @brief Blocks of the current write command programmed so far
+     */
+    uint32_t wr_done;
+
+    /**
+     * @brief Whether the write is a multi-block (CMD25) write
+     */
+    bool wr_multi;
+
+    // ===== Transmit state =====
+
+    /**
+     * @brief Bytes queued for MISO
+     */
+    uint8_t fifo[SD_EMU_FIFO_LEN];
+
+    /**
+     * @brief Index of the next byte to transmit in fifo
+     */
+    uint32_t fifo_head;
+
+    /**
+     * @brief Number of bytes left in fifo
+     */
+    uint32_t fifo_len;
+
+    /**
+     * @brief Bytes of busy (0x00) to transmit once the FIFO drains, clock cycles of DAT0 low on
+     * the SD bus
+     */
+    uint32_t busy;
+
+    /**
+     * @brief Bytes of 0xFF (clock cycles on the SD bus) to transmit before the next read block
+     */
+    uint32_t gap;
+
+    /**
+     * @brief Next block to read
+     */
+    uint32_t rd_lba;
+
+    /**
+     * @brief Blocks left to read, UINT32_MAX for an open ended CMD18
+     */
+    uint32_t rd_remaining;
+
+    /**
+     * @brief Register (CSD, CID, ...) to send instead of image data on the next read
+     */
+    uint8_t reg[64];
+
+    /**
+     * @brief Length of reg, 0 if the next read is from the image
+     */
+    uint32_t reg_len;
+
+    // ===== Native SD bus state =====
+
+    /**
+     * @brief Relative card address, published by CMD3
+     */
+    uint16_t rca;
+
+    /**
+     * @brief Card state (CS_STATE_*)
+     */
+    uint8_t cs_state;
+
+    /**
+     * @brief Error bits reported, then cleared, by the next R1
+     */
+    uint32_t cs;
+
+    /**
+     * @brief DAT lines the card uses, 1 or 4 (ACMD6)
+     */
+    uint8_t bus_width;
+
+    /**
+     * @brief Command being received on the CMD line
+     */
+    uint8_t cmd_in[6];
+
+    /**
+     * @brief Bits of the command received
+     */
+    uint32_t cmd_in_bits;
+
+    /**
+     * @brief Response being transmitted on the CMD line
+     */
+    uint8_t cmd_out[17];
+
+    /**
+     * @brief Length of the response in bits
+     */
+    uint32_t cmd_out_bits;
+
+    /**
+     * @brief Bits of the response transmitted
+     */
+    uint32_t cmd_out_pos;
+
+    /**
+     * @brief Clock cycles before the response starts (NCR)
+     */
+    uint32_t cmd_delay;
+
+    /**
+     * @brief Cycles queued for the DAT lines, one per entry, DAT3..DAT0 in the low nibble
+     */
+    uint8_t dat_fifo[SD_EMU_DAT_FIFO_LEN];
+
+    /**
+     * @brief Index of the next cycle to transmit in dat_fifo
+     */
+    uint32_t dat_head;
+
+    /**
+     * @brief Number of cycles left in dat_fifo
+     */
+    uint32_t dat_len;
+
+    /**
+     * @brief Cycles of the data block being written received
+     */
+    uint32_t dat_in_cycles;
+
+    /**
+     * @brief CRC16 received after the data block being written, one per DAT line
+     */
+    uint16_t crc_in[4];
+} sd_emu_t;
+
+/**
+ * @brief Opens (creating or extending if requested) a disk image and powers up an emulated card
+ *
+ * @param emu Emulated card
+ * @param path Path to the disk image
+ * @param size If non-zero, the image is grown to at least this many bytes
+ * @return Whether the image was opened and mapped
+ */
+bool sd_emu_open(sd_emu_t *emu, const char *path, uint64_t size);
+
+/**
+ * @brief Flushes and unmaps the disk image
+ *
+ * @param emu Emulated card
+ */
+void sd_emu_close(sd_emu_t *emu);
+
+/**
+ * @brief Asserts/deasserts the card's chip select
+ *
+ * @param emu Emulated card
+ * @param select Whether CS is asserted
+ */
+void sd_emu_select(sd_emu_t *emu, bool select);
+
+/**
+ * @brief Clocks one byte through the card
+ *
+ * @param emu Emulated card
+ * @param mosi Byte driven by the host
+ * @return Byte driven by the card
+ */
+uint8_t sd_emu_xchg(sd_emu_t *emu, uint8_t mosi);
+
+/**
+ * @brief Clocks the CMD line of the native SD bus
+ *
+ * @param emu Emulated card
+ * @param tx Bits driven by the host, MSB first, NULL if the host releases the line
+ * @param rx Buffer for the sampled line, NULL to discard it
+ * @param bits Number of clock cycles
+ */
+void sd_emu_cmd_line(sd_emu_t *emu, const uint8_t *tx, uint8_t *rx, size_t bits);
+
+/**
+ * @brief Clocks the DAT lines of the native SD bus. A byte holds 2 cycles of DAT3..DAT0 on a 4-bit
+ * bus, 8 cycles of DAT0 on a 1-bit bus, MSB first
+ *
+ * @param emu Emulated card
+ * @param width Number of DAT lines the host uses, 1 or 4
+ * @param tx Cycles driven by the host, NULL if the host releases the lines
+ * @param rx Buffer for the sampled lines, NULL to discard them
+ * @param cycles Number of clock cycles
+ */
+void sd_emu_dat_lines(sd_emu_t *emu, int width, const uint8_t *tx, uint8_t *rx, size_t cycles);
+
+/**
+ * @brief Sets the timing fields from a latency profile at a bus clock. Call again whenever the
+ * clock changes, the times are kept as bytes at the clock
+ *
+ * @param emu Emulated card
+ * @param profile Latency profile
+ * @param clock_hz Bus clock
+ */
+void sd_emu_set_timing(sd_emu_t *emu, const sd_emu_profile_t *profile, uint32_t clock_hz);
+
+/**
+ * @brief Looks up a built in latency profile
+ *
+ * @param name Profile name
+ * @return Profile, NULL if there is none of that name
+ */
+const sd_emu_profile_t *sd_emu_find_profile(const char *name);
+
+/**
+ * @brief Lets time pass without clocking the card: busy and read access time elapse as they would
+ * on a real card while the host waits
+ *
+ * @param emu Emulated card
+ * @param cycles Clock cycles that passed
+ */
+void sd_emu_elapse(sd_emu_t *emu, uint64_t cycles);
+
+/**
+ * @brief CRC7 as used by SD command frames
+ *
+ * @param buf Buffer
+ * @param n Buffer length
+ * @return 7 bit CRC
+ */
+uint8_t sd_emu_crc7(const uint8_t *buf, size_t n);
+
+/**
+ * @brief CRC16-CCITT as used by SD data blocks
+ *
+ * @param buf Buffer
+ * @param n Buffer length
+ * @return 16 bit CRC
+ */
+uint16_t sd_emu_crc16(const uint8_t *buf, size_t n);
+
+#endif
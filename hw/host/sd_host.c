@@ -0,0 +1,435 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_host.c
+ * @brief Hosted (Linux) Port, SPI or native SD bus wired to an emulated card
+ */
+
+#include "../../include/bus/sd_sdmmc.h"
+#include "../../include/bus/sd_spi.h"
+#include "../../include/bus/sd_spi_chain.h"
+#include "../../include/sd.h"
+#include "../../include/sd_host.h"
+#include "../../include/sd_types.h"
+#include "libsd_mcu_defs.h"
+#include "sd_emu.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// ========== Timing Model ==========
+
+/**
+ * @brief Modeled time (ns), shared by the hosts with virtual_time set
+ */
+static uint64_t model_ns;
+
+/**
+ * @brief Whether a host with virtual_time set was initialized, the time source then reports the
+ * modeled time
+ */
+static bool model_on;
+
+/**
+ * @brief Lets the card catch up on the time that passed since it was last clocked, while the host
+ * waited or talked to other cards
+ *
+ * @param ctx Host context
+ */
+static void model_catch_up(sd_host_ctx_t *ctx)
+{
+    if (!ctx->virtual_time)
+        return;
+
+    uint64_t hz = ctx->clock_hz ? ctx->clock_hz : 400000;
+    sd_emu_elapse(&ctx->card, (model_ns - ctx->card_ns) * hz / 1000000000u);
+    ctx->card_ns = model_ns;
+}
+
+/**
+ * @brief Advances the modeled time by a transfer
+ *
+ * @param ctx Host context
+ * @param cycles Bus clock cycles of the transfer
+ */
+static void model_advance(sd_host_ctx_t *ctx, uint64_t cycles)
+{
+    if (!ctx->virtual_time)
+        return;
+
+    uint64_t hz = ctx->clock_hz ? ctx->clock_hz : 400000;
+    model_ns += cycles * 1000000000u / hz + ctx->xfer_overhead_ns;
+    ctx->card_ns = model_ns;
+}
+
+// ========== Helper Functions ==========
+
+/**
+ * @brief Sleeps for a number of milliseconds
+ *
+ * @param ms Milliseconds to sleep
+ */
+static void host_delay_ms(uint32_t ms)
+{
+    if (model_on)
+    {
+        model_ns += (uint64_t)ms * 1000000u;
+        return;
+    }
+
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Sleeps for a number of microseconds
+ *
+ * @param us Microseconds to sleep
+ */
+static void host_delay_us(uint32_t us)
+{
+    if (model_on)
+    {
+        model_ns += (uint64_t)us * 1000u;
+        return;
+    }
+
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (long)(us % 1000000) * 1000L};
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Monotonic time source
+ *
+ * @return Time in microseconds
+ */
+static uint64_t host_get_time_us(void)
+{
+    if (model_on)
+        return model_ns / 1000u;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/**
+ * @brief Takes the host's mutex
+ *
+ * @param host SD Host Controller
+ */
+static void host_lock(sd_host_t *host)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+    pthread_mutex_lock(&ctx->lock);
+}
+
+/**
+ * @brief Releases the host's mutex
+ *
+ * @param host SD Host Controller
+ */
+static void host_unlock(sd_host_t *host)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+// ========== SPI Bus Ops ==========
+// These are provided to the SPI vtbl to use
+
+/**
+ * @brief Selects the CS pin
+ *
+ * @param host SD Host Controller
+ * @param select Select state
+ */
+static void host_select_cs(sd_host_t *host, bool select)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+    sd_emu_select(&ctx->card, select);
+}
+
+/**
+ * @brief Sets the bus speed
+ *
+ * @param host SD Host
+ * @param hz Bus clock frequency
+ */
+static void host_set_clock(sd_host_t *host, uint32_t hz)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    // Clamp to the port's fastest rate, as a real SPI peripheral would
+    if (ctx->fast_hz && hz > ctx->fast_hz)
+        hz = ctx->fast_hz;
+    ctx->clock_hz = hz;
+
+    // Card latencies are kept as byte times, they change with the clock
+    if (ctx->profile)
+        sd_emu_set_timing(&ctx->card, ctx->profile, hz);
+}
+
+/**
+ * @brief Exchanges one byte over SPI: transmits a byte and receives a byte
+ *
+ * @param host SD Host Controller
+ * @param tx Byte to transmit
+ * @return Byte received
+ */
+static uint8_t host_xchg1(sd_host_t *host, uint8_t tx)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    model_catch_up(ctx);
+    uint8_t rx = sd_emu_xchg(&ctx->card, tx);
+    model_advance(ctx, 8);
+
+    return rx;
+}
+
+/**
+ * @brief Writes a buffer over SPI
+ *
+ * @param host SD Host Controller
+ * @param src Source buffer
+ * @param n Number of bytes to write
+ */
+static void host_write(sd_host_t *host, const uint8_t *src, size_t n)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    model_catch_up(ctx);
+    for (size_t i = 0; i < n; i++)
+        sd_emu_xchg(&ctx->card, src[i]);
+    model_advance(ctx, (uint64_t)n * 8);
+}
+
+/**
+ * @brief Reads N bytes over SPI by clocking out 0xFF
+ *
+ * @param host SD Host Controller
+ * @param dst Destination buffer to store read data
+ * @param n Number of bytes to read
+ */
+static void host_read_ff(sd_host_t *host, uint8_t *dst, size_t n)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    model_catch_up(ctx);
+    for (size_t i = 0; i < n; i++)
+        dst[i] = sd_emu_xchg(&ctx->card, 0xFF);
+    model_advance(ctx, (uint64_t)n * 8);
+}
+
+/**
+ * @brief Full-duplex bulk transfer
+ *
+ * @param host SD Host Controller
+ * @param tx Bytes to transmit, NULL to transmit fill
+ * @param rx Buffer for received bytes, NULL to discard them
+ * @param n Number of bytes
+ * @param fill Byte transmitted when tx is NULL
+ */
+static void host_xfer(sd_host_t *host, const uint8_t *tx, uint8_t *rx, size_t n, uint8_t fill)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    model_catch_up(ctx);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t v = sd_emu_xchg(&ctx->card, tx ? tx[i] : fill);
+        if (rx)
+            rx[i] = v;
+    }
+    model_advance(ctx, (uint64_t)n * 8);
+}
+
+/**
+ * @brief Runs chained segments the way a DMA port does, through the shared chain state machine:
+ * each slot stands in for a DMA channel, loaded ahead and reloaded once it completes
+ *
+ * @param host SD Host Controller
+ * @param segs Segments to transfer
+ * @param count Number of segments
+ */
+static void host_xfer_chain(sd_host_t *host, const sd_spi_seg_t *segs, size_t count)
+{
+    const sd_spi_seg_t *slots[SD_SPI_CHAIN_SLOTS] = {0};
+    const sd_spi_seg_t *seg;
+    sd_spi_chain_t chain;
+    uint8_t slot, run = 0;
+    bool chained;
+
+    sd_spi_chain_init(&chain, segs, count);
+
+    do
+    {
+        // Loads every free slot, the "channel" loaded ahead is triggered when the running one ends
+        while ((seg = sd_spi_chain_arm(&chain, &slot, &chained)))
+            slots[slot] = seg;
+
+        seg = slots[run];
+        slots[run] = NULL;
+        if (!seg)
+            return;
+
+        host_xfer(host, seg->tx, seg->rx, seg->len, seg->fill);
+    } while (sd_spi_chain_complete(&chain, &run));
+}
+
+// ========== SD Bus Ops ==========
+// These are provided to the native SD bus vtbl to use
+
+/**
+ * @brief Clocks the CMD line
+ *
+ * @param host SD Host Controller
+ * @param tx Bits to drive, NULL to release the line
+ * @param rx Buffer for the sampled bits, NULL to discard them
+ * @param bits Number of clock cycles
+ */
+static void host_cmd_line(sd_host_t *host, const uint8_t *tx, uint8_t *rx, size_t bits)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    model_catch_up(ctx);
+    sd_emu_cmd_line(&ctx->card, tx, rx, bits);
+    model_advance(ctx, bits);
+}
+
+/**
+ * @brief Clocks the DAT lines
+ *
+ * @param host SD Host Controller
+ * @param tx Cycles to drive, NULL to release the lines
+ * @param rx Buffer for the sampled cycles, NULL to discard them
+ * @param cycles Number of clock cycles
+ */
+static void host_dat_lines(sd_host_t *host, const uint8_t *tx, uint8_t *rx, size_t cycles)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    model_catch_up(ctx);
+    sd_emu_dat_lines(&ctx->card, ctx->width, tx, rx, cycles);
+    model_advance(ctx, cycles);
+}
+
+/**
+ * @brief Sets the number of DAT lines used
+ *
+ * @param host SD Host Controller
+ * @param bits Bus width, 1 or 4
+ */
+static void host_set_width(sd_host_t *host, int bits)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+    ctx->width = (uint8_t)bits;
+}
+
+// ========== Host Platform Port ==========
+
+// Bus op table for SPI bus
+static const sd_spi_ops_t HOST_SPI_OPS = {
+    .select_cs = host_select_cs,
+    .xchg1 = host_xchg1,
+    .write = host_write,
+    .read_ff = host_read_ff,
+    .xfer = host_xfer,
+    .xfer_chain = host_xfer_chain,
+    .set_baud = host_set_clock,
+};
+
+// Bus op table for the native SD bus
+static const sd_sdmmc_ops_t HOST_SDMMC_OPS = {
+    .cmd_line = host_cmd_line,
+    .dat_lines = host_dat_lines,
+    .set_width = host_set_width,
+    .set_clock = host_set_clock,
+};
+
+// Host controller op table
+static const sd_host_ops_t HOST_HOST_OPS = {
+    .set_power = NULL,
+    .delay_ms = host_delay_ms,
+    .delay_us = host_delay_us,
+    .get_time_us = host_get_time_us,
+    .lock = host_lock,
+    .unlock = host_unlock,
+};
+
+sd_status_t init_host(sd_host_t *host)
+{
+    if (!host || !host->ctx)
+        return SD_ERR_PARAM;
+
+    sd_host_ctx_t *ctx = host->ctx;
+    if (!ctx->image_path)
+        return SD_ERR_PARAM;
+
+    // "Insert" the card, mapping its backing image
+    if (!sd_emu_open(&ctx->card, ctx->image_path, ctx->image_size))
+        return SD_ERR_NO_CARD;
+
+    if (!ctx->slow_hz)
+        ctx->slow_hz = 400000;
+    if (!ctx->fast_hz)
+        ctx->fast_hz = 25000000;
+
+    // The modeled clock starts at the card's insertion
+    if (ctx->virtual_time)
+    {
+        model_on = true;
+        ctx->card_ns = model_ns;
+    }
+
+    // The API takes the lock again for nested calls and completion callbacks
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&ctx->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    // Assigns host controller ops
+    host->ops = &HOST_HOST_OPS;
+
+#if SD_TRACE_ENABLE
+    // Nothing is traced until the application attaches a ring
+    host->trace = NULL;
+#endif
+
+    if (ctx->sd_bus)
+    {
+        // Native SD bus, all four DAT lines are wired to the emulated card
+        sd_bind_sdmmc_transport(host, &HOST_SDMMC_OPS, &ctx->sdmmc_ctx, true);
+        host->max_clock_hz = ctx->fast_hz;
+
+        // Provide ≥74 clocks with CMD high before CMD0
+        host_set_clock(host, ctx->slow_hz);
+        host_cmd_line(host, NULL, NULL, 80);
+
+        return SD_OK;
+    }
+
+    // Assigns SPI bus ops, optionally on a bus shared with other cards
+    sd_bind_spi_transport(host, &HOST_SPI_OPS, &ctx->spi_ctx);
+    if (ctx->shared_bus)
+        sd_spi_share_bus(host, ctx->shared_bus);
+
+    // The controller can go as fast as the port allows
+    host->max_clock_hz = ctx->fast_hz;
+
+    // Provide ≥74 clocks with CS high before CMD0
+    uint8_t ff[11];
+    memset(ff, 0xFF, sizeof(ff));
+
+    spi_ctx_t *spi_ctx = (spi_ctx_t *)host->bus_ctx;
+    host->bus->set_clock(host, ctx->slow_hz);
+    spi_ctx->spi->select_cs(host, false);
+    spi_ctx->spi->write(host, ff, sizeof(ff));
+
+    return SD_OK;
+}
@@ -13,4 +13,4 @@ pico_sdk_init()
 
 add_library(libsd_backend OBJECT ${CMAKE_CURRENT_LIST_DIR}/sd_rp2040.c)
 
-target_link_libraries(libsd_backend OBJECT pico_stdlib hardware_spi)
+target_link_libraries(libsd_backend OBJECT pico_stdlib hardware_spi hardware_dma)
@@ -8,9 +8,12 @@
 
 #ifndef LIBSD_MCU_DEFS_H
 #define LIBSD_MCU_DEFS_H
+#include "bus/sd_spi.h"
 #include "hardware/spi.h"
+#include "pico/mutex.h"
 #include "pico/stdlib.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /**
@@ -44,6 +47,13 @@ typedef struct
      */
     uint cs_pin;
 
+    /**
+     * @brief OPTIONAL: State of a SPI instance shared with other cards, each on its own cs_pin.
+     * NULL if the card has the instance to itself. Every card on it must go through init_host
+     * before any of them is used
+     */
+    sd_spi_bus_t *shared_bus;
+
     /**
      * @brief SPI Clock rate to use for identification
      */
@@ -53,5 +63,44 @@ typedef struct
      * @brief Fastest clock rate for SPI peripheral once in operating mode
      */
     uint32_t fast_hz;
+
+    /**
+     * @brief Disables DMA, every transfer then uses the blocking SPI functions
+     */
+    bool no_dma;
+
+    /**
+     * @brief DMA channels a chained transfer alternates between, claimed by init_host. -1 if DMA
+     * is unavailable
+     */
+    int dma_chain[2];
+
+    /**
+     * @brief DMA channel running the other side of the bus for a whole transfer, claimed by
+     * init_host. -1 if DMA is unavailable
+     */
+    int dma_stream;
+
+    /**
+     * @brief Byte the transmit channel repeats while receiving. Per host, a DMA transfer of
+     * another host may be running
+     */
+    uint8_t dma_fill;
+
+    /**
+     * @brief Where the receive channel discards bytes while transmitting
+     */
+    uint8_t dma_sink;
+
+    /**
+     * @brief SPI bus driver state of this card
+     */
+    spi_ctx_t spi_ctx;
+
+    /**
+     * @brief Recursive mutex behind the host lock hooks, lets several cores or RTOS tasks share
+     * the card
+     */
+    recursive_mutex_t lock;
 } sd_host_ctx_t;
 #endif
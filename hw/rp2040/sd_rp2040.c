@@ -7,16 +7,29 @@
  */
 
 #include "../../include/bus/sd_spi.h"
+#include "../../include/bus/sd_spi_chain.h"
 #include "../../include/sd.h"
+#include "../../include/sd_crc.h"
 #include "../../include/sd_host.h"
 #include "../../include/sd_types.h"
+#include "hardware/dma.h"
 #include "hardware/spi.h"
 #include "libsd_mcu_defs.h"
+#include "pico/mutex.h"
 #include "pico/stdlib.h"
 
 #include <boards/pico.h>
 #include <pico/time.h>
 #include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Transfers shorter than this use the blocking SPI functions, setting up DMA costs more
+ */
+#define RP2040_DMA_MIN_LEN 64
+
+// The DMA sniffer is shared by every channel, one host at a time may use it
+auto_init_mutex(sniffer_lock);
 
 // ========== Helper Functions ==========
 
@@ -66,6 +79,206 @@ sd_status_t init_bus(sd_host_t *host)
     return SD_OK;
 }
 
+/**
+ * @brief Claims the DMA channels used for bulk transfers. Without enough free channels, the port
+ * stays on the blocking SPI functions
+ *
+ * @param ctx SD Host Controller Private Context
+ */
+static void init_dma(sd_host_ctx_t *ctx)
+{
+    ctx->dma_chain[0] = -1;
+    ctx->dma_chain[1] = -1;
+    ctx->dma_stream = -1;
+
+    if (ctx->no_dma)
+        return;
+
+    int a = dma_claim_unused_channel(false);
+    int b = dma_claim_unused_channel(false);
+    int c = dma_claim_unused_channel(false);
+
+    if (a < 0 || b < 0 || c < 0)
+    {
+        if (a >= 0)
+            dma_channel_unclaim(a);
+        if (b >= 0)
+            dma_channel_unclaim(b);
+        if (c >= 0)
+            dma_channel_unclaim(c);
+        return;
+    }
+
+    ctx->dma_chain[0] = a;
+    ctx->dma_chain[1] = b;
+    ctx->dma_stream = c;
+}
+
+/**
+ * @brief Builds the configuration of a DMA channel feeding or draining the SPI data register
+ *
+ * @param ctx SD Host Controller Private Context
+ * @param ch DMA channel
+ * @param tx Whether the channel feeds the TX FIFO, otherwise it drains the RX FIFO
+ * @param inc Whether the memory side steps through a buffer, otherwise it repeats one byte
+ * @param chain_to Channel triggered on completion, ch itself for none
+ * @return Channel configuration
+ */
+static dma_channel_config dma_config(sd_host_ctx_t *ctx, uint ch, bool tx, bool inc, uint chain_to)
+{
+    dma_channel_config c = dma_channel_get_default_config(ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+
+    // Paced by the SPI FIFO the channel feeds or drains
+    channel_config_set_dreq(&c, spi_get_dreq(ctx->spi, tx));
+
+    // The data register side never increments
+    channel_config_set_read_increment(&c, tx && inc);
+    channel_config_set_write_increment(&c, !tx && inc);
+    channel_config_set_chain_to(&c, chain_to);
+    return c;
+}
+
+/**
+ * @brief Loads a DMA channel without triggering it
+ *
+ * @param ctx SD Host Controller Private Context
+ * @param ch DMA channel
+ * @param tx Whether the channel feeds the TX FIFO, otherwise it drains the RX FIFO
+ * @param buf Memory side buffer, NULL to repeat ctx->dma_fill (tx) or discard into ctx->dma_sink
+ * (rx)
+ * @param n Number of bytes
+ * @param chain_to Channel triggered on completion, ch itself for none
+ */
+static void dma_load(sd_host_ctx_t *ctx, uint ch, bool tx, const void *buf, size_t n, uint chain_to)
+{
+    io_rw_32 *dr = &spi_get_hw(ctx->spi)->dr;
+    dma_channel_config c = dma_config(ctx, ch, tx, buf != NULL, chain_to);
+
+    if (tx)
+        dma_channel_configure(ch, &c, dr, buf ? buf : &ctx->dma_fill, n, false);
+    else
+        dma_channel_configure(ch, &c, buf ? (void *)buf : &ctx->dma_sink, dr, n, false);
+}
+
+/**
+ * @brief Full-duplex transfer on a pair of DMA channels
+ *
+ * @param ctx SD Host Controller Private Context
+ * @param tx Bytes to transmit, NULL to transmit fill
+ * @param rx Buffer for received bytes, NULL to discard them
+ * @param n Number of bytes
+ * @param fill Byte transmitted when tx is NULL
+ */
+static void dma_xfer(sd_host_ctx_t *ctx, const uint8_t *tx, uint8_t *rx, size_t n, uint8_t fill)
+{
+    uint rx_ch = ctx->dma_chain[0];
+    uint tx_ch = ctx->dma_stream;
+
+    ctx->dma_fill = fill;
+    dma_load(ctx, rx_ch, false, rx, n, rx_ch);
+    dma_load(ctx, tx_ch, true, tx, n, tx_ch);
+
+    // Both start together, the receive channel finishes once the last byte was clocked in
+    dma_start_channel_mask((1u << rx_ch) | (1u << tx_ch));
+    dma_channel_wait_for_finish_blocking(rx_ch);
+
+    dma_hw->intr = (1u << rx_ch) | (1u << tx_ch);
+}
+
+/**
+ * @brief Loads a chain slot's channel with a segment, and points the channel ahead of it at it
+ *
+ * @param ctx SD Host Controller Private Context
+ * @param tx Whether the chain transmits, otherwise it receives
+ * @param slot Slot to load
+ * @param seg Segment to load
+ * @param chained Whether the other slot's channel must trigger this one
+ */
+static void dma_chain_load(sd_host_ctx_t *ctx,
+                           bool tx,
+                           uint8_t slot,
+                           const sd_spi_seg_t *seg,
+                           bool chained)
+{
+    uint ch = ctx->dma_chain[slot];
+    uint prev = ctx->dma_chain[slot ^ 1];
+
+    dma_load(ctx, ch, tx, tx ? (const void *)seg->tx : (const void *)seg->rx, seg->len, ch);
+    if (!chained)
+        return;
+
+    // The channel ahead triggers this one as it completes, no CPU involved between segments
+    dma_channel_config c = dma_config(ctx, prev, tx, true, ch);
+    dma_channel_set_config(prev, &c, false);
+
+    // Unless it completed before it was pointed here: then nothing triggered this channel
+    bool prev_done = dma_hw->intr & (1u << prev);
+    bool started = dma_channel_is_busy(ch) || (dma_hw->intr & (1u << ch));
+    if (prev_done && !started)
+        dma_channel_start(ch);
+}
+
+/**
+ * @brief Runs segments on the two chain channels in turn, while the stream channel runs the other
+ * side of the bus for the whole chain. A block and its CRC are clocked back to back
+ *
+ * @param ctx SD Host Controller Private Context
+ * @param segs Segments, all receive or all transmit
+ * @param count Number of segments
+ * @param tx Whether the chain transmits, otherwise it receives
+ */
+static void dma_xfer_chain(sd_host_ctx_t *ctx, const sd_spi_seg_t *segs, size_t count, bool tx)
+{
+    uint stream = ctx->dma_stream;
+    uint32_t mask = (1u << ctx->dma_chain[0]) | (1u << ctx->dma_chain[1]);
+    const sd_spi_seg_t *seg;
+    sd_spi_chain_t chain;
+    uint8_t slot, run = 0;
+    bool chained;
+
+    // Fill bytes out for a receive chain, received bytes discarded for a transmit chain
+    ctx->dma_fill = segs[0].fill;
+    dma_load(ctx, stream, !tx, NULL, sd_spi_chain_len(segs, count), stream);
+
+    // Loads the head of the chain and the segment after it
+    dma_hw->intr = mask;
+    sd_spi_chain_init(&chain, segs, count);
+    while ((seg = sd_spi_chain_arm(&chain, &slot, &chained)))
+        dma_chain_load(ctx, tx, slot, seg, chained);
+
+    dma_start_channel_mask((1u << ctx->dma_chain[0]) | (1u << stream));
+
+    for (;;)
+    {
+        uint32_t bit = 1u << ctx->dma_chain[run];
+        while (!(dma_hw->intr & bit))
+            tight_loop_contents();
+        dma_hw->intr = bit;
+
+        if (!sd_spi_chain_complete(&chain, &run))
+            break;
+
+        // The other channel is running now, reload the one that completed
+        while ((seg = sd_spi_chain_arm(&chain, &slot, &chained)))
+            dma_chain_load(ctx, tx, slot, seg, chained);
+    }
+
+    // A transmit chain ends once the stream channel clocked in the last byte
+    dma_channel_wait_for_finish_blocking(stream);
+    dma_hw->intr = mask | (1u << stream);
+}
+
+/**
+ * @brief Delays by a number of microseconds
+ *
+ * @param us Microseconds to delay
+ */
+static void delay_us(uint32_t us)
+{
+    sleep_us(us);
+}
+
 // ========== SPI Bus Ops ==========
 // These are provided to the SPI vtbl to use
 
@@ -95,6 +308,10 @@ void set_clock(sd_host_t *host, uint32_t hz)
 {
     sd_host_ctx_t *ctx = host->ctx;
 
+    // Never exceed the fastest rate configured for the port
+    if (ctx->fast_hz && hz > ctx->fast_hz)
+        hz = ctx->fast_hz;
+
     spi_set_baudrate(ctx->spi, hz);
 }
 
@@ -114,6 +331,51 @@ uint8_t xchg1(sd_host_t *host, uint8_t tx)
     return rx;
 }
 
+/**
+ * @brief Full-duplex bulk transfer
+ *
+ * @param host SD Host Controller
+ * @param tx Bytes to transmit, NULL to transmit fill
+ * @param rx Buffer for received bytes, NULL to discard them
+ * @param n Number of bytes
+ * @param fill Byte transmitted when tx is NULL
+ */
+void xfer(sd_host_t *host, const uint8_t *tx, uint8_t *rx, size_t n, uint8_t fill)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    // Bulk transfers run on DMA, the core only waits for the last byte
+    if (n >= RP2040_DMA_MIN_LEN && ctx->dma_stream >= 0)
+    {
+        dma_xfer(ctx, tx, rx, n, fill);
+        return;
+    }
+
+    if (tx && rx)
+    {
+        spi_write_read_blocking(ctx->spi, tx, rx, n);
+    }
+    else if (tx)
+    {
+        spi_write_blocking(ctx->spi, tx, n);
+    }
+    else if (rx)
+    {
+        spi_read_blocking(ctx->spi, fill, rx, n);
+    }
+    else
+    {
+        // Only clocks, received bytes are discarded through a small scratch buffer
+        uint8_t scratch[16];
+        while (n)
+        {
+            size_t chunk = n < sizeof(scratch) ? n : sizeof(scratch);
+            spi_read_blocking(ctx->spi, fill, scratch, chunk);
+            n -= chunk;
+        }
+    }
+}
+
 /**
  * @brief Writes a buffer over SPI
  *
@@ -123,8 +385,7 @@ uint8_t xchg1(sd_host_t *host, uint8_t tx)
  */
 void write(sd_host_t *host, const uint8_t *src, size_t n)
 {
-    sd_host_ctx_t *ctx = host->ctx;
-    spi_write_blocking(ctx->spi, src, n);
+    xfer(host, src, NULL, n, 0xFF);
 }
 
 /**
@@ -136,9 +397,95 @@ void write(sd_host_t *host, const uint8_t *src, size_t n)
  */
 void read_ff(sd_host_t *host, uint8_t *dst, size_t n)
 {
-    sd_host_ctx_t *ctx = host->ctx;
     // Read by clocking out 0xFF
-    spi_read_blocking(ctx->spi, 0xFF, dst, n);
+    xfer(host, NULL, dst, n, 0xFF);
+}
+
+/**
+ * @brief Runs segments back to back on chained DMA channels
+ *
+ * @param host SD Host Controller
+ * @param segs Segments to transfer
+ * @param count Number of segments
+ */
+void xfer_chain(sd_host_t *host, const sd_spi_seg_t *segs, size_t count)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+    sd_spi_chain_dir_t dir = sd_spi_chain_dir(segs, count);
+
+    // Short or unchainable transfers go one segment at a time
+    if (ctx->dma_stream < 0 || dir == SD_SPI_CHAIN_INVALID ||
+        sd_spi_chain_len(segs, count) < RP2040_DMA_MIN_LEN)
+    {
+        for (size_t i = 0; i < count; i++)
+            xfer(host, segs[i].tx, segs[i].rx, segs[i].len, segs[i].fill);
+        return;
+    }
+
+    dma_xfer_chain(ctx, segs, count, dir == SD_SPI_CHAIN_TX);
+}
+
+/**
+ * @brief CRC16-CCITT computed by the DMA sniffer, the buffer is streamed through the idle stream
+ * channel at memory speed. The sniffer is a single block shared by all channels, a host finding
+ * it in use by another host (on the other core or task) uses the table driven CRC instead
+ *
+ * @param host SD Host Controller
+ * @param buf Buffer
+ * @param n Buffer length
+ * @return 16 bit CRC
+ */
+uint16_t crc16(sd_host_t *host, const uint8_t *buf, size_t n)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+
+    // Short buffers, no DMA, or a sniffer busy with another host use the table driven CRC
+    if (ctx->dma_stream < 0 || n < RP2040_DMA_MIN_LEN || !mutex_try_enter(&sniffer_lock, NULL))
+        return sd_crc16(0, buf, n);
+
+    uint ch = ctx->dma_stream;
+
+    // Unpaced memory to sink copy, the sniffer sees every byte read
+    dma_channel_config c = dma_channel_get_default_config(ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_sniff_enable(&c, true);
+
+    dma_sniffer_enable(ch, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, false);
+    dma_sniffer_set_data_accumulator(0);
+
+    dma_channel_configure(ch, &c, &ctx->dma_sink, buf, n, true);
+    dma_channel_wait_for_finish_blocking(ch);
+
+    uint16_t crc = (uint16_t)dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+    dma_hw->intr = 1u << ch;
+    mutex_exit(&sniffer_lock);
+
+    return crc;
+}
+
+/**
+ * @brief Takes the host's mutex
+ *
+ * @param host SD Host Controller
+ */
+static void host_lock(sd_host_t *host)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+    recursive_mutex_enter_blocking(&ctx->lock);
+}
+
+/**
+ * @brief Releases the host's mutex
+ *
+ * @param host SD Host Controller
+ */
+static void host_unlock(sd_host_t *host)
+{
+    sd_host_ctx_t *ctx = host->ctx;
+    recursive_mutex_exit(&ctx->lock);
 }
 
 // ========== RP2040 Platform Port ==========
@@ -149,6 +496,9 @@ static const sd_spi_ops_t RP2040_SPI_OPS = {
     .xchg1 = xchg1,
     .write = write,
     .read_ff = read_ff,
+    .xfer = xfer,
+    .xfer_chain = xfer_chain,
+    .crc16 = crc16,
     .set_baud = set_clock,
 };
 
@@ -156,8 +506,10 @@ static const sd_spi_ops_t RP2040_SPI_OPS = {
 static const sd_host_ops_t RP2040_HOST_OPS = {
     .set_power = NULL,
     .delay_ms = sleep_ms,
-    .lock = NULL,
-    .unlock = NULL,
+    .delay_us = delay_us,
+    .get_time_us = time_us_64,
+    .lock = host_lock,
+    .unlock = host_unlock,
 };
 
 sd_status_t init_host(sd_host_t *host)
@@ -165,19 +517,39 @@ sd_status_t init_host(sd_host_t *host)
     if (!host || !host->ctx)
         return SD_ERR_PARAM;
 
+    sd_host_ctx_t *ctx = host->ctx;
+
+    // Default to the identification rate and the SD default speed maximum (25 Mhz)
+    if (!ctx->slow_hz)
+        ctx->slow_hz = 400000;
+    if (!ctx->fast_hz)
+        ctx->fast_hz = 25000000;
+
+    // The API takes the lock again for nested calls and completion callbacks
+    recursive_mutex_init(&ctx->lock);
+
     // Assigns host controller ops, and SPI bus ops
     host->ops = &RP2040_HOST_OPS;
-    sd_bind_spi_transport(host, &RP2040_SPI_OPS);
+#if SD_TRACE_ENABLE
+    host->trace = NULL;
+#endif
+    host->max_clock_hz = ctx->fast_hz;
+    sd_bind_spi_transport(host, &RP2040_SPI_OPS, &ctx->spi_ctx);
+    if (ctx->shared_bus)
+        sd_spi_share_bus(host, ctx->shared_bus);
 
-    // Initialize SPI peripheral
+    // Initialize SPI peripheral, and the DMA channels feeding it
     init_bus(host);
+    init_dma(ctx);
 
     // Provide ≥74 clocks with CS high before CMD0
     uint8_t ff[11];
     memset(ff, 0xFF, sizeof(ff));
 
     spi_ctx_t *spi_ctx = (spi_ctx_t *)host->bus_ctx;
-    spi_ctx->spi->set_baud(host, 400000);
+    host->bus->set_clock(host, ctx->slow_hz);
     spi_ctx->spi->select_cs(host, false);
     spi_ctx->spi->write(host, ff, sizeof(ff));
+
+    return SD_OK;
 }
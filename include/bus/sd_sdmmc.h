@@ -0,0 +1,99 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_sdmmc.h
+ * @brief Native SD bus operation prototypes and contexts
+ */
+
+#ifndef LIBSD_SD_SDMMC_H
+#define LIBSD_SD_SDMMC_H
+
+#include "../sd_host.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Native SD bus vtable/ops table. Porting a SD Host controller that drives the CMD and DAT
+ * lines (GPIO, PIO, a serializer) needs to implement these functions. Framing, CRCs, busy and
+ * timeouts are handled by the bus driver
+ *
+ * Bits are packed MSB first. On the CMD line every byte holds 8 clock cycles. On the DAT lines
+ * every cycle takes as many bits as the bus is wide: a byte holds 2 cycles of DAT3..DAT0 on a
+ * 4-bit bus, 8 cycles of DAT0 on a 1-bit bus. A partial byte uses its top bits
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Clocks the CMD line, driving it from tx and sampling it into rx
+     *
+     * @param tx Bits to drive, NULL to release the line (pulled high)
+     * @param rx Buffer for the sampled bits, NULL to discard them
+     * @param bits Number of clock cycles
+     */
+    void (*cmd_line)(sd_host_t *, const uint8_t *tx, uint8_t *rx, size_t bits);
+
+    /**
+     * @brief Clocks the DAT lines, driving them from tx and sampling them into rx
+     *
+     * @param tx Cycles to drive, NULL to release the lines (pulled high)
+     * @param rx Buffer for the sampled cycles, NULL to discard them
+     * @param cycles Number of clock cycles
+     */
+    void (*dat_lines)(sd_host_t *, const uint8_t *tx, uint8_t *rx, size_t cycles);
+
+    /**
+     * @brief Sets the number of DAT lines used, 1 or 4
+     *
+     * @param bits Bus width
+     */
+    void (*set_width)(sd_host_t *, int bits);
+
+    /**
+     * @brief Sets the bus clock rate
+     *
+     * @param hz Clock rate in hz
+     */
+    void (*set_clock)(sd_host_t *, uint32_t hz);
+} sd_sdmmc_ops_t;
+
+/**
+ * @brief Native SD bus Private Context, the logic sd_sdmmc.c will use this private context for its
+ * operations. Allocated by the caller, one per host
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Native SD bus vtable/ops table
+     */
+    const sd_sdmmc_ops_t *sdmmc;
+
+    /**
+     * @brief Pointer to Host controller struct, to us host functions like delay_ms
+     */
+    sd_host_t *host;
+
+    /**
+     * @brief Number of DAT lines in use, 1 or 4
+     */
+    uint8_t width;
+} sdmmc_ctx_t;
+
+/**
+ * @brief Binds a native SD bus vtable/ops to the host, configures host for SD bus mode
+ *
+ * @param host Pointer to host struct
+ * @param ops vtable/ops table to bind to host. Populated with line hooks for the target MCU
+ * @param ctx Private context for the host, must outlive it. Not shared between hosts
+ * @param supports_4bit Whether DAT1-DAT3 are wired
+ */
+void sd_bind_sdmmc_transport(sd_host_t *host,
+                             const sd_sdmmc_ops_t *ops,
+                             sdmmc_ctx_t *ctx,
+                             bool supports_4bit);
+
+#endif /* ifndef LIBSD_SD_SDMMC_H */
@@ -10,11 +10,27 @@
 #define LIBSD_SD_SPI_H
 
 #include "../sd_host.h"
+#include "sd_spi_chain.h"
 
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+/**
+ * @brief Bytes clocked in at once while polling for a R1, NCR is at most 8 bytes
+ */
+#ifndef SD_SPI_RESP_CHUNK
+#define SD_SPI_RESP_CHUNK 8
+#endif
+
+/**
+ * @brief Bytes clocked in at once while searching for a token or waiting out busy. Bytes clocked in
+ * past what is being polled for are kept and consumed by the following reads
+ */
+#ifndef SD_SPI_POLL_CHUNK
+#define SD_SPI_POLL_CHUNK 32
+#endif
+
 /**
  * @brief SPI vtable/ops table. Porting a SD Host controller that uses SPI needs to implement these functions
  *
@@ -52,6 +68,37 @@ typedef struct
      */
     void (*read_ff)(sd_host_t *, uint8_t *dst, size_t n);
 
+    /**
+     * @brief OPTIONAL: Full-duplex bulk transfer. When not provided, the bus driver falls back to
+     * xchg1 for polling
+     *
+     * @param tx Bytes to transmit, NULL to transmit n fill bytes
+     * @param rx Buffer for the received bytes, NULL to discard them
+     * @param n Number of bytes to exchange
+     * @param fill Byte to transmit when tx is NULL
+     */
+    void (*xfer)(sd_host_t *, const uint8_t *tx, uint8_t *rx, size_t n, uint8_t fill);
+
+    /**
+     * @brief OPTIONAL: Runs segments back to back, e.g. a data block and its CRC on chained DMA
+     * channels. Segments are either all receive with the same fill byte, or all transmit (see
+     * sd_spi_chain_dir). When not provided, the bus driver transfers the segments one at a time
+     *
+     * @param segs Segments to transfer
+     * @param count Number of segments
+     */
+    void (*xfer_chain)(sd_host_t *, const sd_spi_seg_t *segs, size_t count);
+
+    /**
+     * @brief OPTIONAL: Computes a CRC16-CCITT in hardware (e.g. a DMA sniffer). When not provided,
+     * the bus driver uses the table driven sd_crc16
+     *
+     * @param buf Buffer
+     * @param n Buffer length
+     * @return 16 bit CRC of the buffer, starting from 0
+     */
+    uint16_t (*crc16)(sd_host_t *, const uint8_t *buf, size_t n);
+
     /**
      * @brief Sets SPI Baud/clock rate
      *
@@ -61,10 +108,107 @@ typedef struct
 } sd_spi_ops_t;
 
 /**
- * @brief SPI Private Context, the logic sd_spi.c will use this private context for its operations
+ * @brief Phase of an asynchronous SPI request
+ *
+ */
+typedef enum
+{
+    SPI_ASYNC_IDLE,
+    SPI_ASYNC_TOKEN,    // Waiting for the start token of the next read block
+    SPI_ASYNC_BUSY,     // Waiting for the card to program the last written block
+    SPI_ASYNC_STOP_BUSY // Waiting for the card to finish after CMD12 or the stop tran token
+} spi_async_state_t;
+
+/**
+ * @brief State of the in-flight asynchronous SPI request
  *
  */
 typedef struct
+{
+    /**
+     * @brief Request in flight, NULL if none
+     */
+    const sd_request_t *rq;
+
+    /**
+     * @brief Response of the request in flight
+     */
+    sd_response_t *out;
+
+    /**
+     * @brief Position in the data buffer of the current block
+     */
+    uint8_t *buf;
+
+    /**
+     * @brief Blocks completed
+     */
+    uint32_t block;
+
+    /**
+     * @brief Phase of the request
+     */
+    spi_async_state_t state;
+
+    /**
+     * @brief Status reported once the busy phase of a stop ends, the data phase may have failed
+     */
+    sd_status_t status;
+
+    /**
+     * @brief Time (us) the current phase times out
+     */
+    uint64_t deadline;
+
+    /**
+     * @brief Time (us) the request was started, for statistics
+     */
+    uint64_t start;
+
+    /**
+     * @brief Time (us) the current busy phase started, for statistics
+     */
+    uint64_t busy_start;
+
+    /**
+     * @brief Chunks polled in the current busy phase, for statistics
+     */
+    uint32_t busy_polls;
+
+    /**
+     * @brief Time (us) the request was started, for the trace
+     */
+    uint32_t trace_start;
+} spi_async_t;
+
+struct spi_ctx_t;
+
+/**
+ * @brief SPI peripheral shared by several cards. Every card has its own host, spi_ctx_t and CS
+ * line, the bus tracks which of them holds CS and which clock the peripheral is set to. It has no
+ * lock of its own: each host's lock only serializes that card, so all cards on one bus must be
+ * used from a single thread, task or core
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Context whose card has CS asserted, NULL if none
+     */
+    struct spi_ctx_t *active;
+
+    /**
+     * @brief Context whose clock rate the peripheral is set to, NULL if unknown
+     */
+    struct spi_ctx_t *clocked;
+} sd_spi_bus_t;
+
+/**
+ * @brief SPI Private Context, the logic sd_spi.c will use this private context for its operations.
+ * Allocated by the caller, one per host
+ *
+ */
+typedef struct spi_ctx_t
 {
     /**
      * @brief SPI vtable/ops table
@@ -75,6 +219,51 @@ typedef struct
      * @brief Pointer to Host controller struct, to us host functions like delay_ms
      */
     sd_host_t *host;
+
+    /**
+     * @brief SPI peripheral shared with other hosts, NULL if the host has it to itself
+     */
+    sd_spi_bus_t *bus;
+
+    /**
+     * @brief Clock rate of this card, restored when it is selected on a shared bus
+     */
+    uint32_t clock_hz;
+
+    /**
+     * @brief Bytes clocked in from the card while polling, not yet consumed
+     */
+    uint8_t rx_buf[SD_SPI_POLL_CHUNK > SD_SPI_RESP_CHUNK ? SD_SPI_POLL_CHUNK : SD_SPI_RESP_CHUNK];
+
+    /**
+     * @brief Index of the next unconsumed byte in rx_buf
+     */
+    uint8_t rx_head;
+
+    /**
+     * @brief Number of unconsumed bytes in rx_buf
+     */
+    uint8_t rx_len;
+
+    /**
+     * @brief Whether the card checks CRCs (CMD59), data block CRCs are then computed and verified
+     */
+    bool crc_on;
+
+    /**
+     * @brief Whether a CMD18 stream was left open, the card stays selected until it is stopped
+     */
+    bool stream_open;
+
+    /**
+     * @brief Timeout (ms) waiting for each block of the open stream
+     */
+    uint32_t stream_timeout_ms;
+
+    /**
+     * @brief In-flight asynchronous request
+     */
+    spi_async_t async;
 } spi_ctx_t;
 
 /**
@@ -82,7 +271,21 @@ typedef struct
  *
  * @param host Pointer to host struct
  * @param ops vtable/ops table to bind to host. Populated with SPI hooks for the target MCU
+ * @param ctx Private context for the host, must outlive it. Not shared between hosts
+ */
+void sd_bind_spi_transport(sd_host_t *host, const sd_spi_ops_t *ops, spi_ctx_t *ctx);
+
+/**
+ * @brief Puts a bound host on a SPI peripheral shared with other hosts, each with its own CS line.
+ * Selecting a card first stops a read stream another card on the bus left open, and restores the
+ * card's clock rate. Requests fail with SD_ERR_PARAM while another card has an asynchronous request
+ * in flight. Not thread safe: the host lock hooks only serialize calls on one card, the bus state
+ * and the wire are not locked, so every card on the bus must be driven from the same thread, task
+ * or core
+ *
+ * @param host Host bound with sd_bind_spi_transport
+ * @param bus Shared bus state, zero initialized, must outlive every host on it
  */
-void sd_bind_spi_transport(sd_host_t *host, const sd_spi_ops_t *ops);
+void sd_spi_share_bus(sd_host_t *host, sd_spi_bus_t *bus);
 
 #endif /* ifndef LIBSD_SD_SPI_H */
@@ -0,0 +1,143 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_spi_chain.h
+ * @brief Chained SPI transfer segments, and the state machine ports use to run them on two
+ * ping-ponged DMA channels
+ */
+
+#ifndef LIBSD_SD_SPI_CHAIN_H
+#define LIBSD_SD_SPI_CHAIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Number of slots (DMA channels) a chain alternates between
+ */
+#define SD_SPI_CHAIN_SLOTS 2
+
+/**
+ * @brief One segment of a chained transfer
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Bytes to transmit, NULL to transmit fill
+     */
+    const uint8_t *tx;
+
+    /**
+     * @brief Buffer for the received bytes, NULL to discard them
+     */
+    uint8_t *rx;
+
+    /**
+     * @brief Number of bytes, never 0
+     */
+    size_t len;
+
+    /**
+     * @brief Byte transmitted when tx is NULL
+     */
+    uint8_t fill;
+} sd_spi_seg_t;
+
+/**
+ * @brief Which side of the bus a chain moves through its segments. The other side runs for the
+ * whole chain at once: filler out for a receive chain, discarded bytes in for a transmit chain
+ *
+ */
+typedef enum
+{
+    SD_SPI_CHAIN_RX,     // Every segment receives, and transmits the same fill byte
+    SD_SPI_CHAIN_TX,     // Every segment transmits, received bytes are discarded
+    SD_SPI_CHAIN_INVALID // Segments mix directions, are full-duplex or empty
+} sd_spi_chain_dir_t;
+
+/**
+ * @brief Progress of a chain over its slots. Segments are loaded into the slots in turn: while one
+ * slot transfers, the other holds the next segment and is triggered by the first one completing,
+ * and the slot that completed is reloaded with the segment after that
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Segments of the chain
+     */
+    const sd_spi_seg_t *segs;
+
+    /**
+     * @brief Number of segments
+     */
+    size_t count;
+
+    /**
+     * @brief Segments loaded into a slot so far
+     */
+    size_t armed;
+
+    /**
+     * @brief Segments completed so far
+     */
+    size_t completed;
+
+    /**
+     * @brief Slot transferring, or next to transfer
+     */
+    uint8_t active;
+} sd_spi_chain_t;
+
+/**
+ * @brief Classifies segments by the side of the bus that moves through them
+ *
+ * @param segs Segments
+ * @param count Number of segments
+ * @return Direction of the chain, SD_SPI_CHAIN_INVALID if it can't be chained
+ */
+sd_spi_chain_dir_t sd_spi_chain_dir(const sd_spi_seg_t *segs, size_t count);
+
+/**
+ * @brief Total number of bytes clocked by a chain
+ *
+ * @param segs Segments
+ * @param count Number of segments
+ * @return Bytes
+ */
+size_t sd_spi_chain_len(const sd_spi_seg_t *segs, size_t count);
+
+/**
+ * @brief Starts a chain, the first segment goes into slot 0
+ *
+ * @param chain Chain state
+ * @param segs Segments, must outlive the chain
+ * @param count Number of segments
+ */
+void sd_spi_chain_init(sd_spi_chain_t *chain, const sd_spi_seg_t *segs, size_t count);
+
+/**
+ * @brief Hands out the next segment to load, if a slot is free. Called until it returns NULL
+ * after sd_spi_chain_init and after every sd_spi_chain_complete
+ *
+ * @param chain Chain state
+ * @param slot Output, slot to load the segment into
+ * @param chained Output, whether the other slot is still loaded and must trigger this slot when it
+ * completes. Otherwise this slot is the head of the chain and must be triggered by the caller
+ * @return Segment to load, NULL if none or no slot is free
+ */
+const sd_spi_seg_t *sd_spi_chain_arm(sd_spi_chain_t *chain, uint8_t *slot, bool *chained);
+
+/**
+ * @brief Records that the active slot completed its segment, freeing it
+ *
+ * @param chain Chain state
+ * @param next Output, slot expected to be transferring now
+ * @return Whether segments remain, false once the chain is complete
+ */
+bool sd_spi_chain_complete(sd_spi_chain_t *chain, uint8_t *next);
+
+#endif /* ifndef LIBSD_SD_SPI_CHAIN_H */
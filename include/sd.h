@@ -15,6 +15,148 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/**
+ * @brief Whether sd_init turns on CRC checking (CMD59) of commands and data blocks in SPI mode
+ */
+#ifndef SD_CRC_ENABLE
+#define SD_CRC_ENABLE 1
+#endif
+
+struct sd_async;
+
+/**
+ * @brief Card geometry and performance, decoded from the SCR and the SD Status. Fields the card
+ * doesn't report are 0
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Allocation unit size in blocks (AU_SIZE)
+     */
+    uint32_t au_blocks;
+
+    /**
+     * @brief Allocation unit size in blocks for UHS speed grade operation (UHS_AU_SIZE)
+     */
+    uint32_t uhs_au_blocks;
+
+    /**
+     * @brief Number of AUs erased within erase_timeout_s (ERASE_SIZE)
+     */
+    uint16_t erase_size;
+
+    /**
+     * @brief Seconds to erase erase_size AUs (ERASE_TIMEOUT)
+     */
+    uint8_t erase_timeout_s;
+
+    /**
+     * @brief Seconds added once to every erase (ERASE_OFFSET)
+     */
+    uint8_t erase_offset_s;
+
+    /**
+     * @brief Speed class, the guaranteed sequential write rate in MB/s: 0, 2, 4, 6 or 10
+     */
+    uint8_t speed_class;
+
+    /**
+     * @brief UHS speed grade, the guaranteed rate in units of 10MB/s: 0, 1 or 3
+     */
+    uint8_t uhs_speed_grade;
+
+    /**
+     * @brief Video speed class, the guaranteed rate in MB/s (V6 ... V90)
+     */
+    uint8_t video_speed_class;
+
+    /**
+     * @brief Application performance class, 1 for A1 and 2 for A2
+     */
+    uint8_t app_perf_class;
+
+    /**
+     * @brief Sequential write rate in MB/s while moving data, 0xFF for infinity (PERFORMANCE_MOVE)
+     */
+    uint8_t perf_move_mbs;
+
+    /**
+     * @brief Physical layer specification version, e.g. 0x300 for 3.0x (SD_SPEC, SD_SPEC3/4/X)
+     */
+    uint16_t spec_version;
+
+    /**
+     * @brief Whether the card supports the 4-bit bus (SD_BUS_WIDTHS)
+     */
+    bool bus_4bit;
+
+    /**
+     * @brief Value of erased bytes, 0x00 or 0xFF (DATA_STAT_AFTER_ERASE)
+     */
+    uint8_t erase_value;
+} sd_geometry_t;
+
+/**
+ * @brief How the last sd_init or sd_init_fast brought the card up
+ *
+ */
+typedef enum
+{
+    SD_INIT_FULL = 0, // Full identification, every register read
+    SD_INIT_COLD,     // The card was power cycled, identification without the saved registers
+    SD_INIT_WARM,     // The card kept power and its state, only the host side was restored
+} sd_init_path_t;
+
+/**
+ * @brief Time spent in each phase of the last initialization, in microseconds. All 0 without the
+ * host's get_time_us
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Powering the card and letting it settle
+     */
+    uint32_t power_us;
+
+    /**
+     * @brief CMD0, CMD8 and CMD59 at the identification clock. On a warm resume, probing the card
+     */
+    uint32_t reset_us;
+
+    /**
+     * @brief ACMD41 polling until the card is ready, and CMD58 in SPI mode. Usually the longest
+     */
+    uint32_t op_cond_us;
+
+    /**
+     * @brief Registers and identity: CMD2/CMD3/CMD9/CMD7 on the SD bus, CMD16/CMD9/CMD10 in SPI
+     * mode
+     */
+    uint32_t ident_us;
+
+    /**
+     * @brief SCR, bus width, SD Status, speed mode and the operating clock
+     */
+    uint32_t config_us;
+
+    /**
+     * @brief Sum of the phases
+     */
+    uint32_t total_us;
+
+    /**
+     * @brief ACMD41 commands sent
+     */
+    uint16_t op_cond_polls;
+
+    /**
+     * @brief How the card was brought up
+     */
+    sd_init_path_t path;
+} sd_init_times_t;
+
 /**
  * @brief Struct representing SD card properties, set by sd_init and manipulated by SD commands
  *
@@ -51,11 +193,26 @@ typedef struct
      */
     sd_speed_t curr_speed;
 
+    /**
+     * @brief Maximum transfer clock of the card in the current speed mode (CSD TRAN_SPEED)
+     */
+    uint32_t max_clock_hz;
+
+    /**
+     * @brief Bus clock the card is currently operated at
+     */
+    uint32_t clock_hz;
+
     /**
      * @brief Whether a 4-bit bus is being used
      */
     bool bus_4bit;
 
+    /**
+     * @brief Whether the card checks the CRC of commands and data blocks (always on the SD bus)
+     */
+    bool crc_on;
+
     /**
      * @brief Whether the SD card is locked
      */
@@ -72,27 +229,236 @@ typedef struct
     uint8_t cid[16];
 
     /**
-     * @brief Card-Specific Data Register`
+     * @brief Card-Specific Data Register
      */
     uint8_t csd[16];
 
     /**
-     * @brief SD Configuration Register
+     * @brief SD Configuration Register, all zeroes if the card didn't return it
      */
     uint8_t scr[8];
 
+    /**
+     * @brief SD Status (ACMD13), all zeroes if the card didn't return it
+     */
+    uint8_t ssr[64];
+
+    /**
+     * @brief Allocation unit size in blocks (SD Status AU_SIZE), 0 if not reported
+     */
+    uint32_t au_blocks;
+
+    /**
+     * @brief Number of AUs erased within erase_timeout_s (SD Status ERASE_SIZE), 0 if the card
+     * doesn't support the erase timeout calculation
+     */
+    uint16_t erase_size;
+
+    /**
+     * @brief Seconds to erase erase_size AUs (SD Status ERASE_TIMEOUT)
+     */
+    uint8_t erase_timeout_s;
+
+    /**
+     * @brief Seconds added once to every erase (SD Status ERASE_OFFSET)
+     */
+    uint8_t erase_offset_s;
+
+    /**
+     * @brief Whether sequential reads are served from an open CMD18 stream (sd_set_read_ahead)
+     */
+    bool read_ahead;
+
+    /**
+     * @brief Whether a CMD18 stream is open
+     */
+    bool stream_open;
+
+    /**
+     * @brief Block the open stream delivers next
+     */
+    uint32_t stream_next;
+
+    /**
+     * @brief Block following the last read, a read starting here is sequential
+     */
+    uint32_t seq_next;
+
+    /**
+     * @brief Time spent in each phase of the last sd_init or sd_init_fast
+     */
+    sd_init_times_t init_times;
+
     /**
      * @brief Host controller associated with card
      */
     sd_host_t *host;
+
+    /**
+     * @brief Oldest queued asynchronous request, the one in progress
+     */
+    struct sd_async *async_head;
+
+    /**
+     * @brief Newest queued asynchronous request
+     */
+    struct sd_async *async_tail;
 } sd_card_t;
 
+/**
+ * @brief First word of a card descriptor, "SDD1" in little endian. The digit is bumped whenever
+ * the layout changes, so descriptors kept across firmware updates are rejected
+ */
+#define SD_CARD_DESC_MAGIC 0x31444453u
+
+/**
+ * @brief What sd_init_fast needs to bring a known card back up: its registers and the bus setup
+ * negotiated for it. Plain data, fit to keep in retention RAM or flash across low power states
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief SD_CARD_DESC_MAGIC once filled in by sd_get_card_desc
+     */
+    uint32_t magic;
+
+    /**
+     * @brief Bus the card was used on
+     */
+    sd_bus_t bus;
+
+    /**
+     * @brief Operation Conditions Register
+     */
+    uint32_t ocr;
+
+    /**
+     * @brief SD Mode RCA (0 in SPI)
+     */
+    uint32_t rca;
+
+    /**
+     * @brief Card Identification Register, compared to tell whether the same card is present
+     */
+    uint8_t cid[16];
+
+    /**
+     * @brief Card-Specific Data Register
+     */
+    uint8_t csd[16];
+
+    /**
+     * @brief SD Configuration Register
+     */
+    uint8_t scr[8];
+
+    /**
+     * @brief SD Status
+     */
+    uint8_t ssr[64];
+
+    /**
+     * @brief Speed mode
+     */
+    sd_speed_t speed;
+
+    /**
+     * @brief Maximum transfer clock in that speed mode
+     */
+    uint32_t max_clock_hz;
+
+    /**
+     * @brief Bus clock the card was operated at
+     */
+    uint32_t clock_hz;
+
+    /**
+     * @brief Whether the 4-bit bus was in use
+     */
+    bool bus_4bit;
+
+    /**
+     * @brief Whether the card checked CRCs
+     */
+    bool crc_on;
+} sd_card_desc_t;
+
+/**
+ * @brief Handle of an asynchronous block request
+ */
+typedef struct sd_async sd_async_t;
+
+/**
+ * @brief Completion callback of an asynchronous block request, invoked from sd_poll with the host
+ * lock held
+ *
+ * @param req Request that completed
+ * @param status Final status of the request
+ * @param user User pointer given when the request was submitted
+ */
+typedef void (*sd_async_cb_t)(sd_async_t *req, sd_status_t status, void *user);
+
+/**
+ * @brief Asynchronous block request. Allocated by the caller, and owned by libsd from submission
+ * until its callback is invoked
+ *
+ */
+struct sd_async
+{
+    /**
+     * @brief Card the request targets
+     */
+    sd_card_t *card;
+
+    /**
+     * @brief Command request handed to the bus driver
+     */
+    sd_request_t rq;
+
+    /**
+     * @brief Command response
+     */
+    sd_response_t rs;
+
+    /**
+     * @brief Data buffer
+     */
+    void *buf;
+
+    /**
+     * @brief Completion callback, may be NULL
+     */
+    sd_async_cb_t cb;
+
+    /**
+     * @brief User pointer passed to the callback
+     */
+    void *user;
+
+    /**
+     * @brief SD_PENDING until completion, then the final status
+     */
+    volatile sd_status_t status;
+
+    /**
+     * @brief Whether the request was handed to the bus driver
+     */
+    bool started;
+
+    /**
+     * @brief Next queued request
+     */
+    struct sd_async *next;
+};
+
 // ========== libsd API ==========
 
 // === SD Lifecycle ===
 
 /**
- * @brief Initializes the SD card and sd_card_t struct
+ * @brief Initializes the SD card and sd_card_t struct, recording the time of each phase in
+ * card->init_times
  *
  * @param host A fully initialized SD host controller
  * @param card Struct representing the card to operate on
@@ -101,25 +467,86 @@ typedef struct
 sd_status_t sd_init(sd_host_t *host, sd_card_t *card);
 
 /**
- * @brief Sets bus width
+ * @brief Brings a card back up from a descriptor saved by sd_get_card_desc, e.g. after a low
+ * power state. A card that kept power is only probed (CMD13) and checked to be the same one, the
+ * host then just resumes where it left off. A power cycled card goes through CMD0, CMD8 and ACMD41,
+ * but the registers aren't read again, CMD16 is skipped on SDHC/SDXC cards, and the bus moves to
+ * the saved operating clock, bus width and speed mode right after identification. Falls back to a
+ * full sd_init when the descriptor is invalid or a different card is present, card->init_times
+ * tells which path was taken
  *
- * @param card SD Card to operate on
- * @param width_bits Bus width
+ * @param host A fully initialized SD host controller
+ * @param card Struct representing the card to operate on
+ * @param desc Descriptor saved from the card
+ * @return Status code
+ */
+sd_status_t sd_init_fast(sd_host_t *host, sd_card_t *card, const sd_card_desc_t *desc);
+
+/**
+ * @brief Saves what sd_init_fast needs to bring the card back up. Also completes queued requests
+ * and stops an open read stream, so the card waits in the transfer state: call it right before
+ * entering a low power state
+ *
+ * @param card Initialized SD card
+ * @param desc Output, card descriptor
  * @return Status code
  */
+sd_status_t sd_get_card_desc(sd_card_t *card, sd_card_desc_t *desc);
+
+/**
+ * @brief Sets bus width (ACMD6). sd_init already selects 4-bit when the card and controller
+ * support it
+ *
+ * @param card SD Card to operate on
+ * @param width_bits Bus width, 1 or 4. Only 1 in SPI mode
+ * @return Status code, SD_ERR_UNSUPPORTED if the card or controller lacks DAT1-DAT3
+ */
 sd_status_t sd_set_bus_width(sd_card_t *card, int width_bits);
 
 /**
- * @brief Sets SD Card speed
+ * @brief Sets SD Card speed with CMD6 (SWITCH_FUNC) and raises the bus clock to match, within
+ * host->max_clock_hz. Cards start out at default speed (25MHz), high speed allows 50MHz
  *
  * @param card SD Card to operate on
- * @param speed Speed to operate
- * @return Status code
+ * @param speed SD_SPEED_DEFAULT or SD_SPEED_HIGH, UHS modes need 1.8V signalling
+ * @return Status code, SD_ERR_UNSUPPORTED if the card lacks the access mode
  */
 sd_status_t sd_set_speed(sd_card_t *card, sd_speed_t speed);
 
+/**
+ * @brief Turns CRC checking of commands and data blocks on or off (CMD59). Only SPI mode can turn
+ * it off, the native SD bus always checks CRCs
+ *
+ * @param card SD Card to operate on
+ * @param enable Whether to check CRCs
+ * @return Status code
+ */
+sd_status_t sd_set_crc(sd_card_t *card, bool enable);
+
+// === Card information ===
+
+/**
+ * @brief Decodes the card's geometry and performance class, read by sd_init
+ *
+ * @param card Initialized SD card
+ * @param geo Output, decoded geometry
+ * @return Status code
+ */
+sd_status_t sd_get_geometry(const sd_card_t *card, sd_geometry_t *geo);
+
 // === Block level i/o ===
 
+/**
+ * @brief Turns read-ahead on or off. With it on, a read continuing the previous one opens a CMD18
+ * stream that following sequential reads are served from without a new command. Any other access
+ * stops the stream (CMD12)
+ *
+ * @param card SD Card to operate on
+ * @param enable Whether to read ahead
+ * @return Status code, SD_ERR_UNSUPPORTED if the bus can't keep a stream open
+ */
+sd_status_t sd_set_read_ahead(sd_card_t *card, bool enable);
+
 /**
  * @brief Reads blocks from SD card
  *
@@ -143,13 +570,141 @@ sd_status_t sd_read_blocks(sd_card_t *card, uint32_t lba, void *buf, uint32_t co
 sd_status_t sd_write_blocks(sd_card_t *card, uint32_t lba, const void *buf, uint32_t count);
 
 /**
- * @brief Erases a range of blocks on a SD Card
+ * @brief Reads blocks straight into a list of segments with a single command, so data can land in
+ * place (e.g. a header and a payload) without a copy. Segments may split blocks anywhere and may
+ * be empty, their lengths must add up to whole blocks. Buses without a scatter-gather data phase
+ * fall back to a command per run of whole blocks within a segment
+ *
+ * @param card SD Card to operate on
+ * @param lba Start block
+ * @param iov Destination segments
+ * @param iovcnt Number of segments
+ * @return Status code, SD_ERR_PARAM if the segments don't add up to whole blocks
+ */
+sd_status_t sd_readv(sd_card_t *card, uint32_t lba, const sd_iovec_t *iov, uint32_t iovcnt);
+
+/**
+ * @brief Writes blocks gathered from a list of segments with a single command. The same rules as
+ * sd_readv apply
+ *
+ * @param card SD Card to operate on
+ * @param lba Start block
+ * @param iov Source segments
+ * @param iovcnt Number of segments
+ * @return Status code, SD_ERR_PARAM if the segments don't add up to whole blocks
+ */
+sd_status_t sd_writev(sd_card_t *card, uint32_t lba, const sd_iovec_t *iov, uint32_t iovcnt);
+
+/**
+ * @brief Erases a range of blocks on a SD Card (CMD32/CMD33/CMD38). Waits for the card to finish,
+ * up to the erase timeout derived from the SD Status erase fields
  *
  * @param card SD Card to operate on
  * @param lba_start Starting block
- * @param lba_end Ending block
+ * @param lba_end Ending block, inclusive
  * @return Status code
  */
 sd_status_t sd_erase_range(sd_card_t *card, uint32_t lba_start, uint32_t lba_end);
 
+/**
+ * @brief Erases the whole allocation units within a range of blocks, partial AUs at either end
+ * are left untouched. Erasing regions ahead of time, e.g. a log while idle, makes later writes to
+ * them faster
+ *
+ * @param card SD Card to operate on
+ * @param lba_start Starting block
+ * @param lba_end Ending block, inclusive
+ * @return Status code, SD_ERR_UNSUPPORTED if the card doesn't report its AU size
+ */
+sd_status_t sd_discard(sd_card_t *card, uint32_t lba_start, uint32_t lba_end);
+
+// === Asynchronous block i/o ===
+
+/**
+ * @brief Queues a read of blocks from the SD card and returns immediately. The request is started
+ * and advanced by sd_poll, which invokes cb once it completes
+ *
+ * @param card SD Card to operate on
+ * @param req Request handle, must stay valid until completion
+ * @param lba Start block
+ * @param buf Buffer to store contents, must stay valid until completion
+ * @param count Number of blocks
+ * @param cb Completion callback, may be NULL
+ * @param user User pointer passed to cb
+ * @return Status code, SD_OK if the request was queued
+ */
+sd_status_t sd_read_blocks_async(sd_card_t *card,
+                                 sd_async_t *req,
+                                 uint32_t lba,
+                                 void *buf,
+                                 uint32_t count,
+                                 sd_async_cb_t cb,
+                                 void *user);
+
+/**
+ * @brief Queues a write of blocks to the SD card and returns immediately. The request is started
+ * and advanced by sd_poll, which invokes cb once it completes
+ *
+ * @param card SD Card to operate on
+ * @param req Request handle, must stay valid until completion
+ * @param lba Start block
+ * @param buf Buffer containing data to write, must stay valid until completion
+ * @param count Number of blocks
+ * @param cb Completion callback, may be NULL
+ * @param user User pointer passed to cb
+ * @return Status code, SD_OK if the request was queued
+ */
+sd_status_t sd_write_blocks_async(sd_card_t *card,
+                                  sd_async_t *req,
+                                  uint32_t lba,
+                                  const void *buf,
+                                  uint32_t count,
+                                  sd_async_cb_t cb,
+                                  void *user);
+
+/**
+ * @brief Advances queued asynchronous requests without waiting for data tokens or busy. Call
+ * from the main loop, or from a bus completion interrupt. The waits left are bounded: starting a
+ * request clocks its command (and the ACMD23 ahead of a multi-block write) and R1, stopping a
+ * multi-block read clocks CMD12 and its R1. On a bus without submit_async a request runs to
+ * completion when it starts
+ *
+ * @param card SD Card to operate on
+ * @return SD_PENDING while requests remain queued, SD_OK once the queue is empty
+ */
+sd_status_t sd_poll(sd_card_t *card);
+
+// === Statistics ===
+
+/**
+ * @brief Copies the command statistics recorded for the card's host since sd_init or the last
+ * sd_reset_stats. Needs SD_STATS_ENABLE
+ *
+ * @param card SD Card to operate on
+ * @param out Output, statistics
+ * @return Status code, SD_ERR_UNSUPPORTED if statistics were compiled out
+ */
+sd_status_t sd_get_stats(sd_card_t *card, sd_stats_t *out);
+
+/**
+ * @brief Clears the command statistics of the card's host
+ *
+ * @param card SD Card to operate on
+ * @return Status code, SD_ERR_UNSUPPORTED if statistics were compiled out
+ */
+sd_status_t sd_reset_stats(sd_card_t *card);
+
+// === Tracing ===
+
+/**
+ * @brief Attaches a trace ring to a host. From then on every command and every block API call on
+ * it appends a record. Attaching between init_host and sd_init traces the initialization too.
+ * Needs SD_TRACE_ENABLE
+ *
+ * @param host SD Host, set up by the port's init_host
+ * @param trace Ring initialized with sd_trace_init, NULL to stop tracing
+ * @return Status code, SD_ERR_UNSUPPORTED if tracing was compiled out
+ */
+sd_status_t sd_trace_attach(sd_host_t *host, sd_trace_t *trace);
+
 #endif
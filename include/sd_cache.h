@@ -0,0 +1,156 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_cache.h
+ * @brief Optional write-back LRU block cache in front of the block API
+ */
+
+#ifndef LIBSD_SD_CACHE_H
+#define LIBSD_SD_CACHE_H
+
+#include "sd.h"
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of a cached block
+ */
+#define SD_CACHE_BLOCK_LEN 512
+
+/**
+ * @brief Bytes of arena needed for a cache of N slots
+ */
+#define SD_CACHE_ARENA_LEN(n) ((n) * SD_CACHE_BLOCK_LEN)
+
+/**
+ * @brief State of one cache slot
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Block held by the slot
+     */
+    uint32_t lba;
+
+    /**
+     * @brief Value of the cache's tick at the last access, the lowest is evicted first
+     */
+    uint32_t last_use;
+
+    /**
+     * @brief Whether the slot holds a block
+     */
+    bool valid;
+
+    /**
+     * @brief Whether the slot was written and not yet flushed to the card
+     */
+    bool dirty;
+} sd_cache_slot_t;
+
+/**
+ * @brief Write-back block cache. Single block accesses (FAT sectors, directory entries) are kept
+ * in the cache, multi-block transfers go to the card and only update blocks already cached
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Card behind the cache
+     */
+    sd_card_t *card;
+
+    /**
+     * @brief Block storage, slot i at arena + i * SD_CACHE_BLOCK_LEN
+     */
+    uint8_t *arena;
+
+    /**
+     * @brief Per slot state
+     */
+    sd_cache_slot_t *slots;
+
+    /**
+     * @brief Number of slots
+     */
+    uint32_t count;
+
+    /**
+     * @brief Access counter, stamps the slots for LRU replacement
+     */
+    uint32_t tick;
+
+    /**
+     * @brief Blocks served from the cache
+     */
+    uint32_t hits;
+
+    /**
+     * @brief Blocks that had to be read from, or were first written through, the card
+     */
+    uint32_t misses;
+
+    /**
+     * @brief Dirty blocks written back to the card, on eviction or flush
+     */
+    uint32_t writebacks;
+} sd_cache_t;
+
+/**
+ * @brief Initializes an empty cache over user supplied storage
+ *
+ * @param cache Cache to initialize
+ * @param card Initialized SD card
+ * @param arena Block storage, SD_CACHE_ARENA_LEN(count) bytes
+ * @param slots Slot state, count entries
+ * @param count Number of slots
+ * @return Status code
+ */
+sd_status_t sd_cache_init(sd_cache_t *cache,
+                          sd_card_t *card,
+                          void *arena,
+                          sd_cache_slot_t *slots,
+                          uint32_t count);
+
+/**
+ * @brief Reads blocks through the cache
+ *
+ * @param cache Cache
+ * @param lba Start block
+ * @param buf Buffer to store contents, must be correctly sized
+ * @param count Number of blocks
+ * @return Status code
+ */
+sd_status_t sd_cache_read(sd_cache_t *cache, uint32_t lba, void *buf, uint32_t count);
+
+/**
+ * @brief Writes blocks through the cache. Single blocks are only written back on eviction or flush
+ *
+ * @param cache Cache
+ * @param lba Start block
+ * @param buf Buffer containing data to write, must be correctly sized
+ * @param count Number of blocks
+ * @return Status code
+ */
+sd_status_t sd_cache_write(sd_cache_t *cache, uint32_t lba, const void *buf, uint32_t count);
+
+/**
+ * @brief Writes every dirty block back to the card, in block order
+ *
+ * @param cache Cache
+ * @return Status code, blocks that failed stay dirty
+ */
+sd_status_t sd_cache_flush(sd_cache_t *cache);
+
+/**
+ * @brief Drops every cached block without writing dirty ones back, e.g. after a card change
+ *
+ * @param cache Cache
+ */
+void sd_cache_invalidate(sd_cache_t *cache);
+
+#endif /* ifndef LIBSD_SD_CACHE_H */
@@ -0,0 +1,151 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_coalesce.h
+ * @brief Optional write coalescing, merges contiguous small writes into CMD25 bursts
+ */
+
+#ifndef LIBSD_SD_COALESCE_H
+#define LIBSD_SD_COALESCE_H
+
+#include "sd.h"
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of a buffered block
+ */
+#define SD_COALESCE_BLOCK_LEN 512
+
+/**
+ * @brief Bytes of arena needed to buffer N blocks
+ */
+#define SD_COALESCE_ARENA_LEN(n) ((n) * SD_COALESCE_BLOCK_LEN)
+
+/**
+ * @brief Write coalescing state. Contiguous writes are buffered and written as one CMD25 (with an
+ * ACMD23 pre-erase count) once the threshold, an AU boundary or the deadline is reached, or on
+ * sd_coalesce_flush. The tuning fields may be changed after sd_coalesce_init
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Card behind the coalescing layer
+     */
+    sd_card_t *card;
+
+    /**
+     * @brief Buffered blocks, contiguous from start
+     */
+    uint8_t *arena;
+
+    /**
+     * @brief Capacity of the arena in blocks
+     */
+    uint32_t arena_blocks;
+
+    /**
+     * @brief First buffered block
+     */
+    uint32_t start;
+
+    /**
+     * @brief Number of buffered blocks
+     */
+    uint32_t count;
+
+    /**
+     * @brief Time (us) the oldest buffered block was written, if the host has a time source
+     */
+    uint64_t since_us;
+
+    // ===== Tuning =====
+
+    /**
+     * @brief Buffered blocks that trigger a burst, at most arena_blocks (the default)
+     */
+    uint32_t threshold;
+
+    /**
+     * @brief Allocation unit size in blocks, bursts end at AU boundaries. 0 for none. Defaults to
+     * the card's AU size (SD Status)
+     */
+    uint32_t au_blocks;
+
+    /**
+     * @brief Longest time (ms) a block stays buffered, checked on writes and sd_coalesce_poll. 0
+     * for none (the default). Needs the host's get_time_us
+     */
+    uint32_t deadline_ms;
+
+    // ===== Statistics =====
+
+    /**
+     * @brief Blocks written through the layer
+     */
+    uint32_t blocks;
+
+    /**
+     * @brief Write commands issued to the card
+     */
+    uint32_t bursts;
+} sd_coalesce_t;
+
+/**
+ * @brief Initializes an empty coalescing layer over a user supplied arena
+ *
+ * @param co Coalescing state to initialize
+ * @param card Initialized SD card
+ * @param arena Block buffer, SD_COALESCE_ARENA_LEN(arena_blocks) bytes
+ * @param arena_blocks Capacity of the arena in blocks
+ * @return Status code
+ */
+sd_status_t sd_coalesce_init(sd_coalesce_t *co,
+                             sd_card_t *card,
+                             void *arena,
+                             uint32_t arena_blocks);
+
+/**
+ * @brief Writes blocks through the coalescing layer
+ *
+ * @param co Coalescing state
+ * @param lba Start block
+ * @param buf Buffer containing data to write, must be correctly sized
+ * @param count Number of blocks
+ * @return Status code, including that of any burst written by the call
+ */
+sd_status_t sd_coalesce_write(sd_coalesce_t *co, uint32_t lba, const void *buf, uint32_t count);
+
+/**
+ * @brief Reads blocks, buffered blocks in the range are written out first
+ *
+ * @param co Coalescing state
+ * @param lba Start block
+ * @param buf Buffer to store contents, must be correctly sized
+ * @param count Number of blocks
+ * @return Status code
+ */
+sd_status_t sd_coalesce_read(sd_coalesce_t *co, uint32_t lba, void *buf, uint32_t count);
+
+/**
+ * @brief Writes the buffered blocks out if they were held longer than the deadline. Call
+ * periodically when writes may stop for a while
+ *
+ * @param co Coalescing state
+ * @return Status code
+ */
+sd_status_t sd_coalesce_poll(sd_coalesce_t *co);
+
+/**
+ * @brief Writes the buffered blocks out as one burst
+ *
+ * @param co Coalescing state
+ * @return Status code, the blocks stay buffered if the write failed
+ */
+sd_status_t sd_coalesce_flush(sd_coalesce_t *co);
+
+#endif /* ifndef LIBSD_SD_COALESCE_H */
@@ -0,0 +1,34 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_crc.h
+ * @brief CRC7 (command frames) and CRC16-CCITT (data blocks) used by the SD protocol
+ */
+
+#ifndef LIBSD_SD_CRC_H
+#define LIBSD_SD_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief CRC7 of a buffer, polynomial x^7 + x^3 + 1 as used by command frames and registers
+ *
+ * @param buf Buffer
+ * @param n Buffer length
+ * @return 7 bit CRC, not shifted. Command frames transmit (crc << 1) | 1
+ */
+uint8_t sd_crc7(const uint8_t *buf, size_t n);
+
+/**
+ * @brief CRC16-CCITT (XMODEM) of a buffer, polynomial x^16 + x^12 + x^5 + 1 as used by data blocks
+ *
+ * @param crc CRC of the preceding data, 0 to start a new CRC
+ * @param buf Buffer
+ * @param n Buffer length
+ * @return 16 bit CRC
+ */
+uint16_t sd_crc16(uint16_t crc, const uint8_t *buf, size_t n);
+
+#endif /* ifndef LIBSD_SD_CRC_H */
@@ -13,26 +13,134 @@
 
 // ========== CMDS ==========
 #define CMD_GO_IDLE_STATE 0
+#define CMD_ALL_SEND_CID 2
+#define CMD_SEND_RELATIVE_ADDR 3
+#define CMD_SWITCH_FUNC 6
+#define CMD_SELECT_CARD 7
 #define CMD_SEND_IF_COND 8
+#define CMD_SEND_CSD 9
+#define CMD_SEND_CID 10
+#define CMD_STOP_TRANSMISSION 12
+#define CMD_SEND_STATUS 13
 #define CMD_SET_BLOCKLEN 16
+#define CMD_READ_SINGLE_BLOCK 17
+#define CMD_READ_MULTIPLE_BLOCK 18
+#define CMD_WRITE_BLOCK 24
+#define CMD_WRITE_MULTIPLE_BLOCK 25
+#define CMD_ERASE_WR_BLK_START 32
+#define CMD_ERASE_WR_BLK_END 33
+#define CMD_ERASE 38
 #define CMD_APP_CMD 55
 #define CMD_READ_OCR 58
+#define CMD_CRC_ON_OFF 59
 
 // ========== APP CMDS
+#define ACMD_SET_BUS_WIDTH 6
+#define ACMD_SD_STATUS 13
+#define ACMD_SET_WR_BLK_ERASE_COUNT 23
 #define ACMD_SD_SEND_OP_COND 41
+#define ACMD_SEND_SCR 51
 
 // ========== Masks ==========
 #define R1_IDLE_MASK 0x01
+#define R1_ERASE_RESET_MASK 0x02
+#define R1_ILLEGAL_CMD_MASK 0x04
+#define R1_COM_CRC_MASK 0x08
+#define R1_ERASE_SEQ_MASK 0x10
+#define R1_ADDRESS_MASK 0x20
+#define R1_PARAM_MASK 0x40
+
+// Bits of R1 that indicate the command was rejected
+#define R1_ERROR_MASK 0x7C
+
+// Second byte of a SPI R2 (CMD13) response
+#define R2_CARD_LOCKED_MASK 0x01
+#define R2_WP_ERASE_SKIP_MASK 0x02
+#define R2_ERROR_MASK 0x04
+#define R2_CC_ERROR_MASK 0x08
+#define R2_CARD_ECC_MASK 0x10
+#define R2_WP_VIOLATION_MASK 0x20
+#define R2_ERASE_PARAM_MASK 0x40
+#define R2_OUT_OF_RANGE_MASK 0x80
+
+// Native SD bus card status (R1 response and CMD13)
+#define CS_OUT_OF_RANGE 0x80000000u
+#define CS_ADDRESS_ERROR 0x40000000u
+#define CS_BLOCK_LEN_ERROR 0x20000000u
+#define CS_ERASE_SEQ_ERROR 0x10000000u
+#define CS_ERASE_PARAM 0x08000000u
+#define CS_WP_VIOLATION 0x04000000u
+#define CS_CARD_IS_LOCKED 0x02000000u
+#define CS_COM_CRC_ERROR 0x00800000u
+#define CS_ILLEGAL_COMMAND 0x00400000u
+#define CS_CARD_ECC_FAILED 0x00200000u
+#define CS_CC_ERROR 0x00100000u
+#define CS_ERROR 0x00080000u
+#define CS_WP_ERASE_SKIP 0x00008000u
+#define CS_ERASE_RESET 0x00002000u
+#define CS_READY_FOR_DATA 0x00000100u
+#define CS_APP_CMD 0x00000020u
+#define CS_CURRENT_STATE(X) (((X) >> 9) & 0xF)
+
+// CURRENT_STATE values
+#define CS_STATE_IDLE 0
+#define CS_STATE_READY 1
+#define CS_STATE_IDENT 2
+#define CS_STATE_STBY 3
+#define CS_STATE_TRAN 4
+#define CS_STATE_DATA 5
+#define CS_STATE_RCV 6
+#define CS_STATE_PRG 7
+
+// ========== Data Tokens ==========
+#define TOKEN_START_BLOCK 0xFE
+#define TOKEN_START_BLOCK_MULTI 0xFC
+#define TOKEN_STOP_TRAN 0xFD
+
+// Data error token, sent instead of a start block token when a read fails
+#define TOKEN_ERR_MASK 0xF0
+#define TOKEN_ERR_OUT_OF_RANGE 0x08
+
+// Data response token, sent by the card after every written block
+#define DATA_RESP_MASK 0x1F
+#define DATA_RESP_ACCEPTED 0x05
+#define DATA_RESP_CRC_ERR 0x0B
+#define DATA_RESP_WRITE_ERR 0x0D
 
 // ========== Timeouts (ms) ==========
+// Real deadlines when the host provides get_time_us, otherwise counts of 1ms sleeps
 #define TIMEOUT_SD_DEFAULT 200
 #define TIMEOUT_GO_IDLE_STATE 100
 #define TIMEOUT_SEND_IF_COND 200
 #define TIMEOUT_SET_BLOCKLEN 200
 #define TIMEOUT_APP_CMD 10
 #define TIMEOUT_READ_OCR 200
+#define TIMEOUT_READ_BLOCK 100
+#define TIMEOUT_STOP_TRANSMISSION 250
+#define TIMEOUT_WRITE_BLOCK 500
+#define TIMEOUT_SEND_CSD 100
+#define TIMEOUT_SEND_CID 100
 
 #define TIMEOUT_SD_SEND_OP_COND 20
+#define TIMEOUT_SET_WR_BLK_ERASE_COUNT 10
+#define TIMEOUT_CRC_ON_OFF 100
+#define TIMEOUT_SEND_STATUS 100
+#define TIMEOUT_ALL_SEND_CID 100
+#define TIMEOUT_SEND_RELATIVE_ADDR 100
+#define TIMEOUT_SELECT_CARD 100
+#define TIMEOUT_SET_BUS_WIDTH 100
+#define TIMEOUT_SD_STATUS 100
+#define TIMEOUT_SEND_SCR 100
+#define TIMEOUT_SWITCH_FUNC 100
+#define TIMEOUT_ERASE_WR_BLK 100
+
+// CMD13 probing whether a card kept its state, the answer is due within NCR (8 bytes) so a power
+// cycled card, which stays silent, costs little
+#define TIMEOUT_WARM_PROBE 1
+
+// Erase busy per allocation unit when the card doesn't report its erase timeout (SD Status
+// ERASE_SIZE = 0), also the shortest erase timeout used
+#define TIMEOUT_ERASE_PER_AU 250
 
 // ========== Timeouts (counts) ==========
 #define TIMEOUT_CNT_READ_OCR 10
@@ -42,8 +150,38 @@
 #define OCR_POWER_UP_STATUS(X) (X & 0x80000000)
 #define OCR_HIGH_CAPACITY(X) (X & 0x40000000)
 
+// ========== CSD Macros ==========
+#define CSD_STRUCTURE_V1 0
+#define CSD_STRUCTURE_V2 1
+#define CSD_STRUCTURE_V3 2
+
+// ========== Switch Function (CMD6) ==========
+#define SWITCH_MODE_CHECK 0
+#define SWITCH_MODE_SET 1
+#define SWITCH_NO_CHANGE 0xF
+#define SWITCH_ACCESS_DEFAULT 0
+#define SWITCH_ACCESS_HIGH_SPEED 1
+
 // CONSTANTS
 #define SD_DEFAULT_BLOCK_LEN 512
+#define SD_IDENT_CLOCK_HZ 400000
+#define SD_REG_LEN 16
+#define SD_STATUS_LEN 64
+#define SD_SCR_LEN 8
+#define SD_SWITCH_STATUS_LEN 64
+
+// Bus clock limits of the access modes
+#define SD_DEFAULT_SPEED_CLOCK_HZ 25000000
+#define SD_HIGH_SPEED_CLOCK_HZ 50000000
+
+// Native SD bus timing, in clock cycles: longest command to response delay, and the gaps
+// after a response (before the next command) and before a written data block
+#define SD_NCR_MAX 64
+#define SD_NRC 8
+#define SD_NWR 2
+
+// Allocation unit assumed for erase timeouts when the card doesn't report one, 4MiB
+#define SD_DEFAULT_AU_BLOCKS 8192
 
 /** @endcond */
 
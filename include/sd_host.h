@@ -9,6 +9,8 @@
 #ifndef LIBSD_HOST_H
 #define LIBSD_HOST_H
 
+#include "sd_stats.h"
+#include "sd_trace.h"
 #include "sd_types.h"
 
 #include <stdbool.h>
@@ -17,6 +19,28 @@
 
 struct sd_host_t;
 
+/**
+ * @brief Time (us) the bus drivers spin polling the card before yielding between polls
+ */
+#ifndef SD_POLL_SPIN_US
+#define SD_POLL_SPIN_US 200
+#endif
+
+/**
+ * @brief Time (us) yielded between polls once the spin budget is used up, if delay_us is provided.
+ * Otherwise delay_ms(1) is used
+ */
+#ifndef SD_POLL_YIELD_US
+#define SD_POLL_YIELD_US 50
+#endif
+
+/**
+ * @brief Polls spun before yielding when the host provides no time source
+ */
+#ifndef SD_POLL_SPIN_COUNT
+#define SD_POLL_SPIN_COUNT 64
+#endif
+
 /**
  * @brief Controller operations vtable/ops table. MCU/OS hooks that are Implemented per platform
  *
@@ -37,12 +61,25 @@ typedef struct sd_host_ops
     void (*delay_ms)(uint32_t);
 
     /**
-     * @brief Lock a card
+     * @brief If provided, delays by a number of microseconds. Used to yield while polling
+     */
+    void (*delay_us)(uint32_t);
+
+    /**
+     * @brief If provided, returns a monotonic time in microseconds. Timeouts become real deadlines
+     * instead of counts of 1ms sleeps
+     */
+    uint64_t (*get_time_us)(void);
+
+    /**
+     * @brief If provided, takes a lock held by the API around every command sequence, making the
+     * card safe to use from several threads. Must be recursive: the thread holding it takes it
+     * again for nested calls and from within asynchronous completion callbacks
      */
     void (*lock)(struct sd_host_t *);
 
     /**
-     * @brief Unlock a card
+     * @brief Releases the lock taken by lock
      */
     void (*unlock)(struct sd_host_t *);
 } sd_host_ops_t;
@@ -81,6 +118,66 @@ typedef struct sd_bus_vtbl_t
                           const sd_request_t *rq,
                           sd_response_t *out,
                           void *data_buf); // cmd + optional data
+
+    /**
+     * @brief OPTIONAL: Submits a request whose data phase is scattered over several buffers, in
+     * one command. Segment boundaries need not fall on block boundaries. When not provided,
+     * sd_readv and sd_writev issue a command per run of whole blocks within a segment
+     *
+     * @param rq SD card command request
+     * @param out SD card command response
+     * @param iov Data segments, rq->blocks * rq->block_size bytes in total
+     * @param iovcnt Number of segments
+     * @return Status code
+     */
+    sd_status_t (*submit_sg)(struct sd_host_t *,
+                             const sd_request_t *rq,
+                             sd_response_t *out,
+                             const sd_iovec_t *iov,
+                             uint32_t iovcnt);
+
+    /**
+     * @brief OPTIONAL: Starts a request without waiting for its data phase to complete. The
+     * request, response and data buffer must stay valid until the request completes
+     *
+     * @param rq SD card command request
+     * @param out SD card command response
+     * @param data_buf Data buf to store data contents if needed
+     * @return SD_PENDING while in progress, otherwise the final status code
+     */
+    sd_status_t (*submit_async)(struct sd_host_t *,
+                                const sd_request_t *rq,
+                                sd_response_t *out,
+                                void *data_buf);
+
+    /**
+     * @brief OPTIONAL: Advances the request started by submit_async without waiting for data
+     * tokens or busy, which includes the busy phase after a multi-block request is stopped. Only
+     * a command frame and its R1 (CMD12) may be clocked synchronously. May also be driven from a
+     * bus driver completion interrupt
+     *
+     * @return SD_PENDING while in progress, otherwise the final status code
+     */
+    sd_status_t (*poll)(struct sd_host_t *);
+
+    /**
+     * @brief OPTIONAL: Receives the next blocks of a read stream left open by an open_ended
+     * request. The stream is closed if this fails
+     *
+     * @param data_buf Buffer to store the blocks
+     * @param blocks Number of blocks
+     * @param block_size Block size
+     * @return Status code, SD_ERR_PROTO if no stream is open
+     */
+    sd_status_t (*stream_read)(struct sd_host_t *, void *data_buf, uint32_t blocks,
+                               uint32_t block_size);
+
+    /**
+     * @brief OPTIONAL: Ends a read stream left open by an open_ended request (CMD12)
+     *
+     * @return Status code
+     */
+    sd_status_t (*stream_stop)(struct sd_host_t *);
 } sd_bus_vtbl_t;
 
 /**
@@ -133,6 +230,21 @@ typedef struct sd_host_t
      * @brief Private context used by the controller. Implemented per platform
      */
     void *ctx;
+
+#if SD_STATS_ENABLE
+    /**
+     * @brief Command statistics recorded by the bus driver, read with sd_get_stats
+     */
+    sd_stats_t stats;
+#endif
+
+#if SD_TRACE_ENABLE
+    /**
+     * @brief Ring the bus driver and the block API write trace records to, NULL if none. Set
+     * with sd_trace_attach
+     */
+    sd_trace_t *trace;
+#endif
 } sd_host_t;
 
 /** @cond INTERNAL */
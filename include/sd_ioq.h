@@ -0,0 +1,219 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_ioq.h
+ * @brief Optional I/O queue, elevator scheduling and merging of queued block requests
+ */
+
+#ifndef LIBSD_SD_IOQ_H
+#define LIBSD_SD_IOQ_H
+
+#include "sd.h"
+#include "sd_types.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of a queued block
+ */
+#define SD_IOQ_BLOCK_LEN 512
+
+/**
+ * @brief Bytes of arena needed to merge up to N blocks into one transfer
+ */
+#define SD_IOQ_ARENA_LEN(n) ((n) * SD_IOQ_BLOCK_LEN)
+
+/**
+ * @brief Default number of read transfers dispatched ahead of a waiting write
+ */
+#define SD_IOQ_WRITE_STARVE_DEFAULT 4
+
+struct sd_ioq_req;
+
+/**
+ * @brief Completion callback of a queued request, invoked from the dispatching sd_ioq_poll
+ *
+ * @param req Request that completed
+ * @param status Final status of the request
+ * @param user User pointer of the request
+ */
+typedef void (*sd_ioq_cb_t)(struct sd_ioq_req *req, sd_status_t status, void *user);
+
+/**
+ * @brief Queued block request. Allocated by the caller, and owned by the queue from submission
+ * until its status leaves SD_PENDING
+ *
+ */
+typedef struct sd_ioq_req
+{
+    /**
+     * @brief Start block
+     */
+    uint32_t lba;
+
+    /**
+     * @brief Number of blocks
+     */
+    uint32_t count;
+
+    /**
+     * @brief Data buffer, must stay valid until completion
+     */
+    void *buf;
+
+    /**
+     * @brief Whether the request writes
+     */
+    bool write;
+
+    /**
+     * @brief Completion callback, may be NULL
+     */
+    sd_ioq_cb_t cb;
+
+    /**
+     * @brief User pointer passed to the callback
+     */
+    void *user;
+
+    /**
+     * @brief SD_PENDING until completion, then the final status. Stored with release ordering
+     * once the data is in place, so a plain (or acquire) load that sees it leave SD_PENDING also
+     * sees the read data
+     */
+    _Atomic sd_status_t status;
+
+    /**
+     * @brief Whether the request is part of the transfer being dispatched
+     */
+    bool in_batch;
+
+    /**
+     * @brief Next queued request, in submission order
+     */
+    struct sd_ioq_req *next;
+} sd_ioq_req_t;
+
+/**
+ * @brief I/O queue. Requests are dispatched in ascending block order (C-SCAN), merging adjacent
+ * or overlapping requests of the same direction into one CMD18/CMD25 through the arena. Reads go
+ * ahead of writes, up to a starvation limit. A request never passes an older one it overlaps,
+ * unless both read or both are merged into the same transfer. The tuning fields may be changed
+ * after sd_ioq_init
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Card behind the queue
+     */
+    sd_card_t *card;
+
+    /**
+     * @brief Merge buffer
+     */
+    uint8_t *arena;
+
+    /**
+     * @brief Capacity of the arena in blocks, the longest merged transfer
+     */
+    uint32_t arena_blocks;
+
+    /**
+     * @brief Oldest queued request
+     */
+    sd_ioq_req_t *head;
+
+    /**
+     * @brief Block following the last dispatched transfer, where the elevator continues from
+     */
+    uint32_t pos;
+
+    /**
+     * @brief Read transfers dispatched since a write was last dispatched while one was waiting
+     */
+    uint32_t write_skips;
+
+    /**
+     * @brief Whether a sd_ioq_poll call is dispatching
+     */
+    bool busy;
+
+    // ===== Tuning =====
+
+    /**
+     * @brief Read transfers dispatched ahead of a waiting write before it goes first. 0 gives
+     * writes priority instead
+     */
+    uint32_t write_starve;
+
+    // ===== Statistics =====
+
+    /**
+     * @brief Requests completed
+     */
+    uint32_t requests;
+
+    /**
+     * @brief Transfers issued to the card
+     */
+    uint32_t transfers;
+} sd_ioq_t;
+
+/**
+ * @brief Initializes an empty queue over a user supplied arena
+ *
+ * @param q Queue to initialize
+ * @param card Initialized SD card
+ * @param arena Merge buffer, SD_IOQ_ARENA_LEN(arena_blocks) bytes
+ * @param arena_blocks Capacity of the arena in blocks
+ * @return Status code
+ */
+sd_status_t sd_ioq_init(sd_ioq_t *q, sd_card_t *card, void *arena, uint32_t arena_blocks);
+
+/**
+ * @brief Queues a request and returns immediately. Safe to call from several threads when the
+ * host provides lock hooks
+ *
+ * @param q Queue
+ * @param req Request with lba, count, buf, write, cb and user filled in
+ * @return Status code, SD_OK if the request was queued
+ */
+sd_status_t sd_ioq_submit(sd_ioq_t *q, sd_ioq_req_t *req);
+
+/**
+ * @brief Dispatches the next transfer: picks the direction, the first request at or after the
+ * elevator position, and merges what it can into it. Returns right away if another thread is
+ * dispatching
+ *
+ * @param q Queue
+ * @return SD_PENDING while requests remain queued, SD_OK once the queue is empty
+ */
+sd_status_t sd_ioq_poll(sd_ioq_t *q);
+
+/**
+ * @brief Reads blocks through the queue, dispatching until the request completes
+ *
+ * @param q Queue
+ * @param lba Start block
+ * @param buf Buffer to store contents, must be correctly sized
+ * @param count Number of blocks
+ * @return Status code
+ */
+sd_status_t sd_ioq_read(sd_ioq_t *q, uint32_t lba, void *buf, uint32_t count);
+
+/**
+ * @brief Writes blocks through the queue, dispatching until the request completes
+ *
+ * @param q Queue
+ * @param lba Start block
+ * @param buf Buffer containing data to write, must be correctly sized
+ * @param count Number of blocks
+ * @return Status code
+ */
+sd_status_t sd_ioq_write(sd_ioq_t *q, uint32_t lba, const void *buf, uint32_t count);
+
+#endif /* ifndef LIBSD_SD_IOQ_H */
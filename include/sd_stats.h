@@ -0,0 +1,207 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_stats.h
+ * @brief Optional command latency and throughput statistics, kept per host by the bus drivers
+ */
+
+#ifndef LIBSD_SD_STATS_H
+#define LIBSD_SD_STATS_H
+
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sd_host_t;
+
+/**
+ * @brief Whether the bus drivers record statistics. Changes the layout of sd_host_t, so it must
+ * be the same for the library, the port and the application (the SD_STATS CMake option)
+ */
+#ifndef SD_STATS_ENABLE
+#define SD_STATS_ENABLE 0
+#endif
+
+/**
+ * @brief Number of latency histogram buckets. Bucket 0 counts times under 2us, bucket i times of
+ * 2^i to 2^(i+1) - 1 us, the last bucket everything longer
+ */
+#ifndef SD_STATS_BUCKETS
+#define SD_STATS_BUCKETS 20
+#endif
+
+/**
+ * @brief Number of command indexes, ACMDs are counted with the CMD of the same index
+ */
+#define SD_STATS_CMDS 64
+
+/**
+ * @brief Statistics of one command index. Times need the host's get_time_us, they stay 0 without
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Commands submitted
+     */
+    uint32_t count;
+
+    /**
+     * @brief Commands that failed
+     */
+    uint32_t errors;
+
+    /**
+     * @brief Time (us) from submission to completion, data and busy included, summed
+     */
+    uint64_t total_us;
+
+    /**
+     * @brief Longest time (us) from submission to completion
+     */
+    uint32_t max_us;
+
+    /**
+     * @brief Time (us) waiting for the R1 response, summed
+     */
+    uint64_t r1_us;
+
+    /**
+     * @brief Histogram of the time from submission to completion
+     */
+    uint32_t hist[SD_STATS_BUCKETS];
+} sd_cmd_stats_t;
+
+/**
+ * @brief Statistics of a host
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Per command index
+     */
+    sd_cmd_stats_t cmd[SD_STATS_CMDS];
+
+    /**
+     * @brief Data bytes read from the card
+     */
+    uint64_t bytes_read;
+
+    /**
+     * @brief Data bytes written to the card
+     */
+    uint64_t bytes_written;
+
+    /**
+     * @brief Chunks clocked in waiting for R1 responses
+     */
+    uint32_t r1_polls;
+
+    /**
+     * @brief Chunks clocked in waiting for the card to finish busy
+     */
+    uint32_t busy_polls;
+
+    /**
+     * @brief Time (us) the card was busy (programming, erasing), summed
+     */
+    uint64_t busy_us;
+
+    /**
+     * @brief Histogram of busy phase lengths
+     */
+    uint32_t busy_hist[SD_STATS_BUCKETS];
+
+    /**
+     * @brief Commands that failed with SD_ERR_TIMEOUT
+     */
+    uint32_t timeouts;
+
+    /**
+     * @brief Commands that failed with SD_ERR_CRC
+     */
+    uint32_t crc_errors;
+} sd_stats_t;
+
+// ===== Bus driver hooks, empty when statistics are disabled =====
+
+#if SD_STATS_ENABLE
+
+/**
+ * @brief Start time of a measurement
+ *
+ * @param host SD Host
+ * @return Time in microseconds, 0 without a time source
+ */
+uint64_t sd_stats_now(struct sd_host_t *host);
+
+/**
+ * @brief Records a completed command
+ *
+ * @param host SD Host
+ * @param rq Request of the command
+ * @param ret Final status
+ * @param start_us Time the command was submitted
+ */
+void sd_stats_cmd(struct sd_host_t *host,
+                  const sd_request_t *rq,
+                  sd_status_t ret,
+                  uint64_t start_us);
+
+/**
+ * @brief Records a wait for the R1 response of host->last_cmd
+ *
+ * @param host SD Host
+ * @param start_us Time the wait started
+ * @param polls Chunks clocked in
+ */
+void sd_stats_r1(struct sd_host_t *host, uint64_t start_us, uint32_t polls);
+
+/**
+ * @brief Records a busy phase
+ *
+ * @param host SD Host
+ * @param start_us Time the busy phase started
+ * @param polls Chunks clocked in
+ */
+void sd_stats_busy(struct sd_host_t *host, uint64_t start_us, uint32_t polls);
+
+#else
+
+static inline uint64_t sd_stats_now(struct sd_host_t *host)
+{
+    (void)host;
+    return 0;
+}
+
+static inline void sd_stats_cmd(struct sd_host_t *host,
+                                const sd_request_t *rq,
+                                sd_status_t ret,
+                                uint64_t start_us)
+{
+    (void)host;
+    (void)rq;
+    (void)ret;
+    (void)start_us;
+}
+
+static inline void sd_stats_r1(struct sd_host_t *host, uint64_t start_us, uint32_t polls)
+{
+    (void)host;
+    (void)start_us;
+    (void)polls;
+}
+
+static inline void sd_stats_busy(struct sd_host_t *host, uint64_t start_us, uint32_t polls)
+{
+    (void)host;
+    (void)start_us;
+    (void)polls;
+}
+
+#endif
+
+#endif /* ifndef LIBSD_SD_STATS_H */
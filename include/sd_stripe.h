@@ -0,0 +1,157 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_stripe.h
+ * @brief Optional striping (RAID-0) of several cards into one block device
+ */
+
+#ifndef LIBSD_SD_STRIPE_H
+#define LIBSD_SD_STRIPE_H
+
+#include "sd.h"
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of a striped block
+ */
+#define SD_STRIPE_BLOCK_LEN 512
+
+struct sd_stripe;
+
+/**
+ * @brief One card of a stripe set, with the request it has in flight
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Card holding every count-th stripe
+     */
+    sd_card_t *card;
+
+    /**
+     * @brief Asynchronous request of the card's current chunk
+     */
+    sd_async_t req;
+
+    /**
+     * @brief Next stripe of the transfer the card handles
+     */
+    uint32_t next;
+
+    /**
+     * @brief Stripe set the card belongs to
+     */
+    struct sd_stripe *stripe;
+} sd_stripe_member_t;
+
+/**
+ * @brief Stripe set. Block lba lives on card (lba / stripe_blocks) % count, so a transfer spanning
+ * several stripes runs on every card at once. Each card should sit on its own bus (host), as
+ * cards sharing a SPI peripheral can't have requests in flight together
+ *
+ */
+typedef struct sd_stripe
+{
+    /**
+     * @brief Cards of the set, in stripe order
+     */
+    sd_stripe_member_t *members;
+
+    /**
+     * @brief Number of cards
+     */
+    uint32_t count;
+
+    /**
+     * @brief Stripe size in blocks
+     */
+    uint32_t stripe_blocks;
+
+    /**
+     * @brief Blocks used on every card, the smallest card's capacity in whole stripes
+     */
+    uint32_t card_blocks;
+
+    /**
+     * @brief Capacity of the set in blocks
+     */
+    uint32_t blocks;
+
+    // ===== Transfer in progress =====
+
+    /**
+     * @brief Buffer of the transfer
+     */
+    uint8_t *buf;
+
+    /**
+     * @brief First block of the transfer
+     */
+    uint32_t lba;
+
+    /**
+     * @brief Block following the transfer
+     */
+    uint32_t end;
+
+    /**
+     * @brief Whether the transfer writes
+     */
+    bool write;
+
+    /**
+     * @brief Chunks queued on the cards and not yet completed
+     */
+    uint32_t pending;
+
+    /**
+     * @brief First error of the transfer, no more chunks are queued once set
+     */
+    sd_status_t status;
+} sd_stripe_t;
+
+/**
+ * @brief Initializes a stripe set over initialized cards
+ *
+ * @param stripe Stripe set to initialize
+ * @param members Card state, count entries
+ * @param cards Initialized SD cards, in stripe order
+ * @param count Number of cards
+ * @param stripe_blocks Stripe size in blocks, a multiple of the cards' AU size keeps the writes of
+ * each card AU aligned
+ * @return Status code
+ */
+sd_status_t sd_stripe_init(sd_stripe_t *stripe,
+                           sd_stripe_member_t *members,
+                           sd_card_t *const *cards,
+                           uint32_t count,
+                           uint32_t stripe_blocks);
+
+/**
+ * @brief Reads blocks, every card reads its stripes of the range concurrently
+ *
+ * @param stripe Stripe set
+ * @param lba Start block
+ * @param buf Buffer to store contents, must be correctly sized
+ * @param count Number of blocks
+ * @return Status code, the first error of any card
+ */
+sd_status_t sd_stripe_read(sd_stripe_t *stripe, uint32_t lba, void *buf, uint32_t count);
+
+/**
+ * @brief Writes blocks, every card writes its stripes of the range concurrently
+ *
+ * @param stripe Stripe set
+ * @param lba Start block
+ * @param buf Buffer containing data to write, must be correctly sized
+ * @param count Number of blocks
+ * @return Status code, the first error of any card
+ */
+sd_status_t sd_stripe_write(sd_stripe_t *stripe, uint32_t lba, const void *buf, uint32_t count);
+
+#endif /* ifndef LIBSD_SD_STRIPE_H */
@@ -0,0 +1,270 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_trace.h
+ * @brief Optional binary command trace, fixed size records in a caller supplied ring buffer
+ */
+
+#ifndef LIBSD_SD_TRACE_H
+#define LIBSD_SD_TRACE_H
+
+#include "sd_types.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct sd_host_t;
+
+/**
+ * @brief Whether the bus drivers and the block API write trace records. Changes the layout of
+ * sd_host_t, so it must be the same for the library, the port and the application (the SD_TRACE
+ * CMake option)
+ */
+#ifndef SD_TRACE_ENABLE
+#define SD_TRACE_ENABLE 0
+#endif
+
+/**
+ * @brief First word of a dump, "SDTR" in little endian
+ */
+#define SD_TRACE_MAGIC 0x52544453u
+
+/**
+ * @brief Version of the dump layout, bumped whenever sd_trace_rec_t changes
+ */
+#define SD_TRACE_VERSION 1
+
+/**
+ * @brief What a trace record describes
+ *
+ */
+typedef enum
+{
+    SD_TRACE_CMD = 0, // A command on the bus, data phase and busy included
+    SD_TRACE_STREAM,  // Blocks read from an open CMD18 stream, no command sent
+    SD_TRACE_READ,    // sd_read_blocks
+    SD_TRACE_WRITE,   // sd_write_blocks
+    SD_TRACE_ERASE,   // sd_erase_range
+    SD_TRACE_DISCARD, // sd_discard
+} sd_trace_type_t;
+
+/**
+ * @brief One trace record, 20 bytes. Block API records carry the start block in arg and no cmd
+ * or r1
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Time (us) the command or call started, low 32 bits of the host's get_time_us
+     */
+    uint32_t time_us;
+
+    /**
+     * @brief Time (us) it took
+     */
+    uint32_t dur_us;
+
+    /**
+     * @brief Command argument, or start block
+     */
+    uint32_t arg;
+
+    /**
+     * @brief Data bytes transferred, or the bytes an erase covers
+     */
+    uint32_t bytes;
+
+    /**
+     * @brief Record type, a sd_trace_type_t
+     */
+    uint8_t type;
+
+    /**
+     * @brief Command index, ACMDs are recorded with the CMD of the same index after a CMD55
+     */
+    uint8_t cmd;
+
+    /**
+     * @brief R1 response
+     */
+    uint8_t r1;
+
+    /**
+     * @brief Final status, a sd_status_t
+     */
+    uint8_t status;
+} sd_trace_rec_t;
+
+/**
+ * @brief Header of a dump written by sd_trace_dump, followed by count records oldest first. Both
+ * are in the byte order of the target
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief SD_TRACE_MAGIC
+     */
+    uint32_t magic;
+
+    /**
+     * @brief SD_TRACE_VERSION
+     */
+    uint16_t version;
+
+    /**
+     * @brief sizeof(sd_trace_rec_t)
+     */
+    uint16_t rec_size;
+
+    /**
+     * @brief Records following the header
+     */
+    uint32_t count;
+
+    /**
+     * @brief Records written before the oldest one in the dump, overwritten or left out
+     */
+    uint32_t dropped;
+} sd_trace_hdr_t;
+
+/**
+ * @brief Trace ring buffer. Holds the last size records, the oldest are overwritten. Written by
+ * one host only, under its lock, and never blocks. sd_trace_dump can read it at any time, from
+ * any thread or core
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Record storage
+     */
+    sd_trace_rec_t *recs;
+
+    /**
+     * @brief Index mask, size - 1
+     */
+    uint32_t mask;
+
+    /**
+     * @brief Records written so far, the next record goes to recs[head & mask]
+     */
+    _Atomic uint32_t head;
+} sd_trace_t;
+
+/**
+ * @brief Initializes an empty ring over caller supplied storage
+ *
+ * @param t Ring to initialize
+ * @param recs Record storage
+ * @param size Number of records, a power of two
+ * @return Status code
+ */
+sd_status_t sd_trace_init(sd_trace_t *t, sd_trace_rec_t *recs, uint32_t size);
+
+/**
+ * @brief Writes a dump of the ring: a sd_trace_hdr_t followed by the records oldest first. The
+ * newest records are kept if the buffer is too small. tools/sd_trace_decode.py turns a dump into
+ * a timeline and summary
+ *
+ * @param t Ring
+ * @param out Output buffer
+ * @param len Size of the output buffer
+ * @return Bytes written, 0 if not even the header fits
+ */
+size_t sd_trace_dump(sd_trace_t *t, void *out, size_t len);
+
+// ===== Hooks, empty when tracing is disabled =====
+
+#if SD_TRACE_ENABLE
+
+/**
+ * @brief Start time of a traced command or call
+ *
+ * @param host SD Host
+ * @return Time in microseconds, 0 without a time source or ring
+ */
+uint32_t sd_trace_now(struct sd_host_t *host);
+
+/**
+ * @brief Appends a record to the host's ring, if one is attached
+ *
+ * @param host SD Host
+ * @param type Record type
+ * @param cmd Command index
+ * @param arg Command argument, or start block
+ * @param r1 R1 response
+ * @param bytes Data bytes
+ * @param status Final status
+ * @param start_us Time the command or call started
+ */
+void sd_trace_rec(struct sd_host_t *host,
+                  sd_trace_type_t type,
+                  uint8_t cmd,
+                  uint32_t arg,
+                  uint8_t r1,
+                  uint32_t bytes,
+                  sd_status_t status,
+                  uint32_t start_us);
+
+/**
+ * @brief Appends the record of a completed command to the host's ring, if one is attached
+ *
+ * @param host SD Host
+ * @param rq Request of the command
+ * @param r1 R1 response
+ * @param status Final status
+ * @param start_us Time the command was submitted
+ */
+void sd_trace_cmd(struct sd_host_t *host,
+                  const sd_request_t *rq,
+                  uint8_t r1,
+                  sd_status_t status,
+                  uint32_t start_us);
+
+#else
+
+static inline uint32_t sd_trace_now(struct sd_host_t *host)
+{
+    (void)host;
+    return 0;
+}
+
+static inline void sd_trace_rec(struct sd_host_t *host,
+                                sd_trace_type_t type,
+                                uint8_t cmd,
+                                uint32_t arg,
+                                uint8_t r1,
+                                uint32_t bytes,
+                                sd_status_t status,
+                                uint32_t start_us)
+{
+    (void)host;
+    (void)type;
+    (void)cmd;
+    (void)arg;
+    (void)r1;
+    (void)bytes;
+    (void)status;
+    (void)start_us;
+}
+
+static inline void sd_trace_cmd(struct sd_host_t *host,
+                                const sd_request_t *rq,
+                                uint8_t r1,
+                                sd_status_t status,
+                                uint32_t start_us)
+{
+    (void)host;
+    (void)rq;
+    (void)r1;
+    (void)status;
+    (void)start_us;
+}
+
+#endif
+
+#endif /* ifndef LIBSD_SD_TRACE_H */
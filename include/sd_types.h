@@ -10,6 +10,7 @@
 #define LIBSD_SD_TYPES_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -26,7 +27,8 @@ typedef enum
     SD_ERR_UNSUPPORTED,
     SD_ERR_PARAM,
     SD_ERR_NO_CARD,
-    SD_ERR_LOCKED
+    SD_ERR_LOCKED,
+    SD_PENDING
 } sd_status_t;
 
 /**
@@ -68,6 +70,17 @@ typedef enum
     SD_RESP_R7
 } sd_resp_t;
 
+/**
+ * @brief Enum representing the direction of a command's data phase
+ *
+ */
+typedef enum
+{
+    SD_DATA_NONE,
+    SD_DATA_READ,
+    SD_DATA_WRITE
+} sd_data_dir_t;
+
 /**
  * @brief Struct for a request to send a SD card command
  *
@@ -89,6 +102,11 @@ typedef struct
      */
     sd_resp_t resp;
 
+    /**
+     * @brief Direction of the data phase, if any
+     */
+    sd_data_dir_t dir;
+
     /**
      * @brief Blocks in command
      */
@@ -109,6 +127,12 @@ typedef struct
      */
     bool auto_stop;
 
+    /**
+     * @brief Multi-block read left streaming after its blocks were received. More blocks are read
+     * with the bus's stream_read, and the stream is ended with stream_stop
+     */
+    bool open_ended;
+
     /**
      * @brief Timeout in MS to await a response
      */
@@ -127,12 +151,31 @@ typedef struct
     uint8_t r1;
 
     /**
-     * @brief Response contents, R1/R3/R6/R7 use r[0]; R2 uses r[0..3] (BE-packed)
+     * @brief Response contents, R1/R3/R6/R7 use r[0]; R2 uses r[0..3] (BE-packed), the 16 bit
+     * SPI R2 only r[0]
      */
     uint32_t r[4];
 
 } sd_response_t;
 
+/**
+ * @brief One segment of a scatter-gather transfer. Segments may have any length, blocks are
+ * allowed to straddle them
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Segment data, only read by writes
+     */
+    void *ptr;
+
+    /**
+     * @brief Segment length in bytes, may be 0
+     */
+    size_t len;
+} sd_iovec_t;
+
 /**
  * @brief Voltage ranges provided in CMD8
  *
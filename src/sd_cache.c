@@ -0,0 +1,318 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_cache.c
+ * @brief Write-back LRU block cache
+ */
+
+#include "sd_cache.h"
+
+#include "sd.h"
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// ========== Helper Functions ==========
+
+/**
+ * @brief Storage of a slot
+ *
+ * @param cache Cache
+ * @param i Slot index
+ * @return Pointer to the slot's block
+ */
+static uint8_t *slot_data(sd_cache_t *cache, uint32_t i)
+{
+    return cache->arena + (size_t)i * SD_CACHE_BLOCK_LEN;
+}
+
+/**
+ * @brief Finds the slot holding a block
+ *
+ * @param cache Cache
+ * @param lba Block
+ * @return Slot index, count if the block isn't cached
+ */
+static uint32_t slot_find(sd_cache_t *cache, uint32_t lba)
+{
+    for (uint32_t i = 0; i < cache->count; i++)
+    {
+        if (cache->slots[i].valid && cache->slots[i].lba == lba)
+            return i;
+    }
+
+    return cache->count;
+}
+
+/**
+ * @brief Marks a slot as the most recently used
+ *
+ * @param cache Cache
+ * @param i Slot index
+ */
+static void slot_touch(sd_cache_t *cache, uint32_t i)
+{
+    cache->slots[i].last_use = ++cache->tick;
+}
+
+/**
+ * @brief Writes a dirty slot back to the card
+ *
+ * @param cache Cache
+ * @param i Slot index
+ * @return Status code
+ */
+static sd_status_t slot_write_back(sd_cache_t *cache, uint32_t i)
+{
+    sd_cache_slot_t *slot = &cache->slots[i];
+
+    if (!slot->valid || !slot->dirty)
+        return SD_OK;
+
+    sd_status_t ret = sd_write_blocks(cache->card, slot->lba, slot_data(cache, i), 1);
+    if (ret)
+        return ret;
+
+    slot->dirty = false;
+    cache->writebacks++;
+    return SD_OK;
+}
+
+/**
+ * @brief Frees a slot for a new block: an empty one if any, otherwise the least recently used,
+ * written back first if dirty
+ *
+ * @param cache Cache
+ * @param out Output, freed slot index
+ * @return Status code
+ */
+static sd_status_t slot_alloc(sd_cache_t *cache, uint32_t *out)
+{
+    uint32_t victim = 0;
+
+    for (uint32_t i = 0; i < cache->count; i++)
+    {
+        if (!cache->slots[i].valid)
+        {
+            *out = i;
+            return SD_OK;
+        }
+
+        // Ages are compared relative to the tick, so the counter wrapping doesn't matter
+        if (cache->tick - cache->slots[i].last_use > cache->tick - cache->slots[victim].last_use)
+            victim = i;
+    }
+
+    sd_status_t ret = slot_write_back(cache, victim);
+    if (ret)
+        return ret;
+
+    cache->slots[victim].valid = false;
+    *out = victim;
+    return SD_OK;
+}
+
+// ========== libsd API ==========
+
+sd_status_t sd_cache_init(sd_cache_t *cache,
+                          sd_card_t *card,
+                          void *arena,
+                          sd_cache_slot_t *slots,
+                          uint32_t count)
+{
+    if (!cache || !card || !arena || !slots || !count)
+        return SD_ERR_PARAM;
+
+    // Cached blocks are 512 bytes, the card must use the same block length
+    if (card->block_len != SD_CACHE_BLOCK_LEN)
+        return SD_ERR_UNSUPPORTED;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->card = card;
+    cache->arena = arena;
+    cache->slots = slots;
+    cache->count = count;
+
+    sd_cache_invalidate(cache);
+    return SD_OK;
+}
+
+sd_status_t sd_cache_read(sd_cache_t *cache, uint32_t lba, void *buf, uint32_t count)
+{
+    if (!cache || !buf)
+        return SD_ERR_PARAM;
+
+    uint8_t *dst = buf;
+    sd_status_t ret;
+
+    // Single blocks are the metadata accesses worth keeping, they are filled into a slot
+    if (count == 1)
+    {
+        uint32_t i = slot_find(cache, lba);
+        if (i < cache->count)
+        {
+            cache->hits++;
+        }
+        else
+        {
+            cache->misses++;
+
+            ret = slot_alloc(cache, &i);
+            if (ret)
+                return ret;
+
+            ret = sd_read_blocks(cache->card, lba, slot_data(cache, i), 1);
+            if (ret)
+                return ret;
+
+            cache->slots[i].lba = lba;
+            cache->slots[i].valid = true;
+            cache->slots[i].dirty = false;
+        }
+
+        slot_touch(cache, i);
+        memcpy(dst, slot_data(cache, i), SD_CACHE_BLOCK_LEN);
+        return SD_OK;
+    }
+
+    // Multi-block reads bypass the cache, runs of uncached blocks are read in one command. Cached
+    // blocks are served from their slot, as they may be newer than the card
+    uint32_t run = 0;
+    for (uint32_t b = 0; b <= count; b++)
+    {
+        uint32_t i = (b < count) ? slot_find(cache, lba + b) : cache->count;
+
+        // Ends the current run of uncached blocks at a cached block or at the end
+        if (b == count || i < cache->count)
+        {
+            if (b > run)
+            {
+                cache->misses += b - run;
+                ret = sd_read_blocks(cache->card, lba + run, dst + (size_t)run * SD_CACHE_BLOCK_LEN,
+                                     b - run);
+                if (ret)
+                    return ret;
+            }
+            run = b + 1;
+        }
+
+        if (b < count && i < cache->count)
+        {
+            cache->hits++;
+            slot_touch(cache, i);
+            memcpy(dst + (size_t)b * SD_CACHE_BLOCK_LEN, slot_data(cache, i), SD_CACHE_BLOCK_LEN);
+        }
+    }
+
+    return SD_OK;
+}
+
+sd_status_t sd_cache_write(sd_cache_t *cache, uint32_t lba, const void *buf, uint32_t count)
+{
+    if (!cache || !buf)
+        return SD_ERR_PARAM;
+
+    const uint8_t *src = buf;
+    sd_status_t ret;
+
+    // Single blocks are written back later, repeated updates to a FAT sector cost one write
+    if (count == 1)
+    {
+        uint32_t i = slot_find(cache, lba);
+        if (i < cache->count)
+        {
+            cache->hits++;
+        }
+        else
+        {
+            cache->misses++;
+
+            ret = slot_alloc(cache, &i);
+            if (ret)
+                return ret;
+
+            cache->slots[i].lba = lba;
+            cache->slots[i].valid = true;
+        }
+
+        memcpy(slot_data(cache, i), src, SD_CACHE_BLOCK_LEN);
+        cache->slots[i].dirty = true;
+        slot_touch(cache, i);
+        return SD_OK;
+    }
+
+    // Multi-block writes go straight to the card in one command
+    ret = sd_write_blocks(cache->card, lba, src, count);
+    if (ret)
+        return ret;
+
+    // Cached copies of the written blocks now match the card
+    for (uint32_t i = 0; i < cache->count; i++)
+    {
+        sd_cache_slot_t *slot = &cache->slots[i];
+
+        if (slot->valid && slot->lba >= lba && slot->lba - lba < count)
+        {
+            memcpy(slot_data(cache, i), src + (size_t)(slot->lba - lba) * SD_CACHE_BLOCK_LEN,
+                   SD_CACHE_BLOCK_LEN);
+            slot->dirty = false;
+        }
+    }
+
+    return SD_OK;
+}
+
+sd_status_t sd_cache_flush(sd_cache_t *cache)
+{
+    if (!cache)
+        return SD_ERR_PARAM;
+
+    sd_status_t ret = SD_OK;
+    uint32_t next = 0;
+
+    // Writes back in ascending block order, the card handles sequential writes best
+    for (;;)
+    {
+        uint32_t lowest = cache->count;
+
+        for (uint32_t i = 0; i < cache->count; i++)
+        {
+            sd_cache_slot_t *slot = &cache->slots[i];
+
+            if (!slot->valid || !slot->dirty || slot->lba < next)
+                continue;
+            if (lowest == cache->count || slot->lba < cache->slots[lowest].lba)
+                lowest = i;
+        }
+
+        if (lowest == cache->count)
+            break;
+
+        // Keeps going past failed blocks, they stay dirty and the first error is reported
+        sd_status_t err = slot_write_back(cache, lowest);
+        if (err && !ret)
+            ret = err;
+
+        if (cache->slots[lowest].lba == UINT32_MAX)
+            break;
+        next = cache->slots[lowest].lba + 1;
+    }
+
+    return ret;
+}
+
+void sd_cache_invalidate(sd_cache_t *cache)
+{
+    if (!cache)
+        return;
+
+    for (uint32_t i = 0; i < cache->count; i++)
+    {
+        cache->slots[i].valid = false;
+        cache->slots[i].dirty = false;
+        cache->slots[i].last_use = 0;
+    }
+}
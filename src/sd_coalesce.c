@@ -0,0 +1,260 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_coalesce.c
+ * @brief Write coalescing into CMD25 bursts
+ */
+
+#include "sd_coalesce.h"
+
+#include "sd.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// ========== Helper Functions ==========
+
+/**
+ * @brief Time from the host's time source
+ *
+ * @param co Coalescing state
+ * @param now Output, time in microseconds
+ * @return Whether the host has a time source
+ */
+static bool time_now(sd_coalesce_t *co, uint64_t *now)
+{
+    const sd_host_ops_t *ops = co->card->host->ops;
+
+    if (!ops || !ops->get_time_us)
+        return false;
+
+    *now = ops->get_time_us();
+    return true;
+}
+
+/**
+ * @brief Whether the oldest buffered block was held longer than the deadline
+ *
+ * @param co Coalescing state
+ * @return Whether the buffered blocks are due
+ */
+static bool deadline_passed(sd_coalesce_t *co)
+{
+    uint64_t now;
+
+    if (!co->count || !co->deadline_ms || !time_now(co, &now))
+        return false;
+
+    return now - co->since_us >= (uint64_t)co->deadline_ms * 1000;
+}
+
+/**
+ * @brief Buffered blocks that trigger a burst
+ *
+ * @param co Coalescing state
+ * @return Threshold in blocks, between 1 and the arena capacity
+ */
+static uint32_t burst_len(sd_coalesce_t *co)
+{
+    if (!co->threshold || co->threshold > co->arena_blocks)
+        return co->arena_blocks;
+
+    return co->threshold;
+}
+
+/**
+ * @brief Blocks from a block to the next allocation unit boundary
+ *
+ * @param co Coalescing state
+ * @param lba Block number
+ * @return Number of blocks, UINT32_MAX without an AU size
+ */
+static uint32_t to_au_boundary(sd_coalesce_t *co, uint32_t lba)
+{
+    if (!co->au_blocks)
+        return UINT32_MAX;
+
+    return co->au_blocks - lba % co->au_blocks;
+}
+
+/**
+ * @brief Blocks that may still be appended to the buffered run before it has to be written
+ *
+ * @param co Coalescing state
+ * @return Number of blocks, 0 also when the threshold was lowered below the buffered run
+ */
+static uint32_t room(sd_coalesce_t *co)
+{
+    uint32_t len = burst_len(co);
+    uint32_t n = co->count >= len ? 0 : len - co->count;
+
+    // A burst never crosses into the next allocation unit, measured from its first block so a
+    // run ending right at the boundary has no room left
+    uint32_t to_boundary = to_au_boundary(co, co->start);
+    to_boundary = co->count >= to_boundary ? 0 : to_boundary - co->count;
+    if (to_boundary < n)
+        n = to_boundary;
+
+    return n;
+}
+
+// ========== libsd API ==========
+
+sd_status_t sd_coalesce_init(sd_coalesce_t *co,
+                             sd_card_t *card,
+                             void *arena,
+                             uint32_t arena_blocks)
+{
+    if (!co || !card || !card->host || !arena || !arena_blocks)
+        return SD_ERR_PARAM;
+
+    // Buffered blocks are 512 bytes, the card must use the same block length
+    if (card->block_len != SD_COALESCE_BLOCK_LEN)
+        return SD_ERR_UNSUPPORTED;
+
+    memset(co, 0, sizeof(*co));
+    co->card = card;
+    co->arena = arena;
+    co->arena_blocks = arena_blocks;
+    co->threshold = arena_blocks;
+    co->au_blocks = card->au_blocks;
+
+    return SD_OK;
+}
+
+sd_status_t sd_coalesce_write(sd_coalesce_t *co, uint32_t lba, const void *buf, uint32_t count)
+{
+    if (!co || !buf)
+        return SD_ERR_PARAM;
+
+    const uint8_t *src = buf;
+    sd_status_t ret;
+
+    // Rewrites of buffered blocks are updated in place
+    if (co->count && lba >= co->start && lba - co->start < co->count &&
+        count <= co->count - (lba - co->start))
+    {
+        memcpy(co->arena + (size_t)(lba - co->start) * SD_COALESCE_BLOCK_LEN, src,
+               (size_t)count * SD_COALESCE_BLOCK_LEN);
+        co->blocks += count;
+
+        return deadline_passed(co) ? sd_coalesce_flush(co) : SD_OK;
+    }
+
+    // Anything that doesn't continue the buffered run writes it out first
+    if (co->count && lba != co->start + co->count)
+    {
+        ret = sd_coalesce_flush(co);
+        if (ret)
+            return ret;
+    }
+
+    while (count)
+    {
+        if (!co->count)
+        {
+            // Writes at least a burst long gain nothing from the arena, they are only split at
+            // AU boundaries
+            if (count >= burst_len(co))
+            {
+                uint32_t n = to_au_boundary(co, lba);
+                if (n > count)
+                    n = count;
+
+                ret = sd_write_blocks(co->card, lba, src, n);
+                if (ret)
+                    return ret;
+
+                co->blocks += n;
+                co->bursts++;
+
+                lba += n;
+                src += (size_t)n * SD_COALESCE_BLOCK_LEN;
+                count -= n;
+                continue;
+            }
+
+            co->start = lba;
+            if (!time_now(co, &co->since_us))
+                co->since_us = 0;
+        }
+
+        // The threshold may have been lowered below the buffered run, which is written out first
+        uint32_t n = room(co);
+        if (!n)
+        {
+            ret = sd_coalesce_flush(co);
+            if (ret)
+                return ret;
+            continue;
+        }
+
+        if (n > count)
+            n = count;
+
+        memcpy(co->arena + (size_t)co->count * SD_COALESCE_BLOCK_LEN, src,
+               (size_t)n * SD_COALESCE_BLOCK_LEN);
+        co->count += n;
+        co->blocks += n;
+
+        lba += n;
+        src += (size_t)n * SD_COALESCE_BLOCK_LEN;
+        count -= n;
+
+        // Threshold or AU boundary reached
+        if (!room(co))
+        {
+            ret = sd_coalesce_flush(co);
+            if (ret)
+                return ret;
+        }
+    }
+
+    return deadline_passed(co) ? sd_coalesce_flush(co) : SD_OK;
+}
+
+sd_status_t sd_coalesce_read(sd_coalesce_t *co, uint32_t lba, void *buf, uint32_t count)
+{
+    if (!co)
+        return SD_ERR_PARAM;
+
+    // The card only has the buffered blocks once they were written out
+    if (co->count && lba < co->start + co->count && co->start < lba + count)
+    {
+        sd_status_t ret = sd_coalesce_flush(co);
+        if (ret)
+            return ret;
+    }
+
+    return sd_read_blocks(co->card, lba, buf, count);
+}
+
+sd_status_t sd_coalesce_poll(sd_coalesce_t *co)
+{
+    if (!co)
+        return SD_ERR_PARAM;
+
+    return deadline_passed(co) ? sd_coalesce_flush(co) : SD_OK;
+}
+
+sd_status_t sd_coalesce_flush(sd_coalesce_t *co)
+{
+    if (!co)
+        return SD_ERR_PARAM;
+
+    if (!co->count)
+        return SD_OK;
+
+    // One CMD25, sd_write_blocks announces the length with ACMD23 so the card can pre-erase
+    sd_status_t ret = sd_write_blocks(co->card, co->start, co->arena, co->count);
+    if (ret)
+        return ret;
+
+    co->bursts++;
+    co->count = 0;
+    return SD_OK;
+}
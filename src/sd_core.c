@@ -36,7 +36,364 @@ bool r1_is_error(sd_response_t *r)
  */
 bool r1_in_idle(sd_response_t *r)
 {
-    return r->r[0] & R1_IDLE_MASK;
+    return r->r1 & R1_IDLE_MASK;
+}
+
+/**
+ * @brief Maps a rejected R1 response to a status code
+ *
+ * @param r SD card command response
+ * @return SD_OK if the command was accepted, otherwise the closest status code
+ */
+static sd_status_t r1_to_status(sd_response_t *r)
+{
+    if (!(r->r1 & R1_ERROR_MASK))
+        return SD_OK;
+
+    if (r->r1 & (R1_ADDRESS_MASK | R1_PARAM_MASK))
+        return SD_ERR_PARAM;
+
+    if (r->r1 & R1_COM_CRC_MASK)
+        return SD_ERR_CRC;
+
+    return SD_ERR_IO;
+}
+
+/**
+ * @brief Maps a card status (SD bus) to the second byte of a SPI R2
+ *
+ * @param cs Card status
+ * @return R2_*_MASK bits
+ */
+static uint8_t cs_to_r2(uint32_t cs)
+{
+    uint8_t r2 = 0;
+
+    if (cs & CS_CARD_IS_LOCKED)
+        r2 |= R2_CARD_LOCKED_MASK;
+    if (cs & CS_WP_ERASE_SKIP)
+        r2 |= R2_WP_ERASE_SKIP_MASK;
+    if (cs & CS_ERROR)
+        r2 |= R2_ERROR_MASK;
+    if (cs & CS_CC_ERROR)
+        r2 |= R2_CC_ERROR_MASK;
+    if (cs & CS_CARD_ECC_FAILED)
+        r2 |= R2_CARD_ECC_MASK;
+    if (cs & CS_WP_VIOLATION)
+        r2 |= R2_WP_VIOLATION_MASK;
+    if (cs & CS_ERASE_PARAM)
+        r2 |= R2_ERASE_PARAM_MASK;
+    if (cs & CS_OUT_OF_RANGE)
+        r2 |= R2_OUT_OF_RANGE_MASK;
+
+    return r2;
+}
+
+/**
+ * @brief Unpacks a R2 response (CID/CSD on the SD bus) into register bytes, as received in SPI mode
+ *
+ * @param rs R2 response, r[3] holding the most significant word
+ * @param reg Output, 16 byte register
+ */
+static void r2_to_reg(const sd_response_t *rs, uint8_t reg[16])
+{
+    for (unsigned i = 0; i < 16; i++)
+        reg[i] = (rs->r[3 - i / 4] >> (24 - 8 * (i % 4))) & 0xFF;
+}
+
+/**
+ * @brief Extracts a bit field from a big endian register (CSD, CID, SCR, ...)
+ *
+ * @param reg Register contents, as received from the card
+ * @param len Register length in bytes
+ * @param msb Most significant bit of the field, as numbered in the SD specification
+ * @param lsb Least significant bit of the field
+ * @return Field value
+ */
+static uint32_t reg_bits(const uint8_t *reg, size_t len, unsigned msb, unsigned lsb)
+{
+    uint32_t v = 0;
+
+    for (unsigned bit = msb + 1; bit-- > lsb;)
+        v = (v << 1) | ((reg[len - 1 - bit / 8] >> (bit % 8)) & 1);
+
+    return v;
+}
+
+/**
+ * @brief Decodes the maximum transfer clock from the CSD TRAN_SPEED field
+ *
+ * @param csd CSD register
+ * @return Maximum clock in hz, 0 if the field is invalid
+ */
+static uint32_t csd_tran_speed_hz(const uint8_t *csd)
+{
+    // Time values (x10) indexed by bits 6:3, and rate units (/10) indexed by bits 2:0
+    static const uint8_t time_value[16] = {
+        0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80};
+    static const uint32_t rate_unit[4] = {10000, 100000, 1000000, 10000000};
+
+    uint32_t tran_speed = reg_bits(csd, SD_REG_LEN, 103, 96);
+    if ((tran_speed & 0x7) > 3)
+        return 0;
+
+    return time_value[(tran_speed >> 3) & 0xF] * rate_unit[tran_speed & 0x7];
+}
+
+/**
+ * @brief Decodes the user area capacity from the CSD
+ *
+ * @param csd CSD register
+ * @return Capacity in bytes, 0 if the CSD structure is unknown
+ */
+static uint64_t csd_capacity(const uint8_t *csd)
+{
+    switch (reg_bits(csd, SD_REG_LEN, 127, 126))
+    {
+    case CSD_STRUCTURE_V1:
+    {
+        // SDSC: (C_SIZE + 1) * 2^(C_SIZE_MULT + 2) blocks of 2^READ_BL_LEN bytes
+        uint32_t c_size = reg_bits(csd, SD_REG_LEN, 73, 62);
+        uint32_t c_size_mult = reg_bits(csd, SD_REG_LEN, 49, 47);
+        uint32_t read_bl_len = reg_bits(csd, SD_REG_LEN, 83, 80);
+        return (uint64_t)(c_size + 1) << (c_size_mult + 2 + read_bl_len);
+    }
+    case CSD_STRUCTURE_V2:
+        // SDHC/SDXC: (C_SIZE + 1) * 512KiB
+        return (uint64_t)(reg_bits(csd, SD_REG_LEN, 69, 48) + 1) * 512 * 1024;
+    case CSD_STRUCTURE_V3:
+        // SDUC: 28 bit C_SIZE
+        return (uint64_t)(reg_bits(csd, SD_REG_LEN, 75, 48) + 1) * 512 * 1024;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Sets the bus clock, limited to what the controller supports
+ *
+ * @param card SD Card
+ * @param hz Requested clock
+ * @return Status code
+ */
+static sd_status_t set_card_clock(sd_card_t *card, uint32_t hz)
+{
+    sd_host_t *host = card->host;
+
+    if (host->max_clock_hz && hz > host->max_clock_hz)
+        hz = host->max_clock_hz;
+
+    if (host->bus->set_clock)
+    {
+        sd_status_t ret = host->bus->set_clock(host, hz);
+        if (ret)
+            return ret;
+    }
+
+    card->clock_hz = hz;
+    return SD_OK;
+}
+
+/**
+ * @brief Converts a block number to a data command address argument
+ *
+ * @param card SD Card
+ * @param lba Block number
+ * @return Block number for SDHC/SDXC cards, byte address for SDSC cards
+ */
+static uint32_t block_to_arg(sd_card_t *card, uint32_t lba)
+{
+    return card->high_capacity ? lba : lba * SD_DEFAULT_BLOCK_LEN;
+}
+
+/**
+ * @brief Bytes a block API call covers, for its trace record
+ *
+ * @param blocks Number of blocks
+ * @return Bytes, saturated to 32 bits for large erases
+ */
+static uint32_t trace_bytes(uint64_t blocks)
+{
+    if (blocks > UINT32_MAX / SD_DEFAULT_BLOCK_LEN)
+        return UINT32_MAX;
+
+    return (uint32_t)blocks * SD_DEFAULT_BLOCK_LEN;
+}
+
+/**
+ * @brief Validates the arguments of a block I/O call
+ *
+ * @param card SD Card
+ * @param lba Start block
+ * @param buf Data buffer
+ * @param count Number of blocks
+ * @return Status code
+ */
+static sd_status_t check_block_io(sd_card_t *card, uint32_t lba, const void *buf, uint32_t count)
+{
+    if (!card || !card->host || !buf)
+        return SD_ERR_PARAM;
+
+    // Only checked once the capacity is known
+    uint64_t blocks = card->capacity_bytes / SD_DEFAULT_BLOCK_LEN;
+    if (blocks && ((uint64_t)lba + count) > blocks)
+        return SD_ERR_PARAM;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Validates the segments of a scatter-gather call and counts the blocks they cover
+ *
+ * @param iov Segments
+ * @param iovcnt Number of segments
+ * @param count Output, number of blocks
+ * @return Status code, SD_ERR_PARAM unless the segments add up to whole blocks
+ */
+static sd_status_t iov_blocks(const sd_iovec_t *iov, uint32_t iovcnt, uint32_t *count)
+{
+    const uint64_t max = (uint64_t)UINT32_MAX * SD_DEFAULT_BLOCK_LEN;
+    uint64_t total = 0;
+
+    if (!iov)
+        return SD_ERR_PARAM;
+
+    for (uint32_t i = 0; i < iovcnt; i++)
+    {
+        if ((!iov[i].ptr && iov[i].len) || iov[i].len > max - total)
+            return SD_ERR_PARAM;
+        total += iov[i].len;
+    }
+
+    if (total % SD_DEFAULT_BLOCK_LEN)
+        return SD_ERR_PARAM;
+
+    *count = (uint32_t)(total / SD_DEFAULT_BLOCK_LEN);
+    return SD_OK;
+}
+
+/**
+ * @brief Copies one block between a bounce buffer and the segments it straddles
+ *
+ * @param iov Segments
+ * @param i Current segment, advanced past the block
+ * @param off Offset in the current segment, advanced past the block
+ * @param bounce Bounce buffer, one block
+ * @param gather Whether to copy from the segments into the bounce buffer
+ */
+static void iov_bounce(const sd_iovec_t *iov,
+                       uint32_t *i,
+                       size_t *off,
+                       uint8_t *bounce,
+                       bool gather)
+{
+    for (size_t done = 0; done < SD_DEFAULT_BLOCK_LEN;)
+    {
+        size_t len = iov[*i].len - *off;
+        if (!len)
+        {
+            (*i)++;
+            *off = 0;
+            continue;
+        }
+
+        if (len > SD_DEFAULT_BLOCK_LEN - done)
+            len = SD_DEFAULT_BLOCK_LEN - done;
+
+        uint8_t *p = (uint8_t *)iov[*i].ptr + *off;
+        if (gather)
+            memcpy(bounce + done, p, len);
+        else
+            memcpy(p, bounce + done, len);
+
+        done += len;
+        *off += len;
+    }
+}
+
+/**
+ * @brief Decodes an AU_SIZE or UHS_AU_SIZE code of the SD Status
+ *
+ * @param code Field value
+ * @return Allocation unit size in blocks, 0 if not defined
+ */
+static uint32_t au_size_blocks(uint32_t code)
+{
+    // Codes 1-15 in KiB, 0 means not defined
+    static const uint32_t au_kib[16] = {0,    16,   32,   64,    128,   256,   512,   1024,
+                                        2048, 4096, 8192, 12288, 16384, 24576, 32768, 65536};
+
+    return au_kib[code & 0xF] * 2;
+}
+
+/**
+ * @brief Decodes the physical layer specification version of the SCR
+ *
+ * @param scr SD Configuration Register
+ * @return Version, e.g. 0x300 for 3.0x, 0 if unknown
+ */
+static uint16_t scr_spec_version(const uint8_t *scr)
+{
+    uint32_t spec = reg_bits(scr, SD_SCR_LEN, 59, 56);
+    uint32_t spec3 = reg_bits(scr, SD_SCR_LEN, 47, 47);
+    uint32_t spec4 = reg_bits(scr, SD_SCR_LEN, 42, 42);
+    uint32_t specx = reg_bits(scr, SD_SCR_LEN, 41, 38);
+
+    if (spec == 0)
+        return 0x100;
+    if (spec == 1)
+        return 0x110;
+    if (spec != 2)
+        return 0;
+
+    // SD_SPECX 1-5 stand for versions 5.xx to 9.xx, each implying the ones before
+    if (spec3 && specx >= 1 && specx <= 5)
+        return (uint16_t)((4 + specx) << 8);
+    if (spec3 && spec4)
+        return 0x400;
+    if (spec3)
+        return 0x300;
+
+    return 0x200;
+}
+
+/**
+ * @brief Parses the allocation unit and erase fields of the SD Status
+ *
+ * @param card SD Card, ssr holds the SD Status
+ */
+static void ssr_parse(sd_card_t *card)
+{
+    card->au_blocks = au_size_blocks(reg_bits(card->ssr, SD_STATUS_LEN, 431, 428));
+    card->erase_size = reg_bits(card->ssr, SD_STATUS_LEN, 423, 408);
+    card->erase_timeout_s = reg_bits(card->ssr, SD_STATUS_LEN, 407, 402);
+    card->erase_offset_s = reg_bits(card->ssr, SD_STATUS_LEN, 401, 400);
+}
+
+/**
+ * @brief Longest time a CMD38 (ERASE) of a range may keep the card busy
+ *
+ * @param card SD Card
+ * @param lba_start First block erased
+ * @param lba_end Last block erased
+ * @return Timeout in ms
+ */
+static uint32_t erase_timeout_ms(sd_card_t *card, uint32_t lba_start, uint32_t lba_end)
+{
+    uint32_t au = card->au_blocks ? card->au_blocks : SD_DEFAULT_AU_BLOCKS;
+    uint64_t aus = lba_end / au - lba_start / au + 1;
+    uint64_t ms;
+
+    // SD Status: ERASE_TIMEOUT covers ERASE_SIZE AUs, ERASE_OFFSET is added once per erase
+    if (card->erase_size && card->erase_timeout_s)
+        ms = aus * card->erase_timeout_s * 1000 / card->erase_size + card->erase_offset_s * 1000;
+    else
+        ms = aus * TIMEOUT_ERASE_PER_AU;
+
+    if (ms < TIMEOUT_ERASE_PER_AU)
+        ms = TIMEOUT_ERASE_PER_AU;
+
+    return ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
 }
 
 // ========== SD Commands ==========
@@ -53,10 +410,10 @@ sd_status_t sd_go_idle_state(sd_host_t *host)
     sd_request_t rq;
     sd_response_t rs;
 
-    // Populates request for CMD0 (GO_IDLE_STATE)
+    // Populates request for CMD0 (GO_IDLE_STATE). The card only answers in SPI mode
     rq = (sd_request_t){.cmd = CMD_GO_IDLE_STATE,
                         .arg = 0,
-                        .resp = SD_RESP_R1,
+                        .resp = host->bus_kind == SD_BUS_SPI ? SD_RESP_R1 : SD_RESP_NONE,
                         .timeout_ms = TIMEOUT_GO_IDLE_STATE};
 
     // Submits the command
@@ -66,6 +423,9 @@ sd_status_t sd_go_idle_state(sd_host_t *host)
     if (ret)
         return ret;
 
+    if (host->bus_kind != SD_BUS_SPI)
+        return SD_OK;
+
     // Checks whether error bit is set, and whether the card went into idle
     if (r1_is_error(&rs) || !r1_in_idle(&rs))
         return SD_ERR_IO;
@@ -179,11 +539,12 @@ sd_status_t sd_send_op_cond(sd_host_t *host, sd_card_t *card, sd_response_t *rs)
     if (r1_is_error(rs))
         return SD_ERR_IO;
 
-    // Populates request for ACMD41 (SD_SEND_OP_COND)
+    // Populates request for ACMD41 (SD_SEND_OP_COND). On the SD bus the response is the OCR (R3),
+    // in SPI mode a R1
     uint32_t arg = 0x00300000u | (card->v2 ? 0x40000000 : 0);
     rq = (sd_request_t){.cmd = ACMD_SD_SEND_OP_COND,
                         .arg = arg,
-                        .resp = SD_RESP_R1,
+                        .resp = host->bus_kind == SD_BUS_SPI ? SD_RESP_R1 : SD_RESP_R3,
                         .timeout_ms = TIMEOUT_SD_SEND_OP_COND};
 
     // Submits the command
@@ -235,98 +596,2107 @@ sd_status_t sd_set_block_len(sd_host_t *host, sd_card_t *card, uint32_t block_le
     return SD_OK;
 }
 
-// ========== libsd API ==========
-
-sd_status_t sd_init(sd_host_t *host, sd_card_t *card)
+/**
+ * @brief Send a ACMD23 (SET_WR_BLK_ERASE_COUNT), pre-erase hint for the next multi-block write
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card
+ * @param count Number of blocks about to be written
+ * @return Status code
+ */
+sd_status_t sd_set_wr_blk_erase_count(sd_host_t *host, sd_card_t *card, uint32_t count)
 {
     sd_status_t ret;
+    sd_request_t rq;
     sd_response_t rs;
 
-    // Sanity check pointers
-    if (!host || !card)
-        return SD_ERR_PARAM;
-
-    // Sanit checks that the vtabls for the controllers ops and bus ops are provided
-    if (!host->ops || !host->bus)
-        return SD_ERR_PARAM;
-
-    // Zeroes out the card
-    memset(card, 0, sizeof(*card));
-    card->host = host;
-
-    // Enable SD card power if provided
-    if (host->ops && host->ops->set_power)
-        host->ops->set_power(host, true);
-
-    // TODO: Await card detect?
-
-    // Small delay to let card stabilize
-    host->ops->delay_ms(1);
-
-    // Sets the clock to 400Khz for card initialization
-    if (host->bus->set_clock)
-        host->bus->set_clock(host, 400000);
+    // Populates request for CMD55 (APP_CMD)
+    rq = (sd_request_t){.cmd = CMD_APP_CMD,
+                        .arg = card->rca << 16,
+                        .resp = SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_APP_CMD};
 
-    // CMD0: GO_IDLE_STATE
-    ret = sd_go_idle_state(host);
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
     if (ret)
         return ret;
 
-    // CMD8: SEND_IF_COND
-    // For first gen cards, the SEND_IF_COND is a illegal command
-    // Thus we only care about status code that indicate I/O error
-    ret = sd_send_if_cond(host, SD_CMD8_VOLTAGE_2_7__3_6, &rs);
-    if (ret == SD_ERR_IO) // check pattern err
+    ret = r1_to_status(&rs);
+    if (ret)
         return ret;
 
-    // Check if first or second gen card
-    card->v2 = (ret == SD_OK);
+    // Populates request for ACMD23 (SET_WR_BLK_ERASE_COUNT), the count is 23 bits wide
+    rq = (sd_request_t){.cmd = ACMD_SET_WR_BLK_ERASE_COUNT,
+                        .arg = count & 0x7FFFFF,
+                        .resp = SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_SET_WR_BLK_ERASE_COUNT};
 
-    // TODO: Handle gen 1 cards, for now we ignore them :( as i dont have any to test with
-    if (!card->v2)
-        return SD_ERR_UNSUPPORTED;
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+    if (ret)
+        return ret;
 
-    // TODO: Check non compatible voltages?
+    return r1_to_status(&rs);
+}
 
-    // ACMD41: SD_SEND_OP_COND
-    // Continuously send ACMD41 till R1 yiels 0x00
-    for (int i = 0; i < TIMEOUT_CNT_SD_SEND_OP_COND; i++)
-    {
-        // ACMD41 starts the sd card initialization process
-        sd_send_op_cond(host, card, &rs);
+/**
+ * @brief Turns CRC checking of commands and data on or off. SPI mode only, the native SD bus
+ * always checks CRCs
+ *
+ * @param host SD Card Host Controller
+ * @param enable Whether to check CRCs
+ * @return Status code
+ */
+sd_status_t sd_crc_on_off(sd_host_t *host, bool enable)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
 
-        // Wait till we are no longer in idle
-        if (!r1_in_idle(&rs))
-            break;
-    }
+    // Populates request for CMD59 (CRC_ON_OFF)
+    rq = (sd_request_t){.cmd = CMD_CRC_ON_OFF,
+                        .arg = enable ? 1 : 0,
+                        .resp = SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_CRC_ON_OFF};
 
-    if (r1_in_idle(&rs))
-        return SD_ERR_TIMEOUT;
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
 
-    // CMD58: READ_OCR
-    // Checks Waits till power ready, all statuses like CCS are set once power is ready
-    for (int i = 0; i < TIMEOUT_CNT_READ_OCR; i++)
-    {
-        ret = sd_read_ocr(host, card);
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
 
-        if (ret)
-            return ret;
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
 
-        if (OCR_POWER_UP_STATUS(card->ocr))
-            break;
+/**
+ * @brief Send a CMD9 (SEND_CSD), in SPI mode the register is sent as a data block, on the SD bus
+ * as a R2 response
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card struct to populate
+ * @return Status code
+ */
+sd_status_t sd_send_csd(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD9 (SEND_CSD)
+    rq = (sd_request_t){.cmd = CMD_SEND_CSD,
+                        .arg = card->rca << 16,
+                        .resp = SD_RESP_R1,
+                        .dir = SD_DATA_READ,
+                        .blocks = 1,
+                        .block_size = SD_REG_LEN,
+                        .timeout_ms = TIMEOUT_SEND_CSD};
 
-        // TODO: Check non compatible voltages?
+    // The SD bus returns the register as a R2 response instead
+    if (host->bus_kind == SD_BUS_SDMMC)
+    {
+        rq = (sd_request_t){.cmd = CMD_SEND_CSD,
+                            .arg = card->rca << 16,
+                            .resp = SD_RESP_R2,
+                            .timeout_ms = TIMEOUT_SEND_CSD};
     }
 
-    if (!OCR_POWER_UP_STATUS(card->ocr))
-        return SD_ERR_TIMEOUT;
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, rq.blocks ? card->csd : NULL);
 
-    // CMD16: Set block len
-    ret = sd_set_block_len(host, card, SD_DEFAULT_BLOCK_LEN);
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    ret = r1_to_status(&rs);
     if (ret)
         return ret;
 
-    // TODO: Move to faster clock
+    if (rq.resp == SD_RESP_R2)
+        r2_to_reg(&rs, card->csd);
+
+    // Populates capacity and maximum clock
+    card->capacity_bytes = csd_capacity(card->csd);
+    card->max_clock_hz = csd_tran_speed_hz(card->csd);
 
     return SD_OK;
 }
+
+/**
+ * @brief Send a CMD10 (SEND_CID), in SPI mode the register is sent as a data block
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card struct to populate
+ * @return Status code
+ */
+sd_status_t sd_send_cid(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD10 (SEND_CID)
+    rq = (sd_request_t){.cmd = CMD_SEND_CID,
+                        .arg = card->rca << 16,
+                        .resp = SD_RESP_R1,
+                        .dir = SD_DATA_READ,
+                        .blocks = 1,
+                        .block_size = SD_REG_LEN,
+                        .timeout_ms = TIMEOUT_SEND_CID};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, card->cid);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
+
+/**
+ * @brief Send a CMD2 (ALL_SEND_CID), SD bus only. Moves the card to the identification state
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card struct to populate
+ * @return Status code
+ */
+sd_status_t sd_all_send_cid(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD2 (ALL_SEND_CID)
+    rq = (sd_request_t){
+        .cmd = CMD_ALL_SEND_CID, .arg = 0, .resp = SD_RESP_R2, .timeout_ms = TIMEOUT_ALL_SEND_CID};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    r2_to_reg(&rs, card->cid);
+    return SD_OK;
+}
+
+/**
+ * @brief Send a CMD3 (SEND_RELATIVE_ADDR), SD bus only. The card publishes the RCA every later
+ * addressed command carries, and moves to the standby state
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card struct to populate
+ * @return Status code
+ */
+sd_status_t sd_send_relative_addr(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD3 (SEND_RELATIVE_ADDR)
+    rq = (sd_request_t){.cmd = CMD_SEND_RELATIVE_ADDR,
+                        .arg = 0,
+                        .resp = SD_RESP_R6,
+                        .timeout_ms = TIMEOUT_SEND_RELATIVE_ADDR};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    ret = r1_to_status(&rs);
+    if (ret)
+        return ret;
+
+    card->rca = rs.r[0] >> 16;
+    return SD_OK;
+}
+
+/**
+ * @brief Send a CMD7 (SELECT_CARD), SD bus only. Moves the card to the transfer state
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card to select
+ * @return Status code
+ */
+sd_status_t sd_select_card(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD7 (SELECT_CARD)
+    rq = (sd_request_t){.cmd = CMD_SELECT_CARD,
+                        .arg = card->rca << 16,
+                        .resp = SD_RESP_R1B,
+                        .timeout_ms = TIMEOUT_SELECT_CARD};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
+
+/**
+ * @brief Send a ACMD6 (SET_BUS_WIDTH), SD bus only. The host has to switch its DAT lines as well
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card
+ * @param width_bits Bus width, 1 or 4
+ * @return Status code
+ */
+sd_status_t sd_app_set_bus_width(sd_host_t *host, sd_card_t *card, int width_bits)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD55 (APP_CMD)
+    rq = (sd_request_t){.cmd = CMD_APP_CMD,
+                        .arg = card->rca << 16,
+                        .resp = SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_APP_CMD};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+    if (ret)
+        return ret;
+
+    ret = r1_to_status(&rs);
+    if (ret)
+        return ret;
+
+    // Populates request for ACMD6 (SET_BUS_WIDTH), 0 selects 1-bit and 2 selects 4-bit
+    rq = (sd_request_t){.cmd = ACMD_SET_BUS_WIDTH,
+                        .arg = width_bits == 4 ? 2 : 0,
+                        .resp = SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_SET_BUS_WIDTH};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+    if (ret)
+        return ret;
+
+    return r1_to_status(&rs);
+}
+
+/**
+ * @brief Send a CMD13 (SEND_STATUS)
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card
+ * @param status Output, second byte of the SPI R2 response (R2_*_MASK bits)
+ * @return Status code
+ */
+sd_status_t sd_send_status(sd_host_t *host, sd_card_t *card, uint8_t *status)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+    bool spi = host->bus_kind == SD_BUS_SPI;
+
+    // Populates request for CMD13 (SEND_STATUS), answered with the card status on the SD bus
+    rq = (sd_request_t){.cmd = CMD_SEND_STATUS,
+                        .arg = card->rca << 16,
+                        .resp = spi ? SD_RESP_R2 : SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_SEND_STATUS};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    *status = spi ? (rs.r[0] & 0xFF) : cs_to_r2(rs.r[0]);
+
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
+
+/**
+ * @brief Send a ACMD13 (SD_STATUS), the 512 bit status is sent as a data block
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card struct to populate
+ * @return Status code
+ */
+sd_status_t sd_sd_status(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD55 (APP_CMD)
+    rq = (sd_request_t){.cmd = CMD_APP_CMD,
+                        .arg = card->rca << 16,
+                        .resp = SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_APP_CMD};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+    if (ret)
+        return ret;
+
+    ret = r1_to_status(&rs);
+    if (ret)
+        return ret;
+
+    // Populates request for ACMD13 (SD_STATUS), a R2 in SPI mode and a R1 on the SD bus
+    rq = (sd_request_t){.cmd = ACMD_SD_STATUS,
+                        .arg = 0,
+                        .resp = host->bus_kind == SD_BUS_SPI ? SD_RESP_R2 : SD_RESP_R1,
+                        .dir = SD_DATA_READ,
+                        .blocks = 1,
+                        .block_size = SD_STATUS_LEN,
+                        .timeout_ms = TIMEOUT_SD_STATUS};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, card->ssr);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    ret = r1_to_status(&rs);
+    if (ret)
+        return ret;
+
+    ssr_parse(card);
+    return SD_OK;
+}
+
+/**
+ * @brief Send a CMD6 (SWITCH_FUNC) for the access mode (function group 1), the switch status is
+ * sent as a data block. Every other function group is left unchanged
+ *
+ * @param host SD Card Host Controller
+ * @param mode SWITCH_MODE_CHECK to query the function, SWITCH_MODE_SET to switch to it
+ * @param access Access mode function (SWITCH_ACCESS_*)
+ * @param status Output, SD_SWITCH_STATUS_LEN bytes of switch status
+ * @return Status code
+ */
+sd_status_t sd_switch_func(sd_host_t *host, uint32_t mode, uint32_t access, uint8_t *status)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Groups 6 to 2 keep their function (0xF), group 1 in the low nibble
+    uint32_t arg = (mode << 31) | 0x00FFFFF0 | (access & 0xF);
+
+    // Populates request for CMD6 (SWITCH_FUNC)
+    rq = (sd_request_t){.cmd = CMD_SWITCH_FUNC,
+                        .arg = arg,
+                        .resp = SD_RESP_R1,
+                        .dir = SD_DATA_READ,
+                        .blocks = 1,
+                        .block_size = SD_SWITCH_STATUS_LEN,
+                        .timeout_ms = TIMEOUT_SWITCH_FUNC};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, status);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
+
+/**
+ * @brief Send a ACMD51 (SEND_SCR), the register is sent as a data block
+ *
+ * @param host SD Card Host Controller
+ * @param card SD Card struct to populate
+ * @return Status code
+ */
+sd_status_t sd_send_scr(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD55 (APP_CMD)
+    rq = (sd_request_t){.cmd = CMD_APP_CMD,
+                        .arg = card->rca << 16,
+                        .resp = SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_APP_CMD};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+    if (ret)
+        return ret;
+
+    ret = r1_to_status(&rs);
+    if (ret)
+        return ret;
+
+    // Populates request for ACMD51 (SEND_SCR)
+    rq = (sd_request_t){.cmd = ACMD_SEND_SCR,
+                        .arg = 0,
+                        .resp = SD_RESP_R1,
+                        .dir = SD_DATA_READ,
+                        .blocks = 1,
+                        .block_size = SD_SCR_LEN,
+                        .timeout_ms = TIMEOUT_SEND_SCR};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, card->scr);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
+
+/**
+ * @brief Send a CMD32 (ERASE_WR_BLK_START) or CMD33 (ERASE_WR_BLK_END), setting one end of the
+ * range erased by the next CMD38
+ *
+ * @param host SD Card Host Controller
+ * @param cmd CMD_ERASE_WR_BLK_START or CMD_ERASE_WR_BLK_END
+ * @param addr Block address (SDHC/SDXC) or byte address (SDSC)
+ * @return Status code
+ */
+sd_status_t sd_erase_wr_blk(sd_host_t *host, uint8_t cmd, uint32_t addr)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD32/CMD33
+    rq = (sd_request_t){
+        .cmd = cmd, .arg = addr, .resp = SD_RESP_R1, .timeout_ms = TIMEOUT_ERASE_WR_BLK};
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
+
+/**
+ * @brief Send a CMD38 (ERASE), erases the range set by CMD32/CMD33. The R1b busy lasts until the
+ * card finished erasing
+ *
+ * @param host SD Card Host Controller
+ * @param timeout_ms Longest time the card may stay busy
+ * @return Status code
+ */
+sd_status_t sd_erase(sd_host_t *host, uint32_t timeout_ms)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    // Populates request for CMD38 (ERASE)
+    rq = (sd_request_t){
+        .cmd = CMD_ERASE, .arg = 0, .resp = SD_RESP_R1B, .timeout_ms = timeout_ms};
+
+    // Submits the command, the bus waits out the busy signal
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
+
+/**
+ * @brief Populates a CMD17 (READ_SINGLE_BLOCK) or CMD18 (READ_MULTIPLE_BLOCK) request
+ *
+ * @param card SD Card
+ * @param lba Start block
+ * @param count Number of blocks
+ * @param rq Request to populate
+ */
+static void build_read_rq(sd_card_t *card, uint32_t lba, uint32_t count, sd_request_t *rq)
+{
+    bool multi = count > 1;
+
+    // The bus driver receives every block directly into the buffer, and stops CMD18 with a CMD12
+    *rq = (sd_request_t){.cmd = multi ? CMD_READ_MULTIPLE_BLOCK : CMD_READ_SINGLE_BLOCK,
+                         .arg = block_to_arg(card, lba),
+                         .resp = SD_RESP_R1,
+                         .dir = SD_DATA_READ,
+                         .blocks = count,
+                         .block_size = SD_DEFAULT_BLOCK_LEN,
+                         .multi = multi,
+                         .auto_stop = multi,
+                         .timeout_ms = TIMEOUT_READ_BLOCK};
+}
+
+/**
+ * @brief Populates a CMD24 (WRITE_BLOCK) or CMD25 (WRITE_MULTIPLE_BLOCK) request
+ *
+ * @param card SD Card
+ * @param lba Start block
+ * @param count Number of blocks
+ * @param rq Request to populate
+ */
+static void build_write_rq(sd_card_t *card, uint32_t lba, uint32_t count, sd_request_t *rq)
+{
+    bool multi = count > 1;
+
+    // The bus driver handles the data tokens, data responses and busy of every block
+    *rq = (sd_request_t){.cmd = multi ? CMD_WRITE_MULTIPLE_BLOCK : CMD_WRITE_BLOCK,
+                         .arg = block_to_arg(card, lba),
+                         .resp = SD_RESP_R1,
+                         .dir = SD_DATA_WRITE,
+                         .blocks = count,
+                         .block_size = SD_DEFAULT_BLOCK_LEN,
+                         .multi = multi,
+                         .timeout_ms = TIMEOUT_WRITE_BLOCK};
+}
+
+/**
+ * @brief Completes queued asynchronous requests, synchronous calls must not interleave with them
+ *
+ * @param card SD Card
+ */
+static void async_drain(sd_card_t *card)
+{
+    while (sd_poll(card) == SD_PENDING)
+        ;
+}
+
+/**
+ * @brief Stops an open read stream
+ *
+ * @param card SD Card
+ */
+static void stream_close(sd_card_t *card)
+{
+    if (!card->stream_open)
+        return;
+
+    // The blocks asked for were delivered already, an error stopping the stream changes nothing
+    card->stream_open = false;
+    card->host->bus->stream_stop(card->host);
+}
+
+/**
+ * @brief Returns the card to the transfer state ahead of a command: completes queued asynchronous
+ * requests and stops an open read stream
+ *
+ * @param card SD Card
+ */
+static void card_idle(sd_card_t *card)
+{
+    async_drain(card);
+    stream_close(card);
+}
+
+/**
+ * @brief Takes the host lock, if the port provides one. Held around every command sequence, so
+ * callers on other threads can't interleave frames (CMD55 and its ACMD, an open CMD18 stream)
+ *
+ * @param host SD Host
+ */
+static void host_lock(sd_host_t *host)
+{
+    if (host->ops && host->ops->lock)
+        host->ops->lock(host);
+}
+
+/**
+ * @brief Releases the host lock
+ *
+ * @param host SD Host
+ */
+static void host_unlock(sd_host_t *host)
+{
+    if (host->ops && host->ops->unlock)
+        host->ops->unlock(host);
+}
+
+// ========== libsd API ==========
+
+/**
+ * @brief Body of sd_set_bus_width, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param width_bits Bus width, 1 or 4
+ * @return Status code
+ */
+static sd_status_t set_bus_width(sd_card_t *card, int width_bits)
+{
+    sd_status_t ret;
+
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    sd_host_t *host = card->host;
+
+    if (width_bits != 1 && width_bits != 4)
+        return SD_ERR_PARAM;
+
+    // SPI only has a single data line
+    if (host->bus_kind == SD_BUS_SPI)
+        return width_bits == 1 ? SD_OK : SD_ERR_UNSUPPORTED;
+
+    // Both the controller and the card (SCR SD_BUS_WIDTHS) need DAT1-DAT3
+    if (width_bits == 4 && (!host->supports_4bit || !reg_bits(card->scr, SD_SCR_LEN, 50, 50)))
+        return SD_ERR_UNSUPPORTED;
+
+    card_idle(card);
+
+    // ACMD6: SET_BUS_WIDTH, the card switches once it answered
+    ret = sd_app_set_bus_width(host, card, width_bits);
+    if (ret)
+        return ret;
+
+    if (host->bus->set_bus_width)
+    {
+        ret = host->bus->set_bus_width(host, width_bits);
+        if (ret)
+            return ret;
+    }
+
+    card->bus_4bit = width_bits == 4;
+    return SD_OK;
+}
+
+/**
+ * @brief Time source for the init phase breakdown
+ *
+ * @param host SD Host
+ * @return Time in microseconds, 0 without get_time_us
+ */
+static uint64_t init_now(sd_host_t *host)
+{
+    return host->ops->get_time_us ? host->ops->get_time_us() : 0;
+}
+
+/**
+ * @brief Ends an init phase, adding it to the total
+ *
+ * @param card SD Card
+ * @param mark Start of the phase, moved to its end
+ * @return Time (us) the phase took
+ */
+static uint32_t init_lap(sd_card_t *card, uint64_t *mark)
+{
+    uint64_t now = init_now(card->host);
+    uint32_t us = now - *mark > UINT32_MAX ? UINT32_MAX : (uint32_t)(now - *mark);
+
+    *mark = now;
+    card->init_times.total_us += us;
+    return us;
+}
+
+/**
+ * @brief Powers the card, if the port controls its supply, and lets it settle
+ *
+ * @param host SD Host
+ */
+static void power_up(sd_host_t *host)
+{
+    // Enable SD card power if provided
+    if (host->ops->set_power)
+        host->ops->set_power(host, true);
+
+    // TODO: Await card detect?
+
+    // Small delay to let card stabilize
+    host->ops->delay_ms(1);
+}
+
+/**
+ * @brief Resets the card to the idle state at the identification clock: CMD0, CMD8 and, in SPI
+ * mode, CMD59
+ *
+ * @param host SD Host
+ * @param card SD Card
+ * @return Status code
+ */
+static sd_status_t reset_card(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_response_t rs;
+
+    // Sets the clock to 400Khz for card initialization
+    set_card_clock(card, SD_IDENT_CLOCK_HZ);
+
+    // CMD0 returns the card to a single DAT line, the host may still be on four from before
+    if (host->bus_kind == SD_BUS_SDMMC && host->bus->set_bus_width)
+        host->bus->set_bus_width(host, 1);
+
+    // CMD0: GO_IDLE_STATE
+    ret = sd_go_idle_state(host);
+    if (ret)
+        return ret;
+
+    // CMD8: SEND_IF_COND
+    // For first gen cards, the SEND_IF_COND is a illegal command
+    // Thus we only care about status code that indicate I/O error
+    ret = sd_send_if_cond(host, SD_CMD8_VOLTAGE_2_7__3_6, &rs);
+    if (ret == SD_ERR_IO) // check pattern err
+        return ret;
+
+    // Check if first or second gen card
+    card->v2 = (ret == SD_OK);
+
+    // TODO: Handle gen 1 cards, for now we ignore them :( as i dont have any to test with
+    if (!card->v2)
+        return SD_ERR_UNSUPPORTED;
+
+    // TODO: Check non compatible voltages?
+
+#if SD_CRC_ENABLE
+    // CMD59: CRC_ON_OFF
+    // Protects every following command and data block, the card accepts it while idle
+    if (host->bus_kind == SD_BUS_SPI)
+    {
+        ret = sd_crc_on_off(host, true);
+        if (ret)
+            return ret;
+
+        card->crc_on = true;
+    }
+#endif
+
+    return SD_OK;
+}
+
+/**
+ * @brief Polls ACMD41 until the card leaves the idle state
+ *
+ * @param host SD Host
+ * @param card SD Card, counts the polls in init_times
+ * @param rs Output, response to the last ACMD41 (the OCR on the SD bus)
+ * @return Status code
+ */
+static sd_status_t wait_op_cond(sd_host_t *host, sd_card_t *card, sd_response_t *rs)
+{
+    // ACMD41: SD_SEND_OP_COND
+    // Continuously send ACMD41 till R1 yiels 0x00
+    for (int i = 0; i < TIMEOUT_CNT_SD_SEND_OP_COND; i++)
+    {
+        // ACMD41 starts the sd card initialization process
+        sd_send_op_cond(host, card, rs);
+        card->init_times.op_cond_polls++;
+
+        // Wait till we are no longer in idle
+        if (!r1_in_idle(rs))
+            break;
+
+        // R1 polling no longer sleeps, pace retries so the count stays ~1ms each
+        host->ops->delay_ms(1);
+    }
+
+    if (r1_in_idle(rs))
+        return SD_ERR_TIMEOUT;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Body of sd_init, run with the host lock held
+ *
+ * @param host SD host controller
+ * @param card Struct representing the card to operate on
+ * @return Status code
+ */
+static sd_status_t init_card(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_response_t rs;
+
+    // Sanity check pointers
+    if (!host || !card)
+        return SD_ERR_PARAM;
+
+    // Sanit checks that the vtabls for the controllers ops and bus ops are provided
+    if (!host->ops || !host->bus)
+        return SD_ERR_PARAM;
+
+    // Zeroes out the card
+    memset(card, 0, sizeof(*card));
+    card->host = host;
+
+#if SD_STATS_ENABLE
+    memset(&host->stats, 0, sizeof(host->stats));
+#endif
+
+    uint64_t mark = init_now(host);
+
+    power_up(host);
+    card->init_times.power_us = init_lap(card, &mark);
+
+    ret = reset_card(host, card);
+    card->init_times.reset_us = init_lap(card, &mark);
+    if (ret)
+        return ret;
+
+    ret = wait_op_cond(host, card, &rs);
+    if (ret)
+    {
+        card->init_times.op_cond_us = init_lap(card, &mark);
+        return ret;
+    }
+
+    if (host->bus_kind == SD_BUS_SDMMC)
+    {
+        // On the SD bus the OCR came with the last ACMD41 (R3)
+        card->ocr = rs.r[0];
+        card->high_capacity = OCR_HIGH_CAPACITY(card->ocr);
+        card->init_times.op_cond_us = init_lap(card, &mark);
+
+        // CMD2: ALL_SEND_CID
+        ret = sd_all_send_cid(host, card);
+        if (ret)
+            return ret;
+
+        // CMD3: SEND_RELATIVE_ADDR
+        ret = sd_send_relative_addr(host, card);
+        if (ret)
+            return ret;
+
+        // CMD9: SEND_CSD
+        // Only answered in the standby state, before the card is selected
+        ret = sd_send_csd(host, card);
+        if (ret)
+            return ret;
+
+        // CMD7: SELECT_CARD
+        ret = sd_select_card(host, card);
+        if (ret)
+            return ret;
+    }
+    else
+    {
+        // CMD58: READ_OCR
+        // Checks Waits till power ready, all statuses like CCS are set once power is ready
+        for (int i = 0; i < TIMEOUT_CNT_READ_OCR; i++)
+        {
+            ret = sd_read_ocr(host, card);
+
+            if (ret)
+                return ret;
+
+            if (OCR_POWER_UP_STATUS(card->ocr))
+                break;
+
+            // TODO: Check non compatible voltages?
+        }
+
+        card->init_times.op_cond_us = init_lap(card, &mark);
+        if (!OCR_POWER_UP_STATUS(card->ocr))
+            return SD_ERR_TIMEOUT;
+    }
+
+    // CMD16: Set block len
+    ret = sd_set_block_len(host, card, SD_DEFAULT_BLOCK_LEN);
+    if (ret)
+        return ret;
+
+    card->block_len = SD_DEFAULT_BLOCK_LEN;
+
+    if (host->bus_kind == SD_BUS_SPI)
+    {
+        // CMD9: SEND_CSD
+        // Provides the capacity and maximum transfer clock
+        ret = sd_send_csd(host, card);
+        if (ret)
+            return ret;
+
+        // CMD10: SEND_CID
+        ret = sd_send_cid(host, card);
+        if (ret)
+            return ret;
+    }
+
+    card->init_times.ident_us = init_lap(card, &mark);
+
+    // ACMD51: SEND_SCR
+    // Provides the supported bus widths and specification version. Left zeroed if rejected
+    if (sd_send_scr(host, card))
+        memset(card->scr, 0, sizeof(card->scr));
+
+    // ACMD6: SET_BUS_WIDTH
+    // Four data lines when both the card and the controller have them
+    if (host->bus_kind == SD_BUS_SDMMC && host->supports_4bit &&
+        reg_bits(card->scr, SD_SCR_LEN, 50, 50))
+    {
+        ret = set_bus_width(card, 4);
+        if (ret)
+            return ret;
+    }
+
+    // ACMD13: SD_STATUS
+    // Provides the AU size and erase timing. Optional, erases fall back to default timeouts
+    if (sd_sd_status(host, card))
+    {
+        memset(card->ssr, 0, sizeof(card->ssr));
+        ssr_parse(card);
+    }
+
+    // Move to the card's maximum clock, limited by the controller. Ports further clamp this
+    // to what their peripheral can generate
+    if (card->max_clock_hz > SD_IDENT_CLOCK_HZ)
+    {
+        ret = set_card_clock(card, card->max_clock_hz);
+        if (ret)
+            return ret;
+    }
+
+    card->init_times.config_us = init_lap(card, &mark);
+    return SD_OK;
+}
+
+sd_status_t sd_init(sd_host_t *host, sd_card_t *card)
+{
+    if (!host)
+        return SD_ERR_PARAM;
+
+    host_lock(host);
+    sd_status_t ret = init_card(host, card);
+    host_unlock(host);
+
+    return ret;
+}
+
+sd_status_t sd_set_bus_width(sd_card_t *card, int width_bits)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    sd_status_t ret = set_bus_width(card, width_bits);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Body of sd_set_speed, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param speed Access mode
+ * @return Status code
+ */
+static sd_status_t set_speed(sd_card_t *card, sd_speed_t speed)
+{
+    uint8_t status[SD_SWITCH_STATUS_LEN];
+    uint32_t access, clock_hz;
+    sd_status_t ret;
+
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    sd_host_t *host = card->host;
+
+    // UHS modes need 1.8V signalling (CMD11), which isn't supported
+    switch (speed)
+    {
+    case SD_SPEED_DEFAULT:
+        access = SWITCH_ACCESS_DEFAULT;
+        clock_hz = SD_DEFAULT_SPEED_CLOCK_HZ;
+        break;
+    case SD_SPEED_HIGH:
+        access = SWITCH_ACCESS_HIGH_SPEED;
+        clock_hz = SD_HIGH_SPEED_CLOCK_HZ;
+        break;
+    default:
+        return SD_ERR_UNSUPPORTED;
+    }
+
+    // CMD6 needs a SD 1.10 card (SCR SD_SPEC) in the switch command class (CSD CCC class 10).
+    // Older cards only have the default speed
+    if (!reg_bits(card->scr, SD_SCR_LEN, 59, 56) || !reg_bits(card->csd, SD_REG_LEN, 94, 94))
+        return speed == SD_SPEED_DEFAULT ? SD_OK : SD_ERR_UNSUPPORTED;
+
+    card_idle(card);
+
+    // CMD6 check mode: the function must be supported and selectable, and not busy
+    ret = sd_switch_func(host, SWITCH_MODE_CHECK, access, status);
+    if (ret)
+        return ret;
+
+    if (!reg_bits(status, SD_SWITCH_STATUS_LEN, 400 + access, 400 + access) ||
+        reg_bits(status, SD_SWITCH_STATUS_LEN, 379, 376) != access)
+        return SD_ERR_UNSUPPORTED;
+
+    if (reg_bits(status, SD_SWITCH_STATUS_LEN, 375, 368) >= 1 &&
+        reg_bits(status, SD_SWITCH_STATUS_LEN, 272 + access, 272 + access))
+        return SD_ERR_TIMEOUT;
+
+    // CMD6 switch mode, a maximum current of 0 signals an error
+    ret = sd_switch_func(host, SWITCH_MODE_SET, access, status);
+    if (ret)
+        return ret;
+
+    if (reg_bits(status, SD_SWITCH_STATUS_LEN, 379, 376) != access ||
+        !reg_bits(status, SD_SWITCH_STATUS_LEN, 511, 496))
+        return SD_ERR_IO;
+
+    card->curr_speed = speed;
+
+    // The card uses the new timing once the status block was sent. Back at default speed the
+    // CSD TRAN_SPEED applies again
+    card->max_clock_hz = clock_hz;
+    if (speed == SD_SPEED_DEFAULT && csd_tran_speed_hz(card->csd))
+        card->max_clock_hz = csd_tran_speed_hz(card->csd);
+
+    return set_card_clock(card, card->max_clock_hz);
+}
+
+sd_status_t sd_set_speed(sd_card_t *card, sd_speed_t speed)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    sd_status_t ret = set_speed(card, speed);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Probes whether the card kept power and its state while the host slept: a CMD13 it only
+ * answers once initialized, with a short timeout as a power cycled card stays silent
+ *
+ * @param host SD Host
+ * @param card SD Card, rca as saved
+ * @return SD_OK if the card is ready in the transfer state
+ */
+static sd_status_t probe_card(sd_host_t *host, sd_card_t *card)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+    bool spi = host->bus_kind == SD_BUS_SPI;
+
+    // CMD13: SEND_STATUS
+    rq = (sd_request_t){.cmd = CMD_SEND_STATUS,
+                        .arg = card->rca << 16,
+                        .resp = spi ? SD_RESP_R2 : SD_RESP_R1,
+                        .timeout_ms = TIMEOUT_WARM_PROBE};
+
+    ret = host->bus->submit(host, &rq, &rs, NULL);
+    if (ret)
+        return ret;
+
+    // A card back in the idle state (SPI) or elsewhere than the transfer state (SD bus) has to be
+    // initialized again
+    if (spi)
+        return rs.r1 ? SD_ERR_IO : SD_OK;
+
+    if (r1_to_status(&rs) || CS_CURRENT_STATE(rs.r[0]) != CS_STATE_TRAN)
+        return SD_ERR_IO;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Resumes a card that kept power: the card still has its RCA, bus width, speed mode and
+ * CRC setting, only the host side is brought back in line
+ *
+ * @param host SD Host
+ * @param card SD Card, filled in from the descriptor
+ * @param desc Saved descriptor
+ * @return SD_OK if the same card answered and was resumed
+ */
+static sd_status_t resume_warm(sd_host_t *host, sd_card_t *card, const sd_card_desc_t *desc)
+{
+    sd_status_t ret;
+
+    // A card answering at all was initialized, so it kept power
+    ret = set_card_clock(card, desc->clock_hz);
+    if (ret)
+        return ret;
+
+    ret = probe_card(host, card);
+    if (ret)
+        return ret;
+
+    if (host->bus_kind == SD_BUS_SPI)
+    {
+        // CMD59: CRC_ON_OFF
+        // The bus driver lost track of the card's setting, stating it again aligns both
+        ret = sd_crc_on_off(host, desc->crc_on);
+        if (ret)
+            return ret;
+
+        // CMD10: SEND_CID
+        // A card swapped in meanwhile would have been power cycled, this only rules out a stale
+        // descriptor
+        ret = sd_send_cid(host, card);
+        if (ret)
+            return ret;
+
+        if (memcmp(card->cid, desc->cid, sizeof(card->cid)))
+            return SD_ERR_NO_CARD;
+    }
+    else if (desc->bus_4bit && host->bus->set_bus_width)
+    {
+        // On the SD bus, the RCA the card answered to (it picked it itself at CMD3) identifies it
+        ret = host->bus->set_bus_width(host, 4);
+        if (ret)
+            return ret;
+    }
+
+    card->crc_on = desc->crc_on;
+    card->bus_4bit = desc->bus_4bit;
+    card->curr_speed = desc->speed;
+    card->max_clock_hz = desc->max_clock_hz;
+    return SD_OK;
+}
+
+/**
+ * @brief Body of sd_init_fast, run with the host lock held
+ *
+ * @param host SD host controller
+ * @param card Struct representing the card to operate on
+ * @param desc Saved descriptor
+ * @return Status code
+ */
+static sd_status_t init_card_fast(sd_host_t *host, sd_card_t *card, const sd_card_desc_t *desc)
+{
+    sd_status_t ret;
+    sd_response_t rs;
+
+    if (!host || !card || !desc)
+        return SD_ERR_PARAM;
+
+    if (!host->ops || !host->bus)
+        return SD_ERR_PARAM;
+
+    // A descriptor never saved, or saved on the other bus, is no use
+    if (desc->magic != SD_CARD_DESC_MAGIC || desc->bus != host->bus_kind)
+        return init_card(host, card);
+
+    // The registers can't have changed as long as it is the same card
+    memset(card, 0, sizeof(*card));
+    card->host = host;
+    card->v2 = true;
+    card->ocr = desc->ocr;
+    card->high_capacity = OCR_HIGH_CAPACITY(desc->ocr);
+    card->rca = desc->rca;
+    card->block_len = SD_DEFAULT_BLOCK_LEN;
+    memcpy(card->cid, desc->cid, sizeof(card->cid));
+    memcpy(card->csd, desc->csd, sizeof(card->csd));
+    memcpy(card->scr, desc->scr, sizeof(card->scr));
+    memcpy(card->ssr, desc->ssr, sizeof(card->ssr));
+    card->capacity_bytes = csd_capacity(card->csd);
+    card->max_clock_hz = csd_tran_speed_hz(card->csd);
+    ssr_parse(card);
+
+#if SD_STATS_ENABLE
+    memset(&host->stats, 0, sizeof(host->stats));
+#endif
+
+    uint64_t mark = init_now(host);
+
+    power_up(host);
+    card->init_times.power_us = init_lap(card, &mark);
+
+    ret = resume_warm(host, card, desc);
+    card->init_times.reset_us = init_lap(card, &mark);
+    if (!ret)
+    {
+        card->init_times.path = SD_INIT_WARM;
+        return SD_OK;
+    }
+
+    // The card was power cycled, or doesn't answer as expected: identify it again
+    card->rca = 0;
+    card->crc_on = false;
+
+    ret = reset_card(host, card);
+    card->init_times.reset_us += init_lap(card, &mark);
+    if (ret)
+        return ret;
+
+    ret = wait_op_cond(host, card, &rs);
+    card->init_times.op_cond_us = init_lap(card, &mark);
+    if (ret)
+        return ret;
+
+    if (host->bus_kind == SD_BUS_SDMMC)
+    {
+        // On the SD bus the OCR came with the last ACMD41 (R3)
+        card->ocr = rs.r[0];
+        card->high_capacity = OCR_HIGH_CAPACITY(card->ocr);
+
+        // CMD2: ALL_SEND_CID
+        // Part of the identification anyway, so the identity check is free
+        ret = sd_all_send_cid(host, card);
+        if (ret)
+            return ret;
+
+        if (memcmp(card->cid, desc->cid, sizeof(card->cid)))
+            return init_card(host, card);
+
+        // CMD3: SEND_RELATIVE_ADDR
+        ret = sd_send_relative_addr(host, card);
+        if (ret)
+            return ret;
+
+        // CMD7: SELECT_CARD
+        // CMD9 is skipped, the CSD is known
+        ret = sd_select_card(host, card);
+        if (ret)
+            return ret;
+    }
+
+    // Identification is over, straight to the operating clock. The card is back at default speed
+    // until CMD6, so no faster than CSD TRAN_SPEED yet
+    ret = set_card_clock(card,
+                         desc->clock_hz < card->max_clock_hz ? desc->clock_hz : card->max_clock_hz);
+    if (ret)
+        return ret;
+
+    if (host->bus_kind == SD_BUS_SPI)
+    {
+        // CMD10: SEND_CID
+        // CMD58 and CMD9 are skipped, a ready ACMD41 means powered up and the registers are known
+        ret = sd_send_cid(host, card);
+        if (ret)
+            return ret;
+
+        if (memcmp(card->cid, desc->cid, sizeof(card->cid)))
+            return init_card(host, card);
+    }
+
+    // CMD16: Set block len
+    // SDHC/SDXC cards have a fixed 512 byte block
+    if (!card->high_capacity)
+    {
+        ret = sd_set_block_len(host, card, SD_DEFAULT_BLOCK_LEN);
+        if (ret)
+            return ret;
+    }
+
+    card->init_times.ident_us = init_lap(card, &mark);
+
+    // ACMD6: SET_BUS_WIDTH
+    if (desc->bus_4bit)
+    {
+        ret = set_bus_width(card, 4);
+        if (ret)
+            return ret;
+    }
+
+    // CMD6: SWITCH_FUNC
+    if (desc->speed != SD_SPEED_DEFAULT)
+    {
+        ret = set_speed(card, desc->speed);
+        if (ret)
+            return ret;
+    }
+
+    // CMD59: CRC_ON_OFF
+    // Back to the saved setting, if it was turned off after sd_init
+    if (host->bus_kind == SD_BUS_SPI && card->crc_on != desc->crc_on)
+    {
+        ret = sd_crc_on_off(host, desc->crc_on);
+        if (ret)
+            return ret;
+
+        card->crc_on = desc->crc_on;
+    }
+
+    if (card->clock_hz != desc->clock_hz)
+    {
+        ret = set_card_clock(card, desc->clock_hz);
+        if (ret)
+            return ret;
+    }
+
+    card->init_times.config_us = init_lap(card, &mark);
+    card->init_times.path = SD_INIT_COLD;
+    return SD_OK;
+}
+
+sd_status_t sd_init_fast(sd_host_t *host, sd_card_t *card, const sd_card_desc_t *desc)
+{
+    if (!host)
+        return SD_ERR_PARAM;
+
+    host_lock(host);
+    sd_status_t ret = init_card_fast(host, card, desc);
+    host_unlock(host);
+
+    return ret;
+}
+
+sd_status_t sd_get_card_desc(sd_card_t *card, sd_card_desc_t *desc)
+{
+    if (!card || !card->host || !desc)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+
+    // Quiesce the card, so a warm resume finds it in the transfer state
+    card_idle(card);
+
+    memset(desc, 0, sizeof(*desc));
+    desc->magic = SD_CARD_DESC_MAGIC;
+    desc->bus = card->host->bus_kind;
+    desc->ocr = card->ocr;
+    desc->rca = card->rca;
+    memcpy(desc->cid, card->cid, sizeof(desc->cid));
+    memcpy(desc->csd, card->csd, sizeof(desc->csd));
+    memcpy(desc->scr, card->scr, sizeof(desc->scr));
+    memcpy(desc->ssr, card->ssr, sizeof(desc->ssr));
+    desc->speed = card->curr_speed;
+    desc->max_clock_hz = card->max_clock_hz;
+    desc->clock_hz = card->clock_hz;
+    desc->bus_4bit = card->bus_4bit;
+    desc->crc_on = card->crc_on;
+
+    host_unlock(card->host);
+
+    return SD_OK;
+}
+
+sd_status_t sd_get_geometry(const sd_card_t *card, sd_geometry_t *geo)
+{
+    if (!card || !geo)
+        return SD_ERR_PARAM;
+
+    const uint8_t *ssr = card->ssr;
+    static const uint8_t speed_class[5] = {0, 2, 4, 6, 10};
+    uint32_t sc = reg_bits(ssr, SD_STATUS_LEN, 447, 440);
+
+    memset(geo, 0, sizeof(*geo));
+
+    // SD Status
+    geo->au_blocks = card->au_blocks;
+    geo->uhs_au_blocks = au_size_blocks(reg_bits(ssr, SD_STATUS_LEN, 395, 392));
+    geo->erase_size = card->erase_size;
+    geo->erase_timeout_s = card->erase_timeout_s;
+    geo->erase_offset_s = card->erase_offset_s;
+    geo->speed_class = sc < sizeof(speed_class) ? speed_class[sc] : 0;
+    geo->uhs_speed_grade = reg_bits(ssr, SD_STATUS_LEN, 399, 396);
+    geo->video_speed_class = reg_bits(ssr, SD_STATUS_LEN, 391, 384);
+    geo->app_perf_class = reg_bits(ssr, SD_STATUS_LEN, 339, 336);
+    geo->perf_move_mbs = reg_bits(ssr, SD_STATUS_LEN, 439, 432);
+
+    // SCR, every card supports the 1-bit bus so SD_BUS_WIDTHS = 0 means it was never read
+    if (reg_bits(card->scr, SD_SCR_LEN, 51, 48))
+    {
+        geo->spec_version = scr_spec_version(card->scr);
+        geo->bus_4bit = reg_bits(card->scr, SD_SCR_LEN, 50, 50);
+        geo->erase_value = reg_bits(card->scr, SD_SCR_LEN, 55, 55) ? 0xFF : 0x00;
+    }
+
+    return SD_OK;
+}
+
+// === Block level i/o ===
+
+/**
+ * @brief Body of sd_read_blocks, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param lba Start block
+ * @param buf Buffer to store contents
+ * @param count Number of blocks
+ * @return Status code
+ */
+static sd_status_t read_blocks(sd_card_t *card, uint32_t lba, void *buf, uint32_t count)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    ret = check_block_io(card, lba, buf, count);
+    if (ret || !count)
+        return ret;
+
+    sd_host_t *host = card->host;
+    async_drain(card);
+
+    // Continues the open stream without a command when the read follows on from it
+    if (card->stream_open && lba == card->stream_next)
+    {
+        ret = host->bus->stream_read(host, buf, count, SD_DEFAULT_BLOCK_LEN);
+
+        // SD_ERR_PROTO: the bus already closed the stream, read with a new command below
+        if (ret != SD_ERR_PROTO)
+        {
+            card->stream_open = !ret;
+            card->stream_next = lba + count;
+            card->seq_next = lba + count;
+            return ret;
+        }
+
+        card->stream_open = false;
+    }
+
+    // A non-sequential access stops the stream
+    stream_close(card);
+
+    bool stream = card->read_ahead && lba == card->seq_next;
+    card->seq_next = lba + count;
+
+    // Populates request for CMD17 (READ_SINGLE_BLOCK) or a CMD18 (READ_MULTIPLE_BLOCK) stream
+    build_read_rq(card, lba, count, &rq);
+
+    // Sequential reads leave the CMD18 streaming for the reads that follow
+    if (stream)
+    {
+        rq.cmd = CMD_READ_MULTIPLE_BLOCK;
+        rq.multi = true;
+        rq.auto_stop = false;
+        rq.open_ended = true;
+    }
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, buf);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    ret = r1_to_status(&rs);
+    if (ret)
+        return ret;
+
+    card->stream_open = stream;
+    card->stream_next = lba + count;
+    return SD_OK;
+}
+
+sd_status_t sd_read_blocks(sd_card_t *card, uint32_t lba, void *buf, uint32_t count)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    uint32_t start = sd_trace_now(card->host);
+    sd_status_t ret = read_blocks(card, lba, buf, count);
+    sd_trace_rec(card->host, SD_TRACE_READ, 0, lba, 0, trace_bytes(count), ret, start);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Body of sd_write_blocks, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param lba Start block
+ * @param buf Buffer containing data to write
+ * @param count Number of blocks
+ * @return Status code
+ */
+static sd_status_t write_blocks(sd_card_t *card, uint32_t lba, const void *buf, uint32_t count)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+
+    ret = check_block_io(card, lba, buf, count);
+    if (ret || !count)
+        return ret;
+
+    sd_host_t *host = card->host;
+    card_idle(card);
+
+    // Lets the card pre-erase the whole run. This is only a hint, a card that rejects it
+    // still accepts the CMD25
+    if (count > 1)
+        sd_set_wr_blk_erase_count(host, card, count);
+
+    // Populates request for CMD24 (WRITE_BLOCK) or a CMD25 (WRITE_MULTIPLE_BLOCK) burst
+    build_write_rq(card, lba, count, &rq);
+
+    // Submits the command
+    ret = host->bus->submit(host, &rq, &rs, (void *)buf);
+
+    // Checks if there was any issue transmitting command and receiving (timeout, etc)
+    if (ret)
+        return ret;
+
+    // Checks whether the card rejected the command
+    return r1_to_status(&rs);
+}
+
+sd_status_t sd_write_blocks(sd_card_t *card, uint32_t lba, const void *buf, uint32_t count)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    uint32_t start = sd_trace_now(card->host);
+    sd_status_t ret = write_blocks(card, lba, buf, count);
+    sd_trace_rec(card->host, SD_TRACE_WRITE, 0, lba, 0, trace_bytes(count), ret, start);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Scatter-gather transfer for buses without submit_sg: a command per run of whole blocks
+ * within a segment, blocks straddling segments go through a bounce buffer one at a time
+ *
+ * @param card SD Card to operate on
+ * @param lba Start block
+ * @param iov Segments, validated
+ * @param iovcnt Number of segments
+ * @param write Whether to write
+ * @return Status code
+ */
+static sd_status_t rw_split(sd_card_t *card,
+                            uint32_t lba,
+                            const sd_iovec_t *iov,
+                            uint32_t iovcnt,
+                            bool write)
+{
+    uint8_t bounce[SD_DEFAULT_BLOCK_LEN];
+    sd_status_t ret;
+    uint32_t i = 0;
+    size_t off = 0;
+
+    while (i < iovcnt)
+    {
+        size_t avail = iov[i].len - off;
+        if (!avail)
+        {
+            i++;
+            off = 0;
+            continue;
+        }
+
+        // Whole blocks left in this segment go straight to or from it
+        uint32_t run = (uint32_t)(avail / SD_DEFAULT_BLOCK_LEN);
+        if (run)
+        {
+            uint8_t *p = (uint8_t *)iov[i].ptr + off;
+            ret = write ? write_blocks(card, lba, p, run) : read_blocks(card, lba, p, run);
+            if (ret)
+                return ret;
+
+            lba += run;
+            off += (size_t)run * SD_DEFAULT_BLOCK_LEN;
+            continue;
+        }
+
+        // The next block straddles segments
+        if (write)
+        {
+            iov_bounce(iov, &i, &off, bounce, true);
+            ret = write_blocks(card, lba, bounce, 1);
+        }
+        else
+        {
+            ret = read_blocks(card, lba, bounce, 1);
+            if (!ret)
+                iov_bounce(iov, &i, &off, bounce, false);
+        }
+
+        if (ret)
+            return ret;
+        lba++;
+    }
+
+    return SD_OK;
+}
+
+/**
+ * @brief Body of sd_readv, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param lba Start block
+ * @param iov Destination segments
+ * @param iovcnt Number of segments
+ * @param blocks Output, number of blocks the segments cover, 0 if they are invalid
+ * @return Status code
+ */
+static sd_status_t read_iov(sd_card_t *card,
+                              uint32_t lba,
+                              const sd_iovec_t *iov,
+                              uint32_t iovcnt,
+                              uint32_t *blocks)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+    uint32_t count;
+
+    *blocks = 0;
+    ret = iov_blocks(iov, iovcnt, &count);
+    if (ret)
+        return ret;
+    *blocks = count;
+
+    ret = check_block_io(card, lba, iov, count);
+    if (ret || !count)
+        return ret;
+
+    // A single segment is a plain read, which can also be served from an open stream
+    if (iovcnt == 1)
+        return read_blocks(card, lba, iov->ptr, count);
+
+    sd_host_t *host = card->host;
+    if (!host->bus->submit_sg)
+        return rw_split(card, lba, iov, iovcnt, false);
+
+    card_idle(card);
+    card->seq_next = lba + count;
+
+    // One CMD17/CMD18 for the whole transfer, the bus driver receives straight into the segments
+    build_read_rq(card, lba, count, &rq);
+    ret = host->bus->submit_sg(host, &rq, &rs, iov, iovcnt);
+    if (ret)
+        return ret;
+
+    return r1_to_status(&rs);
+}
+
+sd_status_t sd_readv(sd_card_t *card, uint32_t lba, const sd_iovec_t *iov, uint32_t iovcnt)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    uint32_t start = sd_trace_now(card->host);
+    uint32_t count;
+    sd_status_t ret = read_iov(card, lba, iov, iovcnt, &count);
+    sd_trace_rec(card->host, SD_TRACE_READ, 0, lba, 0, trace_bytes(count), ret, start);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Body of sd_writev, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param lba Start block
+ * @param iov Source segments
+ * @param iovcnt Number of segments
+ * @param blocks Output, number of blocks the segments cover, 0 if they are invalid
+ * @return Status code
+ */
+static sd_status_t write_iov(sd_card_t *card,
+                               uint32_t lba,
+                               const sd_iovec_t *iov,
+                               uint32_t iovcnt,
+                               uint32_t *blocks)
+{
+    sd_status_t ret;
+    sd_request_t rq;
+    sd_response_t rs;
+    uint32_t count;
+
+    *blocks = 0;
+    ret = iov_blocks(iov, iovcnt, &count);
+    if (ret)
+        return ret;
+    *blocks = count;
+
+    ret = check_block_io(card, lba, iov, count);
+    if (ret || !count)
+        return ret;
+
+    if (iovcnt == 1)
+        return write_blocks(card, lba, iov->ptr, count);
+
+    sd_host_t *host = card->host;
+    if (!host->bus->submit_sg)
+        return rw_split(card, lba, iov, iovcnt, true);
+
+    card_idle(card);
+
+    // Pre-erase hint for the whole run, as in write_blocks
+    if (count > 1)
+        sd_set_wr_blk_erase_count(host, card, count);
+
+    // One CMD24/CMD25 for the whole transfer, the bus driver transmits straight from the segments
+    build_write_rq(card, lba, count, &rq);
+    ret = host->bus->submit_sg(host, &rq, &rs, iov, iovcnt);
+    if (ret)
+        return ret;
+
+    return r1_to_status(&rs);
+}
+
+sd_status_t sd_writev(sd_card_t *card, uint32_t lba, const sd_iovec_t *iov, uint32_t iovcnt)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    uint32_t start = sd_trace_now(card->host);
+    uint32_t count;
+    sd_status_t ret = write_iov(card, lba, iov, iovcnt, &count);
+    sd_trace_rec(card->host, SD_TRACE_WRITE, 0, lba, 0, trace_bytes(count), ret, start);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Body of sd_erase_range, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param lba_start Starting block
+ * @param lba_end Ending block, inclusive
+ * @return Status code
+ */
+static sd_status_t erase_range(sd_card_t *card, uint32_t lba_start, uint32_t lba_end)
+{
+    sd_status_t ret;
+    uint8_t status;
+
+    if (!card || !card->host || lba_end < lba_start)
+        return SD_ERR_PARAM;
+
+    // Only checked once the capacity is known
+    uint64_t blocks = card->capacity_bytes / SD_DEFAULT_BLOCK_LEN;
+    if (blocks && lba_end >= blocks)
+        return SD_ERR_PARAM;
+
+    sd_host_t *host = card->host;
+    card_idle(card);
+
+    // CMD32: ERASE_WR_BLK_START
+    ret = sd_erase_wr_blk(host, CMD_ERASE_WR_BLK_START, block_to_arg(card, lba_start));
+    if (ret)
+        return ret;
+
+    // CMD33: ERASE_WR_BLK_END
+    ret = sd_erase_wr_blk(host, CMD_ERASE_WR_BLK_END, block_to_arg(card, lba_end));
+    if (ret)
+        return ret;
+
+    // CMD38: ERASE
+    ret = sd_erase(host, erase_timeout_ms(card, lba_start, lba_end));
+    if (ret)
+        return ret;
+
+    // CMD13: SEND_STATUS
+    // Errors found while erasing are only reported in the status
+    ret = sd_send_status(host, card, &status);
+    if (ret)
+        return ret;
+
+    if (status & (R2_ERASE_PARAM_MASK | R2_OUT_OF_RANGE_MASK))
+        return SD_ERR_PARAM;
+
+    if (status & R2_WP_ERASE_SKIP_MASK)
+        return SD_ERR_LOCKED;
+
+    if (status & (R2_ERROR_MASK | R2_CC_ERROR_MASK | R2_CARD_ECC_MASK))
+        return SD_ERR_IO;
+
+    return SD_OK;
+}
+
+sd_status_t sd_erase_range(sd_card_t *card, uint32_t lba_start, uint32_t lba_end)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    uint32_t start = sd_trace_now(card->host);
+    sd_status_t ret = erase_range(card, lba_start, lba_end);
+    sd_trace_rec(card->host, SD_TRACE_ERASE, 0, lba_start, 0,
+                 trace_bytes((uint64_t)lba_end - lba_start + 1), ret, start);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Body of sd_discard, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param lba_start Starting block
+ * @param lba_end Ending block, inclusive
+ * @return Status code
+ */
+static sd_status_t discard_range(sd_card_t *card, uint32_t lba_start, uint32_t lba_end)
+{
+    if (!card || !card->host || lba_end < lba_start)
+        return SD_ERR_PARAM;
+
+    if (!card->au_blocks)
+        return SD_ERR_UNSUPPORTED;
+
+    // Shrinks the range to whole AUs, the blocks sharing an AU with data outside stay as they are
+    uint64_t au = card->au_blocks;
+    uint64_t first = ((uint64_t)lba_start + au - 1) / au * au;
+    uint64_t end = ((uint64_t)lba_end + 1) / au * au;
+
+    // Erases ERASE_SIZE AUs per CMD38, the unit the card's erase timeout is specified for
+    uint64_t step = (card->erase_size ? card->erase_size : 1) * au;
+
+    for (uint64_t lba = first; lba < end; lba += step)
+    {
+        uint64_t last = (lba + step < end ? lba + step : end) - 1;
+
+        sd_status_t ret = erase_range(card, (uint32_t)lba, (uint32_t)last);
+        if (ret)
+            return ret;
+    }
+
+    return SD_OK;
+}
+
+sd_status_t sd_discard(sd_card_t *card, uint32_t lba_start, uint32_t lba_end)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    uint32_t start = sd_trace_now(card->host);
+    sd_status_t ret = discard_range(card, lba_start, lba_end);
+    sd_trace_rec(card->host, SD_TRACE_DISCARD, 0, lba_start, 0,
+                 trace_bytes((uint64_t)lba_end - lba_start + 1), ret, start);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Body of sd_set_crc, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param enable Whether to check CRCs
+ * @return Status code
+ */
+static sd_status_t set_crc(sd_card_t *card, bool enable)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    sd_host_t *host = card->host;
+
+    // The native SD bus always checks CRCs
+    if (host->bus_kind != SD_BUS_SPI)
+        return enable ? SD_OK : SD_ERR_UNSUPPORTED;
+
+    card_idle(card);
+
+    sd_status_t ret = sd_crc_on_off(host, enable);
+    if (ret)
+        return ret;
+
+    card->crc_on = enable;
+    return SD_OK;
+}
+
+sd_status_t sd_set_crc(sd_card_t *card, bool enable)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    sd_status_t ret = set_crc(card, enable);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+/**
+ * @brief Body of sd_set_read_ahead, run with the host lock held
+ *
+ * @param card SD Card to operate on
+ * @param enable Whether to read ahead
+ * @return Status code
+ */
+static sd_status_t set_read_ahead(sd_card_t *card, bool enable)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    sd_host_t *host = card->host;
+    if (enable && (!host->bus->stream_read || !host->bus->stream_stop))
+        return SD_ERR_UNSUPPORTED;
+
+    if (!enable)
+        card_idle(card);
+
+    // Sequential access is detected afresh
+    card->read_ahead = enable;
+    card->seq_next = UINT32_MAX;
+    return SD_OK;
+}
+
+sd_status_t sd_set_read_ahead(sd_card_t *card, bool enable)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    host_lock(card->host);
+    sd_status_t ret = set_read_ahead(card, enable);
+    host_unlock(card->host);
+
+    return ret;
+}
+
+// === Asynchronous block i/o ===
+
+/**
+ * @brief Appends a request to the card's queue
+ *
+ * @param card SD Card
+ * @param req Request to queue
+ */
+static void async_enqueue(sd_card_t *card, sd_async_t *req)
+{
+    req->card = card;
+    req->status = SD_PENDING;
+    req->started = false;
+    req->next = NULL;
+
+    if (card->async_tail)
+        card->async_tail->next = req;
+    else
+        card->async_head = req;
+    card->async_tail = req;
+}
+
+/**
+ * @brief Hands a queued request to the bus driver
+ *
+ * @param card SD Card
+ * @param req Request to start
+ * @return SD_PENDING while in progress, otherwise the final status
+ */
+static sd_status_t async_start(sd_card_t *card, sd_async_t *req)
+{
+    sd_host_t *host = card->host;
+
+    req->started = true;
+    stream_close(card);
+
+    // Pre-erase hint, as for the synchronous write
+    if (req->rq.dir == SD_DATA_WRITE && req->rq.multi)
+        sd_set_wr_blk_erase_count(host, card, req->rq.blocks);
+
+    // Bus drivers without asynchronous support complete the request right away
+    if (!host->bus->submit_async)
+        return host->bus->submit(host, &req->rq, &req->rs, req->buf);
+
+    return host->bus->submit_async(host, &req->rq, &req->rs, req->buf);
+}
+
+sd_status_t sd_read_blocks_async(sd_card_t *card,
+                                 sd_async_t *req,
+                                 uint32_t lba,
+                                 void *buf,
+                                 uint32_t count,
+                                 sd_async_cb_t cb,
+                                 void *user)
+{
+    sd_status_t ret = check_block_io(card, lba, buf, count);
+    if (ret || !req || !count)
+        return ret ? ret : SD_ERR_PARAM;
+
+    host_lock(card->host);
+    build_read_rq(card, lba, count, &req->rq);
+    req->buf = buf;
+    req->cb = cb;
+    req->user = user;
+    async_enqueue(card, req);
+    host_unlock(card->host);
+
+    return SD_OK;
+}
+
+sd_status_t sd_write_blocks_async(sd_card_t *card,
+                                  sd_async_t *req,
+                                  uint32_t lba,
+                                  const void *buf,
+                                  uint32_t count,
+                                  sd_async_cb_t cb,
+                                  void *user)
+{
+    sd_status_t ret = check_block_io(card, lba, buf, count);
+    if (ret || !req || !count)
+        return ret ? ret : SD_ERR_PARAM;
+
+    host_lock(card->host);
+    build_write_rq(card, lba, count, &req->rq);
+    req->buf = (void *)buf;
+    req->cb = cb;
+    req->user = user;
+    async_enqueue(card, req);
+    host_unlock(card->host);
+
+    return SD_OK;
+}
+
+sd_status_t sd_poll(sd_card_t *card)
+{
+    sd_status_t ret;
+
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+    sd_host_t *host = card->host;
+    host_lock(host);
+
+    sd_async_t *req = card->async_head;
+    if (!req)
+    {
+        host_unlock(host);
+        return SD_OK;
+    }
+
+    // Starts the oldest request, or advances it
+    if (!req->started)
+        ret = async_start(card, req);
+    else if (host->bus->poll)
+        ret = host->bus->poll(host);
+    else
+        ret = SD_ERR_PROTO;
+
+    if (ret == SD_PENDING)
+    {
+        host_unlock(host);
+        return SD_PENDING;
+    }
+
+    // Checks whether the card rejected the command
+    if (!ret)
+        ret = r1_to_status(&req->rs);
+
+    // Dequeue before the callback, so it may queue follow up requests
+    card->async_head = req->next;
+    if (!card->async_head)
+        card->async_tail = NULL;
+
+    req->status = ret;
+    if (req->cb)
+        req->cb(req, ret, req->user);
+
+    ret = card->async_head ? SD_PENDING : SD_OK;
+    host_unlock(host);
+
+    return ret;
+}
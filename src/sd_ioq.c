@@ -0,0 +1,363 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_ioq.c
+ * @brief I/O queue with elevator scheduling, merges queued requests into long transfers
+ */
+
+#include "sd_ioq.h"
+
+#include "sd.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Time (us) a blocking call yields while another thread dispatches
+ */
+#define SD_IOQ_YIELD_US 10
+
+// ========== Helper Functions ==========
+
+/**
+ * @brief Takes the host lock guarding the queue, if the port provides one
+ *
+ * @param q Queue
+ */
+static void q_lock(sd_ioq_t *q)
+{
+    const sd_host_ops_t *ops = q->card->host->ops;
+
+    if (ops && ops->lock)
+        ops->lock(q->card->host);
+}
+
+/**
+ * @brief Releases the host lock guarding the queue
+ *
+ * @param q Queue
+ */
+static void q_unlock(sd_ioq_t *q)
+{
+    const sd_host_ops_t *ops = q->card->host->ops;
+
+    if (ops && ops->unlock)
+        ops->unlock(q->card->host);
+}
+
+/**
+ * @brief Whether two requests share a block
+ *
+ * @param a Request
+ * @param b Request
+ * @return Whether the ranges overlap
+ */
+static bool overlaps(const sd_ioq_req_t *a, const sd_ioq_req_t *b)
+{
+    return (uint64_t)a->lba < (uint64_t)b->lba + b->count &&
+           (uint64_t)b->lba < (uint64_t)a->lba + a->count;
+}
+
+/**
+ * @brief Whether a request has to wait for an older one it overlaps. Reads don't order against
+ * reads, and requests merged into the transfer being built are ordered by the merge itself
+ *
+ * @param q Queue
+ * @param r Request
+ * @return Whether the request can't be dispatched yet
+ */
+static bool blocked(sd_ioq_t *q, const sd_ioq_req_t *r)
+{
+    for (const sd_ioq_req_t *o = q->head; o != r; o = o->next)
+    {
+        if (o->in_batch || (!o->write && !r->write))
+            continue;
+
+        if (overlaps(o, r))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Next request of a direction for the elevator: the lowest dispatchable block at or after
+ * the position, wrapping around to the lowest one overall
+ *
+ * @param q Queue
+ * @param write Direction
+ * @return Request, NULL if none of that direction can be dispatched
+ */
+static sd_ioq_req_t *pick(sd_ioq_t *q, bool write)
+{
+    sd_ioq_req_t *ahead = NULL, *lowest = NULL;
+
+    for (sd_ioq_req_t *r = q->head; r; r = r->next)
+    {
+        if (r->write != write || blocked(q, r))
+            continue;
+
+        if (r->lba >= q->pos && (!ahead || r->lba < ahead->lba))
+            ahead = r;
+        if (!lowest || r->lba < lowest->lba)
+            lowest = r;
+    }
+
+    return ahead ? ahead : lowest;
+}
+
+/**
+ * @brief Merges queued requests into the transfer started by seed: requests of the same direction
+ * starting within or right after it, while the whole run fits the arena
+ *
+ * @param q Queue
+ * @param seed First request of the transfer
+ * @param end Output, block following the transfer
+ * @return Number of requests in the transfer
+ */
+static uint32_t build_batch(sd_ioq_t *q, sd_ioq_req_t *seed, uint32_t *end)
+{
+    uint32_t start = seed->lba;
+    uint32_t n = 1;
+    bool grown = true;
+
+    seed->in_batch = true;
+    *end = seed->lba + seed->count;
+
+    // Merging one request can unblock another that overlapped it, so repeat until nothing fits
+    while (grown)
+    {
+        grown = false;
+
+        for (sd_ioq_req_t *r = q->head; r; r = r->next)
+        {
+            if (r->in_batch || r->write != seed->write || r->lba < start || r->lba > *end)
+                continue;
+
+            uint32_t r_end = r->lba + r->count;
+            uint32_t new_end = r_end > *end ? r_end : *end;
+            if (new_end - start > q->arena_blocks || blocked(q, r))
+                continue;
+
+            r->in_batch = true;
+            *end = new_end;
+            n++;
+            grown = true;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * @brief Dispatches one transfer and completes the requests merged into it
+ *
+ * @param q Queue
+ * @return Whether this call dispatched, false if the queue was empty or another thread was
+ * dispatching
+ */
+static bool dispatch(sd_ioq_t *q)
+{
+    q_lock(q);
+
+    if (q->busy || !q->head)
+    {
+        q_unlock(q);
+        return false;
+    }
+
+    // Reads go first, until a write waited for write_starve read transfers
+    sd_ioq_req_t *rd = pick(q, false);
+    sd_ioq_req_t *wr = pick(q, true);
+    sd_ioq_req_t *seed = rd;
+
+    if (!rd || (wr && q->write_skips >= q->write_starve))
+        seed = wr;
+
+    if (seed == rd && wr)
+        q->write_skips++;
+    else if (seed == wr)
+        q->write_skips = 0;
+
+    uint32_t end;
+    uint32_t start = seed->lba;
+    uint32_t n = build_batch(q, seed, &end);
+    uint8_t *buf = n == 1 ? seed->buf : q->arena;
+
+    // Merged writes are copied in submission order, a newer write to a block wins
+    if (n > 1 && seed->write)
+    {
+        for (sd_ioq_req_t *r = q->head; r; r = r->next)
+        {
+            if (r->in_batch)
+                memcpy(q->arena + (size_t)(r->lba - start) * SD_IOQ_BLOCK_LEN, r->buf,
+                       (size_t)r->count * SD_IOQ_BLOCK_LEN);
+        }
+    }
+
+    q->busy = true;
+    q->pos = end;
+    q->transfers++;
+    q_unlock(q);
+
+    // One CMD18/CMD25 for the whole run, other threads may queue requests meanwhile
+    sd_status_t ret = seed->write ? sd_write_blocks(q->card, start, buf, end - start)
+                                  : sd_read_blocks(q->card, start, buf, end - start);
+
+    q_lock(q);
+
+    // Unlinks the merged requests, scattering the read data back out
+    sd_ioq_req_t *done = NULL, **tail = &done;
+    for (sd_ioq_req_t **link = &q->head; *link;)
+    {
+        sd_ioq_req_t *r = *link;
+        if (!r->in_batch)
+        {
+            link = &r->next;
+            continue;
+        }
+
+        if (n > 1 && !seed->write && !ret)
+            memcpy(r->buf, q->arena + (size_t)(r->lba - start) * SD_IOQ_BLOCK_LEN,
+                   (size_t)r->count * SD_IOQ_BLOCK_LEN);
+
+        *link = r->next;
+        r->in_batch = false;
+        r->next = NULL;
+        *tail = r;
+        tail = &r->next;
+    }
+
+    q->requests += n;
+    q->busy = false;
+    q_unlock(q);
+
+    // The status is set last, the owner may reuse the request once it changes. The release
+    // store orders the scattered read data before it
+    while (done)
+    {
+        sd_ioq_req_t *r = done;
+        done = r->next;
+
+        if (r->cb)
+            r->cb(r, ret, r->user);
+        atomic_store_explicit(&r->status, ret, memory_order_release);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Queues a request and dispatches until it completes
+ *
+ * @param q Queue
+ * @param req Request to run
+ * @return Status code
+ */
+static sd_status_t run(sd_ioq_t *q, sd_ioq_req_t *req)
+{
+    sd_status_t ret = sd_ioq_submit(q, req);
+    if (ret)
+        return ret;
+
+    const sd_host_ops_t *ops = q->card->host->ops;
+    while ((ret = atomic_load_explicit(&req->status, memory_order_acquire)) == SD_PENDING)
+    {
+        // Another thread is dispatching, possibly this very request
+        if (!dispatch(q) && ops && ops->delay_us)
+            ops->delay_us(SD_IOQ_YIELD_US);
+    }
+
+    return ret;
+}
+
+// ========== libsd API ==========
+
+sd_status_t sd_ioq_init(sd_ioq_t *q, sd_card_t *card, void *arena, uint32_t arena_blocks)
+{
+    if (!q || !card || !card->host || !arena || !arena_blocks)
+        return SD_ERR_PARAM;
+
+    // Merged blocks are 512 bytes, the card must use the same block length
+    if (card->block_len != SD_IOQ_BLOCK_LEN)
+        return SD_ERR_UNSUPPORTED;
+
+    memset(q, 0, sizeof(*q));
+    q->card = card;
+    q->arena = arena;
+    q->arena_blocks = arena_blocks;
+    q->write_starve = SD_IOQ_WRITE_STARVE_DEFAULT;
+
+    return SD_OK;
+}
+
+sd_status_t sd_ioq_submit(sd_ioq_t *q, sd_ioq_req_t *req)
+{
+    if (!q || !req || !req->buf || !req->count)
+        return SD_ERR_PARAM;
+
+    // A request past the end would fail every request merged with it
+    uint64_t blocks = q->card->capacity_bytes / SD_IOQ_BLOCK_LEN;
+    if (blocks && (uint64_t)req->lba + req->count > blocks)
+        return SD_ERR_PARAM;
+
+    // Published to the dispatcher by the queue lock
+    atomic_store_explicit(&req->status, SD_PENDING, memory_order_relaxed);
+    req->in_batch = false;
+    req->next = NULL;
+
+    q_lock(q);
+
+    sd_ioq_req_t **link = &q->head;
+    while (*link)
+        link = &(*link)->next;
+    *link = req;
+
+    q_unlock(q);
+
+    return SD_OK;
+}
+
+sd_status_t sd_ioq_poll(sd_ioq_t *q)
+{
+    if (!q)
+        return SD_ERR_PARAM;
+
+    dispatch(q);
+
+    // Other threads may be queuing or dispatching
+    q_lock(q);
+    bool pending = q->head != NULL;
+    q_unlock(q);
+
+    return pending ? SD_PENDING : SD_OK;
+}
+
+sd_status_t sd_ioq_read(sd_ioq_t *q, uint32_t lba, void *buf, uint32_t count)
+{
+    if (!q)
+        return SD_ERR_PARAM;
+
+    if (!count)
+        return SD_OK;
+
+    sd_ioq_req_t req = {.lba = lba, .count = count, .buf = buf, .write = false};
+    return run(q, &req);
+}
+
+sd_status_t sd_ioq_write(sd_ioq_t *q, uint32_t lba, const void *buf, uint32_t count)
+{
+    if (!q)
+        return SD_ERR_PARAM;
+
+    if (!count)
+        return SD_OK;
+
+    sd_ioq_req_t req = {.lba = lba, .count = count, .buf = (void *)buf, .write = true};
+    return run(q, &req);
+}
@@ -0,0 +1,759 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_sdmmc.c
+ * @brief Native SD Bus Logic (1-bit and 4-bit)
+ */
+
+#include "bus/sd_sdmmc.h"
+
+#include "sd_crc.h"
+#include "sd_defines.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <string.h>
+
+// ========= Helper Functions =========
+
+/**
+ * @brief Deadline of a polling loop
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Time polling started (us)
+     */
+    uint64_t start;
+
+    /**
+     * @brief Time polling gives up (us)
+     */
+    uint64_t deadline;
+
+    /**
+     * @brief Without a time source: polls left before yielding
+     */
+    uint32_t spins;
+
+    /**
+     * @brief Without a time source: 1ms sleeps left before giving up
+     */
+    uint32_t sleeps;
+} poll_t;
+
+/**
+ * @brief Starts a polling deadline
+ *
+ * @param ctx Private SD bus context
+ * @param p Deadline to initialize
+ * @param timeout_ms Timeout in ms
+ */
+static void poll_start(sdmmc_ctx_t *ctx, poll_t *p, uint32_t timeout_ms)
+{
+    const sd_host_ops_t *ops = ctx->host->ops;
+
+    p->start = (ops && ops->get_time_us) ? ops->get_time_us() : 0;
+    p->deadline = p->start + (uint64_t)timeout_ms * 1000;
+    p->spins = SD_POLL_SPIN_COUNT;
+    p->sleeps = timeout_ms;
+}
+
+/**
+ * @brief Called after an unsuccessful poll. Spins for SD_POLL_SPIN_US, then yields between polls
+ *
+ * @param ctx Private SD bus context
+ * @param p Deadline
+ * @return Whether to keep polling, false once the deadline passed
+ */
+static bool poll_again(sdmmc_ctx_t *ctx, poll_t *p)
+{
+    const sd_host_ops_t *ops = ctx->host->ops;
+
+    if (ops && ops->get_time_us)
+    {
+        uint64_t now = ops->get_time_us();
+        if (now >= p->deadline)
+            return false;
+
+        if (now - p->start >= SD_POLL_SPIN_US)
+        {
+            if (ops->delay_us)
+                ops->delay_us(SD_POLL_YIELD_US);
+            else if (ops->delay_ms)
+                ops->delay_ms(1);
+        }
+        return true;
+    }
+
+    // No time source, spin a bounded number of polls then count 1ms sleeps. A poll is a single
+    // clock cycle here, so the spin budget is renewed after every sleep
+    if (p->spins)
+    {
+        p->spins--;
+        return true;
+    }
+
+    if (!p->sleeps)
+        return false;
+
+    p->sleeps--;
+    p->spins = SD_POLL_SPIN_COUNT;
+    if (ops && ops->delay_ms)
+        ops->delay_ms(1);
+    return true;
+}
+
+/**
+ * @brief Constructs a command frame, identical on the SD bus and in SPI mode
+ *
+ * @param f Frame to populate
+ * @param cmd Command index
+ * @param arg Command argument
+ */
+static void build_frame(uint8_t f[6], uint8_t cmd, uint32_t arg)
+{
+    cmd &= 0x3F;
+
+    f[0] = (uint8_t)(0x40 | cmd);
+    f[1] = (arg >> 24) & 0xFF;
+    f[2] = (arg >> 16) & 0xFF;
+    f[3] = (arg >> 8) & 0xFF;
+    f[4] = (arg) & 0xFF;
+    f[5] = (uint8_t)((sd_crc7(f, 5) << 1) | 0x01);
+}
+
+/**
+ * @brief Maps a card status to the equivalent SPI R1 bits, so the core handles both buses alike.
+ * ILLEGAL_COMMAND and COM_CRC_ERROR are left out: on the SD bus they describe the previous
+ * command, the failing one gets no response at all
+ *
+ * @param cs Card status
+ * @return R1 bits
+ */
+static uint8_t cs_to_r1(uint32_t cs)
+{
+    uint8_t r1 = 0;
+
+    if (CS_CURRENT_STATE(cs) == CS_STATE_IDLE)
+        r1 |= R1_IDLE_MASK;
+    if (cs & CS_ERASE_RESET)
+        r1 |= R1_ERASE_RESET_MASK;
+    if (cs & CS_ERASE_SEQ_ERROR)
+        r1 |= R1_ERASE_SEQ_MASK;
+    if (cs & CS_ADDRESS_ERROR)
+        r1 |= R1_ADDRESS_MASK;
+    if (cs & (CS_OUT_OF_RANGE | CS_BLOCK_LEN_ERROR | CS_ERASE_PARAM))
+        r1 |= R1_PARAM_MASK;
+
+    return r1;
+}
+
+/**
+ * @brief Level of DAT0 in one sampled clock cycle
+ *
+ * @param ctx Private SD bus context
+ * @param buf Sampled cycles
+ * @param cycle Cycle index
+ * @return Whether DAT0 was high
+ */
+static bool cycle_dat0(sdmmc_ctx_t *ctx, const uint8_t *buf, size_t cycle)
+{
+    // DAT0 is the last of the lines sampled in a cycle
+    size_t bit = cycle * ctx->width + ctx->width - 1;
+    return (buf[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+/**
+ * @brief Position in the data segments of a transfer
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Current segment
+     */
+    const sd_iovec_t *iov;
+
+    /**
+     * @brief Segments left, the current one included
+     */
+    uint32_t left;
+
+    /**
+     * @brief Bytes of the current segment already transferred
+     */
+    size_t off;
+} iov_cursor_t;
+
+/**
+ * @brief Takes the next contiguous piece, up to a length. Exhausted and empty segments are
+ * skipped
+ *
+ * @param c Cursor, advanced past the piece
+ * @param n Most bytes to take
+ * @param p Output, start of the piece
+ * @return Length of the piece, 0 once the segments are exhausted
+ */
+static size_t iov_piece(iov_cursor_t *c, size_t n, uint8_t **p)
+{
+    while (c->left && c->off == c->iov->len)
+    {
+        c->iov++;
+        c->left--;
+        c->off = 0;
+    }
+    if (!c->left)
+        return 0;
+
+    size_t len = c->iov->len - c->off < n ? c->iov->len - c->off : n;
+    *p = (uint8_t *)c->iov->ptr + c->off;
+    c->off += len;
+    return len;
+}
+
+/**
+ * @brief CRC16 of a data block in the form it is clocked out after the block: one CRC over the
+ * whole block on a 1-bit bus, one CRC per DAT line on a 4-bit bus
+ *
+ * @param ctx Private SD bus context
+ * @param c Cursor at the block, taken by value. The block may straddle segments
+ * @param n Block length, a multiple of 4 bytes
+ * @param out Output, 16 cycles of CRC (2 bytes on a 1-bit bus, 8 on a 4-bit bus)
+ */
+static void data_crc(sdmmc_ctx_t *ctx, iov_cursor_t c, size_t n, uint8_t out[8])
+{
+    uint8_t *p;
+
+    if (ctx->width == 1)
+    {
+        uint16_t crc = 0;
+        for (size_t len; n && (len = iov_piece(&c, n, &p)); n -= len)
+            crc = sd_crc16(crc, p, len);
+        out[0] = crc >> 8;
+        out[1] = crc & 0xFF;
+        return;
+    }
+
+    // Every byte is two cycles, DATk carries bits 4+k and k. The bits of each line are gathered
+    // into a byte per 4 block bytes, then run through the table driven CRC. The 4 bytes are
+    // staged in q, a group may straddle segments
+    uint16_t crc[4] = {0};
+    uint8_t lines[4][32];
+    uint8_t q[4];
+    size_t fill = 0, qn = 0;
+
+    for (size_t len; n && (len = iov_piece(&c, n, &p)); n -= len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            q[qn++] = p[i];
+            if (qn < sizeof(q))
+                continue;
+            qn = 0;
+
+            for (unsigned k = 0; k < 4; k++)
+            {
+                uint8_t v = 0;
+                for (unsigned j = 0; j < 4; j++)
+                    v = (uint8_t)((v << 2) | (((q[j] >> (4 + k)) & 1) << 1) | ((q[j] >> k) & 1));
+                lines[k][fill] = v;
+            }
+
+            if (++fill == sizeof(lines[0]) || (len == n && i + 1 == len))
+            {
+                for (unsigned k = 0; k < 4; k++)
+                    crc[k] = sd_crc16(crc[k], lines[k], fill);
+                fill = 0;
+            }
+        }
+    }
+
+    // Cycle c carries bit 15-c of every line's CRC, two cycles per byte
+    memset(out, 0, 8);
+    for (unsigned c = 0; c < 16; c++)
+    {
+        uint8_t nibble = 0;
+        for (unsigned k = 0; k < 4; k++)
+            nibble |= ((crc[k] >> (15 - c)) & 1) << k;
+        out[c / 2] |= (c % 2) ? nibble : (uint8_t)(nibble << 4);
+    }
+}
+
+/**
+ * @brief Clocks the DAT lines until DAT0 reaches a level
+ *
+ * @param ctx Private SD bus context
+ * @param high Level to wait for, low for a start bit, high for the end of busy
+ * @param timeout_ms Timeout in ms
+ * @return Status code
+ */
+static sd_status_t wait_dat0(sdmmc_ctx_t *ctx, bool high, uint32_t timeout_ms)
+{
+    poll_t p;
+    uint8_t b;
+    uint32_t polls = 0;
+    uint64_t start = sd_stats_now(ctx->host);
+    sd_status_t ret = SD_ERR_TIMEOUT;
+
+    poll_start(ctx, &p, timeout_ms);
+
+    do
+    {
+        polls++;
+        ctx->sdmmc->dat_lines(ctx->host, NULL, &b, 1);
+        if (cycle_dat0(ctx, &b, 0) == high)
+        {
+            ret = SD_OK;
+            break;
+        }
+    } while (poll_again(ctx, &p));
+
+    // Waiting for DAT0 to go high is waiting out busy
+    if (high)
+        sd_stats_busy(ctx->host, start, polls);
+
+    return ret;
+}
+
+/**
+ * @brief Transmits a command and receives its response on the CMD line
+ *
+ * @param ctx Private SD bus context
+ * @param rq Request to send
+ * @param out Output response
+ * @return Status code
+ */
+static sd_status_t send_cmd(sdmmc_ctx_t *ctx, const sd_request_t *rq, sd_response_t *out)
+{
+    const sd_sdmmc_ops_t *ops = ctx->sdmmc;
+    sd_host_t *host = ctx->host;
+    uint8_t f[6];
+    uint8_t r[17];
+    uint8_t b = 0xFF;
+
+    memset(out, 0, sizeof(*out));
+
+    // Write the command
+    build_frame(f, rq->cmd, rq->arg);
+    ops->cmd_line(host, f, NULL, 48);
+    host->last_cmd = rq->cmd;
+
+    if (rq->resp == SD_RESP_NONE)
+    {
+        ops->cmd_line(host, NULL, NULL, SD_NRC);
+        return SD_OK;
+    }
+
+    // The response starts with a start bit within NCR cycles
+    uint64_t start = sd_stats_now(host);
+    uint32_t polls = 0;
+    while (polls < SD_NCR_MAX && (b & 0x80))
+    {
+        ops->cmd_line(host, NULL, &b, 1);
+        polls++;
+    }
+    sd_stats_r1(host, start, polls);
+
+    if (b & 0x80)
+    {
+        out->r1 = 0xFF;
+        return SD_ERR_TIMEOUT;
+    }
+
+    // R2 is 136 bits, every other response 48. The start bit completes the first byte
+    size_t len = (rq->resp == SD_RESP_R2) ? 17 : 6;
+    ops->cmd_line(host, NULL, &b, 7);
+    r[0] = b >> 1;
+    ops->cmd_line(host, NULL, r + 1, (len - 1) * 8);
+
+    // Gap before the next command
+    ops->cmd_line(host, NULL, NULL, SD_NRC);
+
+    // Transmission bit must be 0 (card to host), end bit 1
+    if ((r[0] & 0x40) || !(r[len - 1] & 0x01))
+        return SD_ERR_PROTO;
+
+    uint32_t payload =
+        ((uint32_t)r[1] << 24) | ((uint32_t)r[2] << 16) | ((uint32_t)r[3] << 8) | r[4];
+
+    switch (rq->resp)
+    {
+    case SD_RESP_R2:
+        // CID/CSD including their own CRC7, r[3] holds the most significant word
+        if ((r[16] >> 1) != sd_crc7(r + 1, 15))
+            return SD_ERR_CRC;
+        for (unsigned i = 0; i < 4; i++)
+            out->r[3 - i] = ((uint32_t)r[1 + 4 * i] << 24) | ((uint32_t)r[2 + 4 * i] << 16) |
+                            ((uint32_t)r[3 + 4 * i] << 8) | r[4 + 4 * i];
+        return SD_OK;
+
+    case SD_RESP_R3:
+        // OCR, without CRC. The card is still initializing while the busy bit is clear
+        out->r[0] = payload;
+        out->r1 = (payload & 0x80000000) ? 0 : R1_IDLE_MASK;
+        return SD_OK;
+
+    default:
+        break;
+    }
+
+    if ((r[5] >> 1) != sd_crc7(r, 5))
+        return SD_ERR_CRC;
+    if ((r[0] & 0x3F) != (rq->cmd & 0x3F))
+        return SD_ERR_PROTO;
+
+    out->r[0] = payload;
+
+    if (rq->resp == SD_RESP_R6)
+    {
+        // RCA in the upper half, card status bits 23, 22, 19 and 12:0 in the lower
+        uint32_t cs = (payload & 0x1FFF) | ((payload & 0x2000) << 6) | ((payload & 0xC000) << 8);
+        out->r1 = cs_to_r1(cs);
+    }
+    else if (rq->resp == SD_RESP_R1 || rq->resp == SD_RESP_R1B)
+    {
+        out->r1 = cs_to_r1(payload);
+    }
+
+    // R1b: the card holds DAT0 low while busy
+    if (rq->resp == SD_RESP_R1B && !(out->r1 & R1_ERROR_MASK))
+        return wait_dat0(ctx, true, rq->timeout_ms ? rq->timeout_ms : TIMEOUT_SD_DEFAULT);
+
+    return SD_OK;
+}
+
+/**
+ * @brief Sends a CMD12 (STOP_TRANSMISSION) to end a multi-block transfer
+ *
+ * @param ctx Private SD bus context
+ * @param timeout_ms Longest time the card may stay busy afterwards
+ * @return Status code
+ */
+static sd_status_t stop_transmission(sdmmc_ctx_t *ctx, uint32_t timeout_ms)
+{
+    sd_request_t rq = {.cmd = CMD_STOP_TRANSMISSION, .resp = SD_RESP_R1B, .timeout_ms = timeout_ms};
+    sd_response_t rs;
+
+    sd_status_t ret = send_cmd(ctx, &rq, &rs);
+    if (ret)
+        return ret;
+
+    return (rs.r1 & R1_ERROR_MASK) ? SD_ERR_IO : SD_OK;
+}
+
+/**
+ * @brief Receives one data block and verifies its CRC. A block straddling segments is clocked in
+ * piece by piece
+ *
+ * @param ctx Private SD bus context
+ * @param cur Cursor at the destination of the block, advanced past it
+ * @param n Block length
+ * @param timeout_ms Timeout waiting for the start bit
+ * @return Status code
+ */
+static sd_status_t recv_block(sdmmc_ctx_t *ctx, iov_cursor_t *cur, size_t n, uint32_t timeout_ms)
+{
+    const sd_sdmmc_ops_t *ops = ctx->sdmmc;
+    iov_cursor_t blk = *cur;
+    uint8_t crc[8], expect[8], end;
+    uint8_t *p;
+
+    sd_status_t ret = wait_dat0(ctx, false, timeout_ms);
+    if (ret)
+        return ret;
+
+    // Block, 16 cycles of CRC and the end bit
+    for (size_t left = n, len; left; left -= len)
+    {
+        len = iov_piece(cur, left, &p);
+        if (!len)
+            return SD_ERR_PARAM;
+        ops->dat_lines(ctx->host, NULL, p, len * 8 / ctx->width);
+    }
+    ops->dat_lines(ctx->host, NULL, crc, 16);
+    ops->dat_lines(ctx->host, NULL, &end, 1);
+
+    if (!cycle_dat0(ctx, &end, 0))
+        return SD_ERR_PROTO;
+
+    data_crc(ctx, blk, n, expect);
+    if (memcmp(crc, expect, ctx->width * 2))
+        return SD_ERR_CRC;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Transmits one data block, checks its CRC status token and waits out busy. A block
+ * straddling segments is clocked out piece by piece
+ *
+ * @param ctx Private SD bus context
+ * @param cur Cursor at the block to transmit, advanced past it
+ * @param n Block length
+ * @param timeout_ms Longest time the card may stay busy programming the block
+ * @return Status code
+ */
+static sd_status_t send_block(sdmmc_ctx_t *ctx, iov_cursor_t *cur, size_t n, uint32_t timeout_ms)
+{
+    const sd_sdmmc_ops_t *ops = ctx->sdmmc;
+    uint8_t crc[8];
+    uint8_t start = 0x00, end = 0xFF;
+    uint8_t status[2];
+    uint8_t *p;
+
+    data_crc(ctx, *cur, n, crc);
+
+    // Gap, start bit, the block, 16 cycles of CRC and the end bit
+    ops->dat_lines(ctx->host, NULL, NULL, SD_NWR);
+    ops->dat_lines(ctx->host, &start, NULL, 1);
+    for (size_t left = n, len; left; left -= len)
+    {
+        len = iov_piece(cur, left, &p);
+        if (!len)
+            return SD_ERR_PARAM;
+        ops->dat_lines(ctx->host, p, NULL, len * 8 / ctx->width);
+    }
+    ops->dat_lines(ctx->host, crc, NULL, 16);
+    ops->dat_lines(ctx->host, &end, NULL, 1);
+
+    // CRC status on DAT0: start bit, 3 status bits and an end bit
+    sd_status_t ret = wait_dat0(ctx, false, timeout_ms);
+    if (ret)
+        return ret;
+
+    ops->dat_lines(ctx->host, NULL, status, 4);
+
+    uint8_t token = 0;
+    for (unsigned c = 0; c < 3; c++)
+        token = (uint8_t)((token << 1) | cycle_dat0(ctx, status, c));
+
+    if (token != 0x2)
+        return (token == 0x5) ? SD_ERR_CRC : SD_ERR_IO;
+
+    // The card holds DAT0 low while programming the block
+    return wait_dat0(ctx, true, timeout_ms);
+}
+
+/**
+ * @brief Receives the data blocks of a read straight into the destination segments
+ *
+ * @param ctx Private SD bus context
+ * @param rq Request being serviced
+ * @param cur Cursor over the destination segments, blocks * block_size bytes
+ * @return Status code
+ */
+static sd_status_t read_data(sdmmc_ctx_t *ctx, const sd_request_t *rq, iov_cursor_t *cur)
+{
+    uint32_t t = rq->timeout_ms ? rq->timeout_ms : TIMEOUT_READ_BLOCK;
+    sd_status_t ret = SD_OK;
+
+    for (uint32_t i = 0; i < rq->blocks; i++)
+    {
+        ret = recv_block(ctx, cur, rq->block_size, t);
+        if (ret)
+            break;
+    }
+
+    // A multi-block read streams until stopped, even when it failed part way through
+    if (rq->multi)
+    {
+        sd_status_t stop = stop_transmission(ctx, TIMEOUT_STOP_TRANSMISSION);
+        if (!ret)
+            ret = stop;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Transmits the data blocks of a write, handling CRC status and busy
+ *
+ * @param ctx Private SD bus context
+ * @param rq Request being serviced
+ * @param cur Cursor over the source segments, blocks * block_size bytes
+ * @return Status code
+ */
+static sd_status_t write_data(sdmmc_ctx_t *ctx, const sd_request_t *rq, iov_cursor_t *cur)
+{
+    uint32_t t = rq->timeout_ms ? rq->timeout_ms : TIMEOUT_WRITE_BLOCK;
+    sd_status_t ret = SD_OK;
+
+    for (uint32_t i = 0; i < rq->blocks; i++)
+    {
+        ret = send_block(ctx, cur, rq->block_size, t);
+        if (ret)
+            break;
+    }
+
+    // A multi-block write is ended by CMD12, even when it failed part way through
+    if (rq->multi)
+    {
+        sd_status_t stop = stop_transmission(ctx, t);
+        if (!ret)
+            ret = stop;
+    }
+
+    return ret;
+}
+
+// ========== Bus Ops ==========
+// Implements required bus driver functions for the sd_bus_vtbl_t vtable/optable
+
+/**
+ * @brief Sets the bus clock rate
+ *
+ * @param host SD Card Host Controller
+ * @param hz Clock frequency
+ * @return Status code
+ */
+sd_status_t sdmmc_set_clock(sd_host_t *host, uint32_t hz)
+{
+    sdmmc_ctx_t *ctx = host->bus_ctx;
+    ctx->sdmmc->set_clock(host, hz);
+
+    return SD_OK;
+}
+
+/**
+ * @brief Sets the number of DAT lines used, once the card was switched with ACMD6
+ *
+ * @param host SD Card Host Controller
+ * @param bits Bus width, 1 or 4
+ * @return Status code
+ */
+sd_status_t sdmmc_set_width(sd_host_t *host, int bits)
+{
+    sdmmc_ctx_t *ctx = host->bus_ctx;
+
+    if (bits != 1 && bits != 4)
+        return SD_ERR_PARAM;
+    if (bits == 4 && !host->supports_4bit)
+        return SD_ERR_UNSUPPORTED;
+
+    ctx->sdmmc->set_width(host, bits);
+    ctx->width = (uint8_t)bits;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Body of sdmmc_submit and sdmmc_submit_sg
+ *
+ * @param host SD Card Host Controller
+ * @param rq Request to submit
+ * @param out Output response
+ * @param iov Data segments
+ * @param iovcnt Number of segments, 0 without a data phase
+ * @return Status code
+ */
+static sd_status_t submit_iov(sd_host_t *host,
+                              const sd_request_t *rq,
+                              sd_response_t *out,
+                              const sd_iovec_t *iov,
+                              uint32_t iovcnt)
+{
+    sdmmc_ctx_t *ctx = host->bus_ctx;
+
+    uint64_t start = sd_stats_now(host);
+    uint32_t trace_start = sd_trace_now(host);
+    sd_status_t ret = send_cmd(ctx, rq, out);
+
+    // Data phase on the DAT lines, skipped if the card rejected the command
+    if (!ret && iovcnt && rq->blocks && !(out->r1 & R1_ERROR_MASK))
+    {
+        iov_cursor_t cur = {.iov = iov, .left = iovcnt};
+
+        if (rq->dir == SD_DATA_READ)
+            ret = read_data(ctx, rq, &cur);
+        else if (rq->dir == SD_DATA_WRITE)
+            ret = write_data(ctx, rq, &cur);
+    }
+
+    // A rejected command is counted as failed
+    sd_status_t final = (!ret && (out->r1 & R1_ERROR_MASK)) ? SD_ERR_IO : ret;
+    sd_stats_cmd(host, rq, final, start);
+    sd_trace_cmd(host, rq, out->r1, final, trace_start);
+
+    return ret;
+}
+
+/**
+ * @brief Submit a request and transmits the command over the SD bus
+ *
+ * @param host SD Card Host Controller
+ * @param rq Request to submit
+ * @param out Output response
+ * @param data_buf Buffer to store data if any
+ * @return Status code
+ */
+sd_status_t sdmmc_submit(sd_host_t *host,
+                         const sd_request_t *rq,
+                         sd_response_t *out,
+                         void *data_buf)
+{
+    // Checks if a request and response is provided
+    if (!rq || !out)
+        return SD_ERR_PARAM;
+
+    sd_iovec_t iov = {.ptr = data_buf, .len = (size_t)rq->blocks * rq->block_size};
+    return submit_iov(host, rq, out, &iov, data_buf ? 1 : 0);
+}
+
+/**
+ * @brief Submit a request whose data phase is scattered over segments, in one command. The
+ * pieces of a block straddling segments are clocked one after the other
+ *
+ * @param host SD Card Host Controller
+ * @param rq Request to submit
+ * @param out Output response
+ * @param iov Data segments, blocks * block_size bytes in total
+ * @param iovcnt Number of segments
+ * @return Status code
+ */
+sd_status_t sdmmc_submit_sg(sd_host_t *host,
+                            const sd_request_t *rq,
+                            sd_response_t *out,
+                            const sd_iovec_t *iov,
+                            uint32_t iovcnt)
+{
+    if (!rq || !out || (iovcnt && !iov))
+        return SD_ERR_PARAM;
+
+    return submit_iov(host, rq, out, iov, iovcnt);
+}
+
+// ========== SD Bus Ops binding and Init ==========
+
+/**
+ * @brief vtable/op table for the bus driver
+ */
+static const sd_bus_vtbl_t SDMMC_VTBL = {.set_clock = sdmmc_set_clock,
+                                         .set_bus_width = sdmmc_set_width,
+                                         .submit = sdmmc_submit,
+                                         .submit_sg = sdmmc_submit_sg};
+
+void sd_bind_sdmmc_transport(sd_host_t *host,
+                             const sd_sdmmc_ops_t *ops,
+                             sdmmc_ctx_t *ctx,
+                             bool supports_4bit)
+{
+    // Initializes the host's SD bus context, used by bus logic.
+    // Sets MCU specific line hooks
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->host = host;
+    ctx->sdmmc = ops;
+    ctx->width = 1;
+
+    // Initializes host for the SD bus, sets the vtable and private context. Cards always start
+    // out on DAT0 only
+    host->bus_kind = SD_BUS_SDMMC;
+    host->bus = &SDMMC_VTBL;
+    host->bus_ctx = (void *)ctx;
+    host->supports_4bit = supports_4bit;
+    host->supports_1v8 = false;
+
+    ops->set_width(host, 1);
+}
@@ -8,35 +8,1055 @@
 
 #include "bus/sd_spi.h"
 
+#include "sd_crc.h"
 #include "sd_defines.h"
 #include "sd_host.h"
 #include "sd_types.h"
 
+#include <string.h>
+
 // ========= Helper Functions =========
 
 /**
- * @brief Waits for a R1 response from the card
+ * @brief Full-duplex transfer, through the port's bulk op if provided, byte by byte otherwise
+ *
+ * @param spi_ctx Private SPI context
+ * @param tx Bytes to transmit, NULL to transmit fill
+ * @param rx Buffer for received bytes, NULL to discard them
+ * @param n Number of bytes
+ * @param fill Byte transmitted when tx is NULL
+ */
+static void spi_xfer(spi_ctx_t *spi_ctx, const uint8_t *tx, uint8_t *rx, size_t n, uint8_t fill)
+{
+    if (spi_ctx->spi->xfer)
+    {
+        spi_ctx->spi->xfer(spi_ctx->host, tx, rx, n, fill);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t v = spi_ctx->spi->xchg1(spi_ctx->host, tx ? tx[i] : fill);
+        if (rx)
+            rx[i] = v;
+    }
+}
+
+/**
+ * @brief Discards bytes clocked in ahead of the parser. Done before transmitting anything the
+ * card interprets, as those bytes were only idle/stream filler
+ *
+ * @param spi_ctx Private SPI context
+ */
+static void rx_drop(spi_ctx_t *spi_ctx)
+{
+    spi_ctx->rx_head = 0;
+    spi_ctx->rx_len = 0;
+}
+
+/**
+ * @brief Returns the next received byte, clocking in a chunk when the lookahead is empty
+ *
+ * @param spi_ctx Private SPI context
+ * @param chunk Bytes to clock in at once if the lookahead is empty
+ * @return Received byte
+ */
+static uint8_t rx_next(spi_ctx_t *spi_ctx, size_t chunk)
+{
+    if (!spi_ctx->rx_len)
+    {
+        spi_xfer(spi_ctx, NULL, spi_ctx->rx_buf, chunk, 0xFF);
+        spi_ctx->rx_head = 0;
+        spi_ctx->rx_len = chunk;
+    }
+
+    spi_ctx->rx_len--;
+    return spi_ctx->rx_buf[spi_ctx->rx_head++];
+}
+
+/**
+ * @brief Receives N bytes, taking what was already clocked in before reading the rest directly
+ *
+ * @param spi_ctx Private SPI context
+ * @param dst Destination buffer
+ * @param n Number of bytes
+ */
+static void rx_recv(spi_ctx_t *spi_ctx, uint8_t *dst, size_t n)
+{
+    size_t have = spi_ctx->rx_len < n ? spi_ctx->rx_len : n;
+
+    memcpy(dst, spi_ctx->rx_buf + spi_ctx->rx_head, have);
+    spi_ctx->rx_head += have;
+    spi_ctx->rx_len -= have;
+
+    if (n > have)
+        spi_ctx->spi->read_ff(spi_ctx->host, dst + have, n - have);
+}
+
+/**
+ * @brief Transmits N bytes
+ *
+ * @param spi_ctx Private SPI context
+ * @param src Source buffer
+ * @param n Number of bytes
+ */
+static void tx_send(spi_ctx_t *spi_ctx, const uint8_t *src, size_t n)
+{
+    rx_drop(spi_ctx);
+    spi_ctx->spi->write(spi_ctx->host, src, n);
+}
+
+/**
+ * @brief Transfers segments back to back, chained by the port if it can
+ *
+ * @param spi_ctx Private SPI context
+ * @param segs Segments
+ * @param count Number of segments
+ */
+static void spi_chain(spi_ctx_t *spi_ctx, const sd_spi_seg_t *segs, size_t count)
+{
+    if (!count)
+        return;
+
+    if (spi_ctx->spi->xfer_chain && sd_spi_chain_dir(segs, count) != SD_SPI_CHAIN_INVALID)
+    {
+        spi_ctx->spi->xfer_chain(spi_ctx->host, segs, count);
+        return;
+    }
+
+    // No chaining, each segment goes through the matching plain op
+    for (size_t i = 0; i < count; i++)
+    {
+        const sd_spi_seg_t *seg = &segs[i];
+
+        if (!seg->tx && seg->rx && seg->fill == 0xFF)
+            spi_ctx->spi->read_ff(spi_ctx->host, seg->rx, seg->len);
+        else if (seg->tx && !seg->rx)
+            spi_ctx->spi->write(spi_ctx->host, seg->tx, seg->len);
+        else
+            spi_xfer(spi_ctx, seg->tx, seg->rx, seg->len, seg->fill);
+    }
+}
+
+/**
+ * @brief Receives into several buffers back to back, taking what was already clocked in first
+ *
+ * @param spi_ctx Private SPI context
+ * @param segs Receive segments, advanced past the bytes taken from the lookahead
+ * @param count Number of segments
+ */
+static void rx_recv_chain(spi_ctx_t *spi_ctx, sd_spi_seg_t *segs, size_t count)
+{
+    size_t first = 0;
+
+    while (first < count && spi_ctx->rx_len)
+    {
+        sd_spi_seg_t *seg = &segs[first];
+        size_t have = spi_ctx->rx_len < seg->len ? spi_ctx->rx_len : seg->len;
+
+        memcpy(seg->rx, spi_ctx->rx_buf + spi_ctx->rx_head, have);
+        spi_ctx->rx_head += have;
+        spi_ctx->rx_len -= have;
+
+        seg->rx += have;
+        seg->len -= have;
+        if (!seg->len)
+            first++;
+    }
+
+    spi_chain(spi_ctx, segs + first, count - first);
+}
+
+/**
+ * @brief Transmits several buffers back to back
+ *
+ * @param spi_ctx Private SPI context
+ * @param segs Transmit segments
+ * @param count Number of segments
+ */
+static void tx_send_chain(spi_ctx_t *spi_ctx, const sd_spi_seg_t *segs, size_t count)
+{
+    rx_drop(spi_ctx);
+    spi_chain(spi_ctx, segs, count);
+}
+
+// Pieces of a scattered block transferred in one chain, more take further chains
+#define SG_CHAIN_SEGS 8
+
+/**
+ * @brief Position in the segments of a scatter-gather transfer
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Current segment
+     */
+    const sd_iovec_t *iov;
+
+    /**
+     * @brief Segments left, the current one included
+     */
+    uint32_t left;
+
+    /**
+     * @brief Bytes of the current segment already transferred
+     */
+    size_t off;
+} iov_cursor_t;
+
+/**
+ * @brief Moves a cursor past exhausted and empty segments
+ *
+ * @param c Cursor
+ */
+static void iov_skip(iov_cursor_t *c)
+{
+    while (c->left && c->off == c->iov->len)
+    {
+        c->iov++;
+        c->left--;
+        c->off = 0;
+    }
+}
+
+/**
+ * @brief Takes a whole block, if the current segment holds one
+ *
+ * @param c Cursor, advanced past the block if taken
+ * @param n Block length
+ * @return Start of the block, NULL if it straddles segments
+ */
+static uint8_t *iov_block(iov_cursor_t *c, size_t n)
+{
+    iov_skip(c);
+    if (!c->left || c->iov->len - c->off < n)
+        return NULL;
+
+    uint8_t *p = (uint8_t *)c->iov->ptr + c->off;
+    c->off += n;
+    return p;
+}
+
+/**
+ * @brief Takes the next contiguous piece, up to a length
+ *
+ * @param c Cursor, advanced past the piece
+ * @param n Most bytes to take
+ * @param p Output, start of the piece
+ * @return Length of the piece, 0 once the segments are exhausted
+ */
+static size_t iov_piece(iov_cursor_t *c, size_t n, uint8_t **p)
+{
+    iov_skip(c);
+    if (!c->left)
+        return 0;
+
+    size_t len = c->iov->len - c->off < n ? c->iov->len - c->off : n;
+    *p = (uint8_t *)c->iov->ptr + c->off;
+    c->off += len;
+    return len;
+}
+
+/**
+ * @brief CRC16 of a block spread over segments. A hardware crc16 can't continue a CRC, so the
+ * table driven one is used
+ *
+ * @param c Cursor at the start of the block, taken by value
+ * @param n Block length
+ * @return 16 bit CRC
+ */
+static uint16_t iov_crc16(iov_cursor_t c, size_t n)
+{
+    uint16_t crc = 0;
+    uint8_t *p;
+
+    for (size_t len; n && (len = iov_piece(&c, n, &p)); n -= len)
+        crc = sd_crc16(crc, p, len);
+
+    return crc;
+}
+
+/**
+ * @brief Deadline of a polling loop
+ *
+ */
+typedef struct
+{
+    /**
+     * @brief Time polling started (us)
+     */
+    uint64_t start;
+
+    /**
+     * @brief Time polling gives up (us)
+     */
+    uint64_t deadline;
+
+    /**
+     * @brief Without a time source: polls left before yielding
+     */
+    uint32_t spins;
+
+    /**
+     * @brief Without a time source: 1ms sleeps left before giving up
+     */
+    uint32_t sleeps;
+} poll_t;
+
+/**
+ * @brief Starts a polling deadline
+ *
+ * @param spi_ctx Private SPI context
+ * @param p Deadline to initialize
+ * @param timeout_ms Timeout in ms
+ */
+static void poll_start(spi_ctx_t *spi_ctx, poll_t *p, uint32_t timeout_ms)
+{
+    const sd_host_ops_t *ops = spi_ctx->host->ops;
+
+    p->start = (ops && ops->get_time_us) ? ops->get_time_us() : 0;
+    p->deadline = p->start + (uint64_t)timeout_ms * 1000;
+    p->spins = SD_POLL_SPIN_COUNT;
+    p->sleeps = timeout_ms;
+}
+
+/**
+ * @brief Called after an unsuccessful poll. Spins for SD_POLL_SPIN_US, then yields between polls
+ *
+ * @param spi_ctx Private SPI context
+ * @param p Deadline
+ * @return Whether to keep polling, false once the deadline passed
+ */
+static bool poll_again(spi_ctx_t *spi_ctx, poll_t *p)
+{
+    const sd_host_ops_t *ops = spi_ctx->host->ops;
+
+    if (ops && ops->get_time_us)
+    {
+        uint64_t now = ops->get_time_us();
+        if (now >= p->deadline)
+            return false;
+
+        // Most responses arrive within a few bytes, only yield once the card is slow
+        if (now - p->start >= SD_POLL_SPIN_US)
+        {
+            if (ops->delay_us)
+                ops->delay_us(SD_POLL_YIELD_US);
+            else if (ops->delay_ms)
+                ops->delay_ms(1);
+        }
+        return true;
+    }
+
+    // No time source, spin a bounded number of polls then count 1ms sleeps
+    if (p->spins)
+    {
+        p->spins--;
+        return true;
+    }
+
+    if (!p->sleeps)
+        return false;
+
+    p->sleeps--;
+    if (ops && ops->delay_ms)
+        ops->delay_ms(1);
+    return true;
+}
+
+/**
+ * @brief Waits for a R1 response from the card
+ *
+ * @param spi_ctx Private SPI context
+ * @param timeout_ms Timeout in ms to await a response
+ * @return R1 response
+ */
+static uint8_t wait_r1(spi_ctx_t *spi_ctx, uint32_t timeout_ms)
+{
+    poll_t p;
+    uint32_t polls = 0;
+    uint64_t start = sd_stats_now(spi_ctx->host);
+    poll_start(spi_ctx, &p, timeout_ms);
+
+    do
+    {
+        polls++;
+
+        // Clocks out 0xFF a chunk at a time, the R1 arrives within NCR (<= 8) bytes
+        for (int i = 0; i < SD_SPI_RESP_CHUNK; i++)
+        {
+            uint8_t v = rx_next(spi_ctx, SD_SPI_RESP_CHUNK);
+
+            // Checks is response
+            if ((v & 0x80) == 0)
+            {
+                sd_stats_r1(spi_ctx->host, start, polls);
+                return v;
+            }
+        }
+    } while (poll_again(spi_ctx, &p));
+
+    sd_stats_r1(spi_ctx->host, start, polls);
+    return 0xFF;
+}
+
+/**
+ * @brief Clocks in up to one chunk, looking for the card to stop driving an idle value
+ *
+ * @param spi_ctx Private SPI context
+ * @param idle Value the card drives while not ready (0xFF before a token, 0x00 while busy)
+ * @return First byte that is not idle, idle if the whole chunk was
+ */
+static uint8_t scan_chunk(spi_ctx_t *spi_ctx, uint8_t idle)
+{
+    for (int i = 0; i < SD_SPI_POLL_CHUNK; i++)
+    {
+        uint8_t v = rx_next(spi_ctx, SD_SPI_POLL_CHUNK);
+
+        if (v != idle)
+            return v;
+    }
+
+    return idle;
+}
+
+/**
+ * @brief Waits for the card to send a token (data token, data error token or data response)
+ *
+ * @param spi_ctx Private SPI context
+ * @param timeout_ms Timeout in ms to await the token
+ * @return Token received, 0xFF on timeout
+ */
+static uint8_t wait_token(spi_ctx_t *spi_ctx, uint32_t timeout_ms)
+{
+    poll_t p;
+    poll_start(spi_ctx, &p, timeout_ms);
+
+    do
+    {
+        // The card holds the line high until the token
+        uint8_t v = scan_chunk(spi_ctx, 0xFF);
+        if (v != 0xFF)
+            return v;
+    } while (poll_again(spi_ctx, &p));
+
+    return 0xFF;
+}
+
+/**
+ * @brief Waits for the card to release the busy signal (DO held low)
+ *
+ * @param spi_ctx Private SPI context
+ * @param timeout_ms Timeout in ms to wait
+ * @return Status code
+ */
+static sd_status_t wait_busy(spi_ctx_t *spi_ctx, uint32_t timeout_ms)
+{
+    poll_t p;
+    uint32_t polls = 0;
+    uint64_t start = sd_stats_now(spi_ctx->host);
+    poll_start(spi_ctx, &p, timeout_ms);
+
+    do
+    {
+        polls++;
+        if (scan_chunk(spi_ctx, 0x00) != 0x00)
+        {
+            // Whatever follows the end of busy is idle filler
+            rx_drop(spi_ctx);
+            sd_stats_busy(spi_ctx->host, start, polls);
+            return SD_OK;
+        }
+    } while (poll_again(spi_ctx, &p));
+
+    rx_drop(spi_ctx);
+    sd_stats_busy(spi_ctx->host, start, polls);
+    return SD_ERR_TIMEOUT;
+}
+
+/**
+ * @brief CRC16 of a data block, computed by the port's hardware if it can
+ *
+ * @param spi_ctx Private SPI context
+ * @param buf Data block
+ * @param n Block length
+ * @return 16 bit CRC
+ */
+static uint16_t data_crc16(spi_ctx_t *spi_ctx, const uint8_t *buf, size_t n)
+{
+    if (spi_ctx->spi->crc16)
+        return spi_ctx->spi->crc16(spi_ctx->host, buf, n);
+
+    return sd_crc16(0, buf, n);
+}
+
+/**
+ * @brief Constructs a SPI command frame
+ *
+ * @param f Frame to populate
+ * @param cmd Command index
+ * @param arg Command argument
+ */
+static void build_frame(uint8_t f[6], uint8_t cmd, uint32_t arg)
+{
+    cmd &= 0x3F;
+
+    f[0] = (uint8_t)(0x40 | cmd);
+    f[1] = (arg >> 24) & 0xFF;
+    f[2] = (arg >> 16) & 0xFF;
+    f[3] = (arg >> 8) & 0xFF;
+    f[4] = (arg) & 0xFF;
+
+    // CRC7 is only checked on CMD0 and CMD8 until CMD59 turns checking on, it is always sent
+    f[5] = (uint8_t)((sd_crc7(f, 5) << 1) | 0x01);
+}
+
+/**
+ * @brief Sends a CMD12 (STOP_TRANSMISSION) to end a multi-block read and receives its R1, leaving
+ * the busy phase of the R1b response to the caller. CS must be selected
+ *
+ * @param spi_ctx Private SPI context
+ * @return Status code
+ */
+static sd_status_t send_stop_cmd(spi_ctx_t *spi_ctx)
+{
+    uint8_t f[6];
+
+    // Anything clocked in ahead belongs to the stream being stopped
+    build_frame(f, CMD_STOP_TRANSMISSION, 0);
+    spi_ctx->host->last_cmd = CMD_STOP_TRANSMISSION;
+    tx_send(spi_ctx, f, 6);
+
+    // The byte following CMD12 is a stuff byte which may look like a valid R1, discard it
+    rx_next(spi_ctx, 1);
+
+    uint8_t r1 = wait_r1(spi_ctx, TIMEOUT_STOP_TRANSMISSION);
+    if (r1 == 0xFF)
+        return SD_ERR_TIMEOUT;
+    if (r1 & R1_ERROR_MASK)
+        return SD_ERR_IO;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Sends a CMD12 (STOP_TRANSMISSION) to end a multi-block read, CS must be selected
+ *
+ * @param spi_ctx Private SPI context
+ * @return Status code
+ */
+static sd_status_t stop_transmission(spi_ctx_t *spi_ctx)
+{
+    sd_status_t ret = send_stop_cmd(spi_ctx);
+    if (ret)
+        return ret;
+
+    // CMD12 has a R1b response
+    return wait_busy(spi_ctx, TIMEOUT_STOP_TRANSMISSION);
+}
+
+/**
+ * @brief Ends a transaction, deselecting CS. Nothing clocked in ahead survives the transaction
+ *
+ * @param spi_ctx Private SPI context
+ */
+static void end_transaction(spi_ctx_t *spi_ctx)
+{
+    rx_drop(spi_ctx);
+    spi_ctx->spi->select_cs(spi_ctx->host, false);
+
+    if (spi_ctx->bus && spi_ctx->bus->active == spi_ctx)
+        spi_ctx->bus->active = NULL;
+}
+
+/**
+ * @brief Selects the card, transmits a command and receives its response. CS is left selected
+ *
+ * @param spi_ctx Private SPI context
+ * @param rq Request to send
+ * @param out Output response
+ * @return Status code
+ */
+static sd_status_t send_cmd(spi_ctx_t *spi_ctx, const sd_request_t *rq, sd_response_t *out)
+{
+    // Constructs a command frame
+    uint8_t f[6];
+    build_frame(f, rq->cmd, rq->arg);
+
+    // Clear BUSY and select CS
+    spi_ctx->spi->xchg1(spi_ctx->host, 0xFF);
+    spi_ctx->spi->select_cs(spi_ctx->host, true);
+
+    if (spi_ctx->bus)
+        spi_ctx->bus->active = spi_ctx;
+
+    // Write the command
+    tx_send(spi_ctx, f, 6);
+    spi_ctx->host->last_cmd = rq->cmd;
+
+    // Wait for R1 response
+    uint8_t r1 = wait_r1(spi_ctx, rq->timeout_ms ? rq->timeout_ms : TIMEOUT_SD_DEFAULT);
+    out->r1 = r1;
+    if (r1 == 0xFF)
+        return SD_ERR_TIMEOUT;
+
+    // CMD0 resets the card to CRC checking off, CMD59 toggles it
+    if (rq->cmd == CMD_GO_IDLE_STATE)
+        spi_ctx->crc_on = false;
+    else if (rq->cmd == CMD_CRC_ON_OFF && !(r1 & R1_ERROR_MASK))
+        spi_ctx->crc_on = rq->arg & 0x01;
+
+    // Based on the response type, fill out the 'r' field in the response struct
+    switch (rq->resp)
+    {
+    case SD_RESP_NONE:
+        out->r[0] = 0;
+        break;
+    case SD_RESP_R1:
+    case SD_RESP_R1B:
+        out->r[0] = r1;
+        break;
+    case SD_RESP_R3:
+    case SD_RESP_R7:
+    {
+        uint8_t b[4];
+        rx_recv(spi_ctx, b, 4);
+        out->r[0] = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+    }
+    break;
+    case SD_RESP_R2:
+    {
+        // The SPI R2 is the R1 followed by one status byte
+        uint8_t b;
+        rx_recv(spi_ctx, &b, 1);
+        out->r[0] = (r1 << 8) | b;
+    }
+    break;
+    default:
+        out->r[0] = r1;
+        break;
+    }
+
+    // R1b: the card holds DO low while busy
+    if (rq->resp == SD_RESP_R1B && !(r1 & R1_ERROR_MASK))
+        return wait_busy(spi_ctx, rq->timeout_ms ? rq->timeout_ms : TIMEOUT_SD_DEFAULT);
+
+    return SD_OK;
+}
+
+/**
+ * @brief Receives one data block straight into the destination, once its token was received
+ *
+ * @param spi_ctx Private SPI context
+ * @param rq Request being serviced
+ * @param token Token received from the card
+ * @param dst Destination of the block
+ * @return Status code
+ */
+static sd_status_t recv_block(spi_ctx_t *spi_ctx,
+                              const sd_request_t *rq,
+                              uint8_t token,
+                              uint8_t *dst)
+{
+    // Anything but a start block token is a data error token
+    if (token != TOKEN_START_BLOCK)
+        return SD_ERR_IO;
+
+    // Receive the block and its CRC16 in one chained transfer
+    uint8_t crc[2];
+    sd_spi_seg_t segs[2] = {
+        {.rx = dst, .len = rq->block_size, .fill = 0xFF},
+        {.rx = crc, .len = sizeof(crc), .fill = 0xFF},
+    };
+    rx_recv_chain(spi_ctx, segs, 2);
+
+    // Verified against the CRC the card sent once checking is on
+    if (spi_ctx->crc_on && data_crc16(spi_ctx, dst, rq->block_size) != ((crc[0] << 8) | crc[1]))
+        return SD_ERR_CRC;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Waits for the data response token of a transmitted block
+ *
+ * @param spi_ctx Private SPI context
+ * @param timeout_ms Timeout in ms to wait
+ * @return Status code, SD_ERR_TIMEOUT if no token arrived
+ */
+static sd_status_t wait_data_resp(spi_ctx_t *spi_ctx, uint32_t timeout_ms)
+{
+    uint8_t token = wait_token(spi_ctx, timeout_ms);
+    if (token == 0xFF)
+        return SD_ERR_TIMEOUT;
+
+    uint8_t resp = token & DATA_RESP_MASK;
+    if (resp != DATA_RESP_ACCEPTED)
+        return (resp == DATA_RESP_CRC_ERR) ? SD_ERR_CRC : SD_ERR_IO;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Transmits one data block and checks its data response token. Busy is left to the caller
+ *
+ * @param spi_ctx Private SPI context
+ * @param rq Request being serviced
+ * @param src Block to transmit
+ * @return Status code
+ */
+static sd_status_t send_block(spi_ctx_t *spi_ctx, const sd_request_t *rq, const uint8_t *src)
+{
+    uint32_t t = rq->timeout_ms ? rq->timeout_ms : TIMEOUT_WRITE_BLOCK;
+
+    // CMD25 blocks use their own start token
+    uint8_t start = rq->multi ? TOKEN_START_BLOCK_MULTI : TOKEN_START_BLOCK;
+
+    // The card ignores the CRC unless checking is on
+    uint16_t c = spi_ctx->crc_on ? data_crc16(spi_ctx, src, rq->block_size) : 0xFFFF;
+
+    // One byte gap, start token, the block, then its CRC16, in one chained transfer
+    uint8_t hdr[2] = {0xFF, start};
+    uint8_t crc[2] = {c >> 8, c & 0xFF};
+    const sd_spi_seg_t segs[3] = {
+        {.tx = hdr, .len = sizeof(hdr)},
+        {.tx = src, .len = rq->block_size},
+        {.tx = crc, .len = sizeof(crc)},
+    };
+    tx_send_chain(spi_ctx, segs, 3);
+
+    // Every block is acknowledged by a data response token
+    return wait_data_resp(spi_ctx, t);
+}
+
+/**
+ * @brief Receives one data block straddling segments, its pieces and CRC16 chained
+ *
+ * @param spi_ctx Private SPI context
+ * @param rq Request being serviced
+ * @param token Token received from the card
+ * @param cur Cursor at the block, advanced past it
+ * @return Status code
+ */
+static sd_status_t recv_block_sg(spi_ctx_t *spi_ctx,
+                                 const sd_request_t *rq,
+                                 uint8_t token,
+                                 iov_cursor_t *cur)
+{
+    if (token != TOKEN_START_BLOCK)
+        return SD_ERR_IO;
+
+    iov_cursor_t blk = *cur;
+    uint8_t crc[2];
+    sd_spi_seg_t segs[SG_CHAIN_SEGS + 1];
+    size_t n = 0;
+
+    for (size_t left = rq->block_size; left;)
+    {
+        uint8_t *p;
+        size_t len = iov_piece(cur, left, &p);
+        if (!len)
+            return SD_ERR_PARAM;
+
+        segs[n++] = (sd_spi_seg_t){.rx = p, .len = len, .fill = 0xFF};
+        left -= len;
+
+        if (n == SG_CHAIN_SEGS && left)
+        {
+            rx_recv_chain(spi_ctx, segs, n);
+            n = 0;
+        }
+    }
+
+    segs[n++] = (sd_spi_seg_t){.rx = crc, .len = sizeof(crc), .fill = 0xFF};
+    rx_recv_chain(spi_ctx, segs, n);
+
+    if (spi_ctx->crc_on && iov_crc16(blk, rq->block_size) != ((crc[0] << 8) | crc[1]))
+        return SD_ERR_CRC;
+
+    return SD_OK;
+}
+
+/**
+ * @brief Transmits one data block straddling segments and checks its data response token. Busy
+ * is left to the caller
  *
  * @param spi_ctx Private SPI context
- * @param t Timeout in ms to await a response
- * @return R1 response
+ * @param rq Request being serviced
+ * @param cur Cursor at the block, advanced past it
+ * @return Status code
  */
-static uint8_t wait_r1(spi_ctx_t *spi_ctx, volatile uint32_t t)
+static sd_status_t send_block_sg(spi_ctx_t *spi_ctx, const sd_request_t *rq, iov_cursor_t *cur)
 {
-    while (t--)
+    uint32_t t = rq->timeout_ms ? rq->timeout_ms : TIMEOUT_WRITE_BLOCK;
+    uint8_t start = rq->multi ? TOKEN_START_BLOCK_MULTI : TOKEN_START_BLOCK;
+    uint16_t c = spi_ctx->crc_on ? iov_crc16(*cur, rq->block_size) : 0xFFFF;
+
+    // Gap and start token, the pieces, then the CRC16, chained as far as the segments allow
+    uint8_t hdr[2] = {0xFF, start};
+    uint8_t crc[2] = {c >> 8, c & 0xFF};
+    sd_spi_seg_t segs[SG_CHAIN_SEGS + 1] = {{.tx = hdr, .len = sizeof(hdr)}};
+    size_t n = 1;
+
+    for (size_t left = rq->block_size; left;)
     {
-        // Writes out 0xFF to send out clock pulses and read back responses
-        uint8_t v = spi_ctx->spi->xchg1(spi_ctx->host, 0xFF);
+        uint8_t *p;
+        size_t len = iov_piece(cur, left, &p);
+        if (!len)
+            return SD_ERR_PARAM;
 
-        // Checks is response
-        if ((v & 0x80) == 0)
-            return v;
+        segs[n++] = (sd_spi_seg_t){.tx = p, .len = len};
+        left -= len;
 
-        // Otherwise wait 1ms, repeat. until 't' (the timeout in ms) is zero
-        if (spi_ctx->host->ops && spi_ctx->host->ops->delay_ms)
-            spi_ctx->host->ops->delay_ms(1);
+        if (n == SG_CHAIN_SEGS && left)
+        {
+            tx_send_chain(spi_ctx, segs, n);
+            n = 0;
+        }
     }
-    return 0xFF;
+
+    segs[n++] = (sd_spi_seg_t){.tx = crc, .len = sizeof(crc)};
+    tx_send_chain(spi_ctx, segs, n);
+
+    return wait_data_resp(spi_ctx, t);
+}
+
+/**
+ * @brief Sends the stop tran token that ends a CMD25, the card starts signalling busy a byte later
+ *
+ * @param spi_ctx Private SPI context
+ */
+static void send_stop_tran(spi_ctx_t *spi_ctx)
+{
+    uint8_t stop_tran[2] = {TOKEN_STOP_TRAN, 0xFF};
+    tx_send(spi_ctx, stop_tran, 2);
+}
+
+/**
+ * @brief Receives the data blocks of a CMD17/CMD18 straight into the destination segments
+ *
+ * @param spi_ctx Private SPI context
+ * @param rq Request being serviced
+ * @param cur Cursor over the destination segments, blocks * block_size bytes
+ * @return Status code
+ */
+static sd_status_t read_data(spi_ctx_t *spi_ctx, const sd_request_t *rq, iov_cursor_t *cur)
+{
+    uint32_t t = rq->timeout_ms ? rq->timeout_ms : TIMEOUT_READ_BLOCK;
+    sd_status_t ret = SD_OK;
+
+    for (uint32_t i = 0; i < rq->blocks; i++)
+    {
+        uint8_t token = wait_token(spi_ctx, t);
+        if (token == 0xFF)
+        {
+            ret = SD_ERR_TIMEOUT;
+            break;
+        }
+
+        // Blocks within one segment take the plain path, one chain with the CRC
+        uint8_t *dst = iov_block(cur, rq->block_size);
+        ret = dst ? recv_block(spi_ctx, rq, token, dst) : recv_block_sg(spi_ctx, rq, token, cur);
+        if (ret)
+            break;
+    }
+
+    // An open ended read that succeeded is left streaming, the card stays selected
+    if (rq->multi && rq->open_ended && !ret)
+    {
+        spi_ctx->stream_open = true;
+        spi_ctx->stream_timeout_ms = t;
+        return SD_OK;
+    }
+
+    // A multi-block read streams until stopped, even when it failed part way through
+    if (rq->multi)
+    {
+        sd_status_t stop = stop_transmission(spi_ctx);
+        if (!ret)
+            ret = stop;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Stops a CMD18 stream left open, and deselects the card
+ *
+ * @param spi_ctx Private SPI context
+ * @return Status code of the CMD12
+ */
+static sd_status_t stream_close(spi_ctx_t *spi_ctx)
+{
+    if (!spi_ctx->stream_open)
+        return SD_OK;
+
+    spi_ctx->stream_open = false;
+    sd_status_t ret = stop_transmission(spi_ctx);
+    end_transaction(spi_ctx);
+
+    return ret;
+}
+
+/**
+ * @brief Sets a shared peripheral to the card's clock rate, if another card changed it
+ *
+ * @param spi_ctx Private SPI context
+ */
+static void bus_clock(spi_ctx_t *spi_ctx)
+{
+    sd_spi_bus_t *bus = spi_ctx->bus;
+
+    if (!bus || bus->clocked == spi_ctx)
+        return;
+
+    spi_ctx->spi->set_baud(spi_ctx->host, spi_ctx->clock_hz);
+    bus->clocked = spi_ctx;
+}
+
+/**
+ * @brief Takes a shared bus for the card. A read stream another card left open is stopped, at
+ * that card's clock rate
+ *
+ * @param spi_ctx Private SPI context
+ * @return Status code, SD_ERR_PARAM while another card has an asynchronous request in flight
+ */
+static sd_status_t bus_claim(spi_ctx_t *spi_ctx)
+{
+    sd_spi_bus_t *bus = spi_ctx->bus;
+
+    if (!bus)
+        return SD_OK;
+
+    spi_ctx_t *other = bus->active;
+    if (other && other != spi_ctx)
+    {
+        if (other->async.rq)
+            return SD_ERR_PARAM;
+
+        // The other card's core finds the stream closed and reissues the read
+        bus_clock(other);
+        stream_close(other);
+
+        // Anything else still holding CS is deselected
+        if (bus->active == other)
+            end_transaction(other);
+    }
+
+    bus_clock(spi_ctx);
+    return SD_OK;
+}
+
+/**
+ * @brief Transmits the data blocks of a CMD24/CMD25, handling data response tokens and busy
+ *
+ * @param spi_ctx Private SPI context
+ * @param rq Request being serviced
+ * @param cur Cursor over the source segments, blocks * block_size bytes
+ * @return Status code
+ */
+static sd_status_t write_data(spi_ctx_t *spi_ctx, const sd_request_t *rq, iov_cursor_t *cur)
+{
+    uint32_t t = rq->timeout_ms ? rq->timeout_ms : TIMEOUT_WRITE_BLOCK;
+    sd_status_t ret = SD_OK;
+
+    for (uint32_t i = 0; i < rq->blocks; i++)
+    {
+        const uint8_t *src = iov_block(cur, rq->block_size);
+        ret = src ? send_block(spi_ctx, rq, src) : send_block_sg(spi_ctx, rq, cur);
+        if (ret)
+            break;
+
+        // The card holds DO low while programming the block
+        ret = wait_busy(spi_ctx, t);
+        if (ret)
+            break;
+    }
+
+    // A multi-block write is ended by a stop tran token, even when it failed part way through
+    if (rq->multi)
+    {
+        send_stop_tran(spi_ctx);
+
+        sd_status_t stop = wait_busy(spi_ctx, t);
+        if (!ret)
+            ret = stop;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Per-block timeout of an asynchronous request
+ *
+ * @param rq Request
+ * @return Timeout in milliseconds
+ */
+static uint32_t async_timeout_ms(const sd_request_t *rq)
+{
+    if (rq->timeout_ms)
+        return rq->timeout_ms;
+    return rq->dir == SD_DATA_READ ? TIMEOUT_READ_BLOCK : TIMEOUT_WRITE_BLOCK;
+}
+
+/**
+ * @brief Ends the in-flight asynchronous request: deselects the card and records it
+ *
+ * @param spi_ctx Private SPI context
+ * @param ret Final status of the request
+ * @return Final status of the request
+ */
+static sd_status_t async_finish(spi_ctx_t *spi_ctx, sd_status_t ret)
+{
+    const sd_request_t *rq = spi_ctx->async.rq;
+
+    end_transaction(spi_ctx);
+    sd_stats_cmd(spi_ctx->host, rq, ret, spi_ctx->async.start);
+    sd_trace_cmd(spi_ctx->host, rq, spi_ctx->async.out->r1, ret, spi_ctx->async.trace_start);
+    spi_ctx->async.rq = NULL;
+    spi_ctx->async.state = SPI_ASYNC_IDLE;
+
+    return ret;
+}
+
+/**
+ * @brief Ends the data phase of the in-flight asynchronous request. A multi-block request is
+ * stopped (CMD12 after a read, the stop tran token after a write), even when it failed part way
+ * through, and the busy phase that follows is left to spi_poll
+ *
+ * @param spi_ctx Private SPI context
+ * @param ret Status of the data phase
+ * @return SD_PENDING while the stop is in progress, otherwise the final status
+ */
+static sd_status_t async_stop(spi_ctx_t *spi_ctx, sd_status_t ret)
+{
+    const sd_request_t *rq = spi_ctx->async.rq;
+    uint32_t t = rq->timeout_ms ? rq->timeout_ms : TIMEOUT_WRITE_BLOCK;
+
+    if (!rq->multi)
+        return async_finish(spi_ctx, ret);
+
+    if (rq->dir == SD_DATA_READ)
+    {
+        // Only the command and its R1 are clocked now, a card that didn't take it isn't busy
+        sd_status_t stop = send_stop_cmd(spi_ctx);
+        if (stop)
+            return async_finish(spi_ctx, ret ? ret : stop);
+        t = TIMEOUT_STOP_TRANSMISSION;
+    }
+    else
+    {
+        send_stop_tran(spi_ctx);
+    }
+
+    spi_ctx->async.status = ret;
+    spi_ctx->async.state = SPI_ASYNC_STOP_BUSY;
+    spi_ctx->async.deadline = spi_ctx->host->ops->get_time_us() + (uint64_t)t * 1000;
+    spi_ctx->async.busy_start = sd_stats_now(spi_ctx->host);
+    spi_ctx->async.busy_polls = 0;
+
+    return SD_PENDING;
 }
 
 // ========== Bus Ops ==========
@@ -52,7 +1072,18 @@ static uint8_t wait_r1(spi_ctx_t *spi_ctx, volatile uint32_t t)
 sd_status_t spi_set_clock(sd_host_t *host, uint32_t hz)
 {
     spi_ctx_t *spi_ctx = host->bus_ctx;
+    sd_spi_bus_t *bus = spi_ctx->bus;
+
+    spi_ctx->clock_hz = hz;
+
+    // On a shared bus, a card in the middle of a transfer keeps its clock. The new rate is then
+    // applied the next time this card is selected
+    if (bus && bus->active && bus->active != spi_ctx)
+        return SD_OK;
+
     spi_ctx->spi->set_baud(host, hz);
+    if (bus)
+        bus->clocked = spi_ctx;
 
     return SD_OK;
 }
@@ -70,6 +1101,62 @@ sd_status_t spi_set_width(sd_host_t *host, int bits)
     return SD_OK;
 }
 
+/**
+ * @brief Body of spi_submit and spi_submit_sg
+ *
+ * @param host SD Card Host Controller
+ * @param rq Request to submit
+ * @param out Output response
+ * @param iov Data segments
+ * @param iovcnt Number of segments, 0 without a data phase
+ * @return Status code
+ */
+static sd_status_t submit_iov(sd_host_t *host,
+                              const sd_request_t *rq,
+                              sd_response_t *out,
+                              const sd_iovec_t *iov,
+                              uint32_t iovcnt)
+{
+    spi_ctx_t *spi_ctx = host->bus_ctx;
+
+    // Asynchronous requests own the bus until they complete
+    if (spi_ctx->async.rq)
+        return SD_ERR_PARAM;
+
+    sd_status_t ret = bus_claim(spi_ctx);
+    if (ret)
+        return ret;
+
+    // Any other command ends a read stream left open
+    stream_close(spi_ctx);
+
+    uint64_t start = sd_stats_now(host);
+    uint32_t trace_start = sd_trace_now(host);
+    ret = send_cmd(spi_ctx, rq, out);
+
+    // Data phase, skipped if the card rejected the command
+    if (!ret && iovcnt && rq->blocks && !(out->r1 & R1_ERROR_MASK))
+    {
+        iov_cursor_t cur = {.iov = iov, .left = iovcnt};
+
+        if (rq->dir == SD_DATA_READ)
+            ret = read_data(spi_ctx, rq, &cur);
+        else if (rq->dir == SD_DATA_WRITE)
+            ret = write_data(spi_ctx, rq, &cur);
+    }
+
+    // Deselect CS, unless a read stream was left open
+    if (!spi_ctx->stream_open)
+        end_transaction(spi_ctx);
+
+    // A rejected command is counted as failed
+    sd_status_t final = (!ret && (out->r1 & R1_ERROR_MASK)) ? SD_ERR_IO : ret;
+    sd_stats_cmd(host, rq, final, start);
+    sd_trace_cmd(host, rq, out->r1, final, trace_start);
+
+    return ret;
+}
+
 /**
  * @brief Submit a request and transmits the command over SPI bus
  *
@@ -80,117 +1167,317 @@ sd_status_t spi_set_width(sd_host_t *host, int bits)
  * @return Status code
  */
 sd_status_t spi_submit(sd_host_t *host, const sd_request_t *rq, sd_response_t *out, void *data_buf)
+{
+    // Checks if a request and response is provided
+    if (!rq || !out)
+        return SD_ERR_PARAM;
+
+    sd_iovec_t iov = {.ptr = data_buf, .len = (size_t)rq->blocks * rq->block_size};
+    return submit_iov(host, rq, out, &iov, data_buf ? 1 : 0);
+}
+
+/**
+ * @brief Submit a request whose data phase is scattered over segments, in one command. Blocks
+ * within a segment go out as usual, the pieces of a block straddling segments are chained
+ *
+ * @param host SD Card Host Controller
+ * @param rq Request to submit
+ * @param out Output response
+ * @param iov Data segments, blocks * block_size bytes in total
+ * @param iovcnt Number of segments
+ * @return Status code
+ */
+sd_status_t spi_submit_sg(sd_host_t *host,
+                          const sd_request_t *rq,
+                          sd_response_t *out,
+                          const sd_iovec_t *iov,
+                          uint32_t iovcnt)
+{
+    if (!rq || !out || (iovcnt && !iov))
+        return SD_ERR_PARAM;
+
+    return submit_iov(host, rq, out, iov, iovcnt);
+}
+
+/**
+ * @brief Starts a request without waiting for its data phase. The command is sent and its
+ * response received right away, tokens and busy are then polled by spi_poll
+ *
+ * @param host SD Card Host Controller
+ * @param rq Request to submit, must stay valid until completion
+ * @param out Output response, must stay valid until completion
+ * @param data_buf Data buffer, must stay valid until completion
+ * @return SD_PENDING if the data phase is in progress, otherwise the final status
+ */
+sd_status_t spi_submit_async(sd_host_t *host,
+                             const sd_request_t *rq,
+                             sd_response_t *out,
+                             void *data_buf)
 {
     spi_ctx_t *spi_ctx = host->bus_ctx;
 
-    // Checks if a request and response is provided
-    if (!rq && !out)
+    if (!rq || !out)
         return SD_ERR_PARAM;
 
-    // Constructs a command frame
-    uint8_t cmd = rq->cmd & 0x3F;
-    uint8_t f[6] = {(uint8_t)(0x40 | cmd),
-                    (rq->arg >> 24) & 0xFF,
-                    (rq->arg >> 16) & 0xFF,
-                    (rq->arg >> 8) & 0xFF,
-                    (rq->arg) & 0xFF,
-                    0x01};
-
-    // Known CRC's for commands that require CRC, CMD0 and CMD8
-    if (cmd == 0)
-        f[5] = 0x95;
-    if (cmd == 8)
-        f[5] = 0x87;
-
-    // TODO: Calculate CRCS for commands where they aren't required
-    // Should have the capbility to enable/disable CRC's in commands
+    if (spi_ctx->async.rq)
+        return SD_ERR_PARAM;
 
-    // Clear BUSY and select CS
-    spi_ctx->spi->xchg1(host, 0xFF);
-    spi_ctx->spi->select_cs(host, true);
+    // Deadlines can only be tracked without blocking given a time source
+    if (!host->ops || !host->ops->get_time_us)
+        return SD_ERR_UNSUPPORTED;
 
-    // Write the command
-    spi_ctx->spi->write(host, f, 6);
-    // TODO: Handle CMD12
+    sd_status_t ret = bus_claim(spi_ctx);
+    if (ret)
+        return ret;
 
-    // Wait for R1 response
-    uint8_t r1 = wait_r1(spi_ctx, rq->timeout_ms ? rq->timeout_ms : TIMEOUT_SD_DEFAULT);
-    out->r1 = r1;
-    if (r1 == 0xFF)
+    stream_close(spi_ctx);
+
+    // Commands without a data phase complete immediately
+    if (!data_buf || !rq->blocks || rq->dir == SD_DATA_NONE)
+        return spi_submit(host, rq, out, data_buf);
+
+    uint64_t start = sd_stats_now(host);
+    uint32_t trace_start = sd_trace_now(host);
+    ret = send_cmd(spi_ctx, rq, out);
+    if (ret || (out->r1 & R1_ERROR_MASK))
     {
-        spi_ctx->spi->select_cs(host, false);
-        return SD_ERR_TIMEOUT;
+        end_transaction(spi_ctx);
+        sd_stats_cmd(host, rq, ret ? ret : SD_ERR_IO, start);
+        sd_trace_cmd(host, rq, out->r1, ret ? ret : SD_ERR_IO, trace_start);
+        return ret;
     }
 
-    // Based on the response type, fill out the 'r' field in the response struct
-    if (out)
+    uint32_t t = async_timeout_ms(rq);
+
+    spi_ctx->async.rq = rq;
+    spi_ctx->async.buf = data_buf;
+    spi_ctx->async.block = 0;
+    spi_ctx->async.out = out;
+    spi_ctx->async.start = start;
+    spi_ctx->async.trace_start = trace_start;
+    spi_ctx->async.deadline = host->ops->get_time_us() + (uint64_t)t * 1000;
+
+    if (rq->dir == SD_DATA_READ)
+    {
+        spi_ctx->async.state = SPI_ASYNC_TOKEN;
+        return SD_PENDING;
+    }
+
+    // Writes hand over the first block now, then poll busy
+    spi_ctx->async.state = SPI_ASYNC_BUSY;
+    ret = send_block(spi_ctx, rq, spi_ctx->async.buf);
+    if (ret)
+        return async_stop(spi_ctx, ret);
+
+    spi_ctx->async.busy_start = sd_stats_now(host);
+    spi_ctx->async.busy_polls = 0;
+
+    return SD_PENDING;
+}
+
+/**
+ * @brief Advances the in-flight asynchronous request by at most one block. Never waits for a data
+ * token or busy, the only bounded waits are the R1 of the CMD12 that stops a multi-block read
+ * and a block or token already due
+ *
+ * @param host SD Card Host Controller
+ * @return SD_PENDING while in progress, otherwise the final status of the request
+ */
+sd_status_t spi_poll(sd_host_t *host)
+{
+    spi_ctx_t *spi_ctx = host->bus_ctx;
+    const sd_request_t *rq = spi_ctx->async.rq;
+
+    if (!rq)
+        return SD_OK;
+
+    // Another card may have changed a shared peripheral's clock in between
+    bus_clock(spi_ctx);
+
+    uint32_t t = async_timeout_ms(rq);
+    uint64_t now = host->ops->get_time_us();
+    sd_status_t ret = SD_PENDING;
+
+    switch (spi_ctx->async.state)
+    {
+    case SPI_ASYNC_TOKEN:
     {
-        switch (rq->resp)
+        // Waiting for the next block of a read
+        uint8_t token = scan_chunk(spi_ctx, 0xFF);
+        if (token == 0xFF)
         {
-        case SD_RESP_NONE:
-            out->r[0] = 0;
+            if (now >= spi_ctx->async.deadline)
+                ret = SD_ERR_TIMEOUT;
             break;
-        case SD_RESP_R1:
-        case SD_RESP_R1B:
-            out->r[0] = r1;
+        }
+
+        ret = recv_block(spi_ctx, rq, token, spi_ctx->async.buf);
+        if (ret)
+            break;
+
+        spi_ctx->async.buf += rq->block_size;
+        ret = (++spi_ctx->async.block < rq->blocks) ? SD_PENDING : SD_OK;
+        spi_ctx->async.deadline = now + (uint64_t)t * 1000;
+    }
+    break;
+
+    case SPI_ASYNC_BUSY:
+        // Waiting for the card to program the last written block
+        spi_ctx->async.busy_polls++;
+        if (scan_chunk(spi_ctx, 0x00) == 0x00)
+        {
+            if (now >= spi_ctx->async.deadline)
+                ret = SD_ERR_TIMEOUT;
             break;
-        case SD_RESP_R3:
-        case SD_RESP_R7:
+        }
+        rx_drop(spi_ctx);
+        sd_stats_busy(host, spi_ctx->async.busy_start, spi_ctx->async.busy_polls);
+
+        spi_ctx->async.buf += rq->block_size;
+        spi_ctx->async.deadline = now + (uint64_t)t * 1000;
+        if (++spi_ctx->async.block < rq->blocks)
         {
-            uint8_t b[4];
-            spi_ctx->spi->read_ff(host, b, 4);
-            out->r[0] = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+            ret = send_block(spi_ctx, rq, spi_ctx->async.buf);
+            if (!ret)
+                ret = SD_PENDING;
         }
-        break;
-        case SD_RESP_R2:
+        else
         {
-            uint8_t b[16];
-            spi_ctx->spi->read_ff(host, b, 16);
-            out->r[0] = (b[12] << 24) | (b[13] << 16) | (b[14] << 8) | b[15];
-            out->r[1] = (b[8] << 24) | (b[9] << 16) | (b[10] << 8) | b[11];
-            out->r[2] = (b[4] << 24) | (b[5] << 16) | (b[6] << 8) | b[7];
-            out->r[3] = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+            ret = SD_OK;
         }
+
+        // The next busy phase starts with the block just sent
+        spi_ctx->async.busy_start = sd_stats_now(host);
+        spi_ctx->async.busy_polls = 0;
         break;
-        default:
-            out->r[0] = r1;
+
+    case SPI_ASYNC_STOP_BUSY:
+        // Waiting for the card to finish after a CMD12 or a stop tran token
+        spi_ctx->async.busy_polls++;
+        if (scan_chunk(spi_ctx, 0x00) == 0x00)
+        {
+            if (now >= spi_ctx->async.deadline)
+            {
+                ret = spi_ctx->async.status ? spi_ctx->async.status : SD_ERR_TIMEOUT;
+                return async_finish(spi_ctx, ret);
+            }
             break;
         }
+        rx_drop(spi_ctx);
+        sd_stats_busy(host, spi_ctx->async.busy_start, spi_ctx->async.busy_polls);
+        return async_finish(spi_ctx, spi_ctx->async.status);
+
+    default:
+        return async_finish(spi_ctx, SD_ERR_PROTO);
     }
 
-    // TODO: handle R1b response
+    if (ret == SD_PENDING)
+        return ret;
 
-    // data phase
-    // TODO: Handle data phase
+    return async_stop(spi_ctx, ret);
+}
 
-    // Deselect CS
-    spi_ctx->spi->select_cs(host, false);
+// ========== SPI Bus Ops binding and Init ==========
 
-    return SD_OK;
+/**
+ * @brief Receives the next blocks of the CMD18 stream left open by an open ended request
+ *
+ * @param host SD Card Host Controller
+ * @param data_buf Buffer to store the blocks
+ * @param blocks Number of blocks
+ * @param block_size Block size
+ * @return Status code, SD_ERR_PROTO if no stream is open
+ */
+sd_status_t spi_stream_read(sd_host_t *host, void *data_buf, uint32_t blocks, uint32_t block_size)
+{
+    spi_ctx_t *spi_ctx = host->bus_ctx;
+    uint8_t *dst = data_buf;
+
+    if (!spi_ctx->stream_open)
+        return SD_ERR_PROTO;
+
+    bus_clock(spi_ctx);
+
+    // The blocks follow on from the stream, no command is sent. Accounted to the CMD18
+    sd_request_t rq = {.cmd = CMD_READ_MULTIPLE_BLOCK,
+                       .dir = SD_DATA_READ,
+                       .blocks = blocks,
+                       .block_size = block_size,
+                       .multi = true};
+    sd_status_t ret = SD_OK;
+    uint64_t start = sd_stats_now(host);
+    uint32_t trace_start = sd_trace_now(host);
+
+    for (uint32_t i = 0; i < blocks; i++)
+    {
+        uint8_t token = wait_token(spi_ctx, spi_ctx->stream_timeout_ms);
+        if (token == 0xFF)
+        {
+            ret = SD_ERR_TIMEOUT;
+            break;
+        }
+
+        ret = recv_block(spi_ctx, &rq, token, dst);
+        if (ret)
+            break;
+        dst += block_size;
+    }
+
+    // A failed stream is not worth keeping open
+    if (ret)
+        stream_close(spi_ctx);
+
+    sd_stats_cmd(host, &rq, ret, start);
+    sd_trace_rec(host, SD_TRACE_STREAM, CMD_READ_MULTIPLE_BLOCK, 0, 0,
+                 ret ? 0 : blocks * block_size, ret, trace_start);
+    return ret;
 }
 
-// ========== SPI Bus Ops binding and Init ==========
+/**
+ * @brief Ends the CMD18 stream left open by an open ended request
+ *
+ * @param host SD Card Host Controller
+ * @return Status code
+ */
+sd_status_t spi_stream_stop(sd_host_t *host)
+{
+    return stream_close(host->bus_ctx);
+}
 
 /**
  * @brief vtable/op table for the bus driver
  */
-static const sd_bus_vtbl_t SPI_VTBL = {
-    .set_clock = spi_set_clock, .set_bus_width = spi_set_width, .submit = spi_submit};
-
-void sd_bind_spi_transport(sd_host_t *host, const sd_spi_ops_t *ops)
+static const sd_bus_vtbl_t SPI_VTBL = {.set_clock = spi_set_clock,
+                                       .set_bus_width = spi_set_width,
+                                       .submit = spi_submit,
+                                       .submit_sg = spi_submit_sg,
+                                       .submit_async = spi_submit_async,
+                                       .poll = spi_poll,
+                                       .stream_read = spi_stream_read,
+                                       .stream_stop = spi_stream_stop};
 
+void sd_bind_spi_transport(sd_host_t *host, const sd_spi_ops_t *ops, spi_ctx_t *ctx)
 {
-    // Initializes a SPI context, used by bus logic.
+    // Initializes the host's SPI context, used by bus logic.
     // Sets MCU specific spi hooks
-    static spi_ctx_t spi_ctx;
-
-    spi_ctx.host = host;
-    spi_ctx.spi = ops;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->host = host;
+    ctx->spi = ops;
 
     // Initializes host for SPI, sets the vtable for the SPI bus and private context.
     host->bus_kind = SD_BUS_SPI;
     host->bus = &SPI_VTBL;
-    host->bus_ctx = (void *)&spi_ctx;
+    host->bus_ctx = (void *)ctx;
     host->supports_4bit = false;
     host->supports_1v8 = false;
 }
+
+void sd_spi_share_bus(sd_host_t *host, sd_spi_bus_t *bus)
+{
+    spi_ctx_t *spi_ctx = host->bus_ctx;
+
+    spi_ctx->bus = bus;
+
+    // The port may have configured the peripheral directly
+    bus->clocked = NULL;
+}
@@ -0,0 +1,89 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_spi_chain.c
+ * @brief Chained SPI transfer state machine, kept free of hardware so every port shares it
+ */
+
+#include "bus/sd_spi_chain.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+sd_spi_chain_dir_t sd_spi_chain_dir(const sd_spi_seg_t *segs, size_t count)
+{
+    if (!segs || !count)
+        return SD_SPI_CHAIN_INVALID;
+
+    // The direction is set by the first segment, every other segment must agree with it
+    sd_spi_chain_dir_t dir = segs[0].tx ? SD_SPI_CHAIN_TX : SD_SPI_CHAIN_RX;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const sd_spi_seg_t *s = &segs[i];
+
+        // Empty segments can't be loaded into a DMA channel
+        if (!s->len)
+            return SD_SPI_CHAIN_INVALID;
+
+        // A transmit chain discards everything it receives
+        if (dir == SD_SPI_CHAIN_TX && (!s->tx || s->rx))
+            return SD_SPI_CHAIN_INVALID;
+
+        // A receive chain clocks out one fill byte for its whole length
+        if (dir == SD_SPI_CHAIN_RX && (s->tx || !s->rx || s->fill != segs[0].fill))
+            return SD_SPI_CHAIN_INVALID;
+    }
+
+    return dir;
+}
+
+size_t sd_spi_chain_len(const sd_spi_seg_t *segs, size_t count)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++)
+        n += segs[i].len;
+
+    return n;
+}
+
+void sd_spi_chain_init(sd_spi_chain_t *chain, const sd_spi_seg_t *segs, size_t count)
+{
+    chain->segs = segs;
+    chain->count = count;
+    chain->armed = 0;
+    chain->completed = 0;
+    chain->active = 0;
+}
+
+const sd_spi_seg_t *sd_spi_chain_arm(sd_spi_chain_t *chain, uint8_t *slot, bool *chained)
+{
+    // Every segment was loaded, or both slots hold one
+    if (chain->armed >= chain->count || chain->armed - chain->completed >= SD_SPI_CHAIN_SLOTS)
+        return NULL;
+
+    // Segments go into the slots in turn, so segment i always lands in slot i % SLOTS
+    *slot = (uint8_t)(chain->armed % SD_SPI_CHAIN_SLOTS);
+
+    // Another loaded segment runs first, its completion has to trigger this one
+    *chained = chain->armed > chain->completed;
+
+    return &chain->segs[chain->armed++];
+}
+
+bool sd_spi_chain_complete(sd_spi_chain_t *chain, uint8_t *next)
+{
+    if (chain->completed < chain->armed)
+    {
+        chain->completed++;
+        chain->active = (uint8_t)((chain->active + 1) % SD_SPI_CHAIN_SLOTS);
+    }
+
+    if (next)
+        *next = chain->active;
+
+    return chain->completed < chain->count;
+}
@@ -0,0 +1,158 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_stats.c
+ * @brief Command latency and throughput statistics
+ */
+
+#include "sd_stats.h"
+
+#include "sd.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if SD_STATS_ENABLE
+
+// ========== Helper Functions ==========
+
+/**
+ * @brief Histogram bucket of a time, log2 of the microseconds
+ *
+ * @param us Time in microseconds
+ * @return Bucket index
+ */
+static uint32_t bucket(uint64_t us)
+{
+    uint32_t b = 0;
+
+    while (us > 1 && b < SD_STATS_BUCKETS - 1)
+    {
+        us >>= 1;
+        b++;
+    }
+
+    return b;
+}
+
+/**
+ * @brief Time elapsed since a measurement started
+ *
+ * @param host SD Host
+ * @param start_us Start time
+ * @return Time in microseconds, 0 without a time source
+ */
+static uint64_t elapsed(sd_host_t *host, uint64_t start_us)
+{
+    if (!host->ops || !host->ops->get_time_us)
+        return 0;
+
+    return host->ops->get_time_us() - start_us;
+}
+
+// ========== Bus driver hooks ==========
+
+uint64_t sd_stats_now(sd_host_t *host)
+{
+    if (!host->ops || !host->ops->get_time_us)
+        return 0;
+
+    return host->ops->get_time_us();
+}
+
+void sd_stats_cmd(sd_host_t *host, const sd_request_t *rq, sd_status_t ret, uint64_t start_us)
+{
+    sd_stats_t *st = &host->stats;
+    sd_cmd_stats_t *c = &st->cmd[rq->cmd % SD_STATS_CMDS];
+    uint64_t us = elapsed(host, start_us);
+
+    c->count++;
+    c->total_us += us;
+    c->hist[bucket(us)]++;
+    if (us > c->max_us)
+        c->max_us = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+
+    if (ret)
+    {
+        c->errors++;
+        if (ret == SD_ERR_TIMEOUT)
+            st->timeouts++;
+        else if (ret == SD_ERR_CRC)
+            st->crc_errors++;
+        return;
+    }
+
+    // Data only counts once the whole transfer went through
+    uint64_t bytes = (uint64_t)rq->blocks * rq->block_size;
+    if (rq->dir == SD_DATA_READ)
+        st->bytes_read += bytes;
+    else if (rq->dir == SD_DATA_WRITE)
+        st->bytes_written += bytes;
+}
+
+void sd_stats_r1(sd_host_t *host, uint64_t start_us, uint32_t polls)
+{
+    sd_stats_t *st = &host->stats;
+
+    st->cmd[host->last_cmd % SD_STATS_CMDS].r1_us += elapsed(host, start_us);
+    st->r1_polls += polls;
+}
+
+void sd_stats_busy(sd_host_t *host, uint64_t start_us, uint32_t polls)
+{
+    sd_stats_t *st = &host->stats;
+    uint64_t us = elapsed(host, start_us);
+
+    st->busy_us += us;
+    st->busy_hist[bucket(us)]++;
+    st->busy_polls += polls;
+}
+
+#endif
+
+// ========== libsd API ==========
+
+sd_status_t sd_get_stats(sd_card_t *card, sd_stats_t *out)
+{
+    if (!card || !card->host || !out)
+        return SD_ERR_PARAM;
+
+#if SD_STATS_ENABLE
+    sd_host_t *host = card->host;
+
+    // A consistent snapshot, the bus driver updates the counters under the host lock
+    if (host->ops && host->ops->lock)
+        host->ops->lock(host);
+    *out = host->stats;
+    if (host->ops && host->ops->unlock)
+        host->ops->unlock(host);
+
+    return SD_OK;
+#else
+    memset(out, 0, sizeof(*out));
+    return SD_ERR_UNSUPPORTED;
+#endif
+}
+
+sd_status_t sd_reset_stats(sd_card_t *card)
+{
+    if (!card || !card->host)
+        return SD_ERR_PARAM;
+
+#if SD_STATS_ENABLE
+    sd_host_t *host = card->host;
+
+    if (host->ops && host->ops->lock)
+        host->ops->lock(host);
+    memset(&host->stats, 0, sizeof(host->stats));
+    if (host->ops && host->ops->unlock)
+        host->ops->unlock(host);
+
+    return SD_OK;
+#else
+    return SD_ERR_UNSUPPORTED;
+#endif
+}
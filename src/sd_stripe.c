@@ -0,0 +1,187 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_stripe.c
+ * @brief Striping of several cards, chunks run concurrently through the asynchronous block API
+ */
+
+#include "sd_stripe.h"
+
+#include "sd.h"
+#include "sd_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// ========== Helper Functions ==========
+
+static void chunk_done(sd_async_t *req, sd_status_t status, void *user);
+
+/**
+ * @brief Queues the card's next chunk of the transfer: the part of its next stripe within the range
+ *
+ * @param st Stripe set
+ * @param m Card
+ * @return Status code, SD_OK as well once the card has no chunks left
+ */
+static sd_status_t queue_chunk(sd_stripe_t *st, sd_stripe_member_t *m)
+{
+    uint32_t sb = st->stripe_blocks;
+    uint64_t stripe_start = (uint64_t)m->next * sb;
+
+    if (stripe_start >= st->end)
+        return SD_OK;
+
+    // Clip the stripe to the transfer, only the first and last stripes are partial
+    uint32_t first = stripe_start > st->lba ? (uint32_t)stripe_start : st->lba;
+    uint32_t last = stripe_start + sb < st->end ? (uint32_t)(stripe_start + sb) : st->end;
+
+    // Stripes of a card are stored back to back on it
+    uint32_t card_lba = (m->next / st->count) * sb + (first - (uint32_t)stripe_start);
+    uint8_t *buf = st->buf + (size_t)(first - st->lba) * SD_STRIPE_BLOCK_LEN;
+
+    m->next += st->count;
+    st->pending++;
+
+    sd_status_t ret;
+    if (st->write)
+        ret = sd_write_blocks_async(m->card, &m->req, card_lba, buf, last - first, chunk_done, m);
+    else
+        ret = sd_read_blocks_async(m->card, &m->req, card_lba, buf, last - first, chunk_done, m);
+
+    if (ret)
+        st->pending--;
+
+    return ret;
+}
+
+/**
+ * @brief Completion callback of a chunk, queues the card's next one
+ *
+ * @param req Request that completed
+ * @param status Final status of the chunk
+ * @param user Card the chunk ran on
+ */
+static void chunk_done(sd_async_t *req, sd_status_t status, void *user)
+{
+    (void)req;
+
+    sd_stripe_member_t *m = user;
+    sd_stripe_t *st = m->stripe;
+
+    st->pending--;
+    if (status && !st->status)
+        st->status = status;
+
+    // After an error the cards only finish what they have in flight
+    if (!st->status)
+        st->status = queue_chunk(st, m);
+}
+
+/**
+ * @brief Runs a transfer, one chunk in flight on every card until all stripes in range are done
+ *
+ * @param st Stripe set
+ * @param lba Start block
+ * @param buf Transfer buffer
+ * @param count Number of blocks
+ * @param write Whether the transfer writes
+ * @return Status code
+ */
+static sd_status_t transfer(sd_stripe_t *st, uint32_t lba, uint8_t *buf, uint32_t count, bool write)
+{
+    if (!st || !buf || (uint64_t)lba + count > st->blocks)
+        return SD_ERR_PARAM;
+
+    if (!count)
+        return SD_OK;
+
+    st->buf = buf;
+    st->lba = lba;
+    st->end = lba + count;
+    st->write = write;
+    st->pending = 0;
+    st->status = SD_OK;
+
+    // Every card starts at its first stripe at or after the one holding lba
+    uint32_t s0 = lba / st->stripe_blocks;
+    for (uint32_t i = 0; i < st->count && !st->status; i++)
+    {
+        sd_stripe_member_t *m = &st->members[i];
+
+        m->next = s0 + (i + st->count - s0 % st->count) % st->count;
+        st->status = queue_chunk(st, m);
+    }
+
+    // The callbacks queue the following chunks, polling interleaves the cards
+    while (st->pending)
+    {
+        for (uint32_t i = 0; i < st->count; i++)
+            sd_poll(st->members[i].card);
+    }
+
+    return st->status;
+}
+
+// ========== libsd API ==========
+
+sd_status_t sd_stripe_init(sd_stripe_t *stripe,
+                           sd_stripe_member_t *members,
+                           sd_card_t *const *cards,
+                           uint32_t count,
+                           uint32_t stripe_blocks)
+{
+    if (!stripe || !members || !cards || !count || !stripe_blocks)
+        return SD_ERR_PARAM;
+
+    // Every card contributes as many whole stripes as the smallest one holds
+    uint64_t card_blocks = UINT32_MAX;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!cards[i] || !cards[i]->host)
+            return SD_ERR_PARAM;
+
+        if (cards[i]->block_len != SD_STRIPE_BLOCK_LEN)
+            return SD_ERR_UNSUPPORTED;
+
+        uint64_t n = cards[i]->capacity_bytes / SD_STRIPE_BLOCK_LEN;
+        if (n < card_blocks)
+            card_blocks = n;
+    }
+
+    // Block addresses of the set are 32 bit
+    if (card_blocks * count > UINT32_MAX)
+        card_blocks = UINT32_MAX / count;
+    card_blocks -= card_blocks % stripe_blocks;
+
+    if (!card_blocks)
+        return SD_ERR_PARAM;
+
+    memset(stripe, 0, sizeof(*stripe));
+    stripe->members = members;
+    stripe->count = count;
+    stripe->stripe_blocks = stripe_blocks;
+    stripe->card_blocks = (uint32_t)card_blocks;
+    stripe->blocks = (uint32_t)card_blocks * count;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memset(&members[i], 0, sizeof(members[i]));
+        members[i].card = cards[i];
+        members[i].stripe = stripe;
+    }
+
+    return SD_OK;
+}
+
+sd_status_t sd_stripe_read(sd_stripe_t *stripe, uint32_t lba, void *buf, uint32_t count)
+{
+    return transfer(stripe, lba, buf, count, false);
+}
+
+sd_status_t sd_stripe_write(sd_stripe_t *stripe, uint32_t lba, const void *buf, uint32_t count)
+{
+    return transfer(stripe, lba, (uint8_t *)buf, count, true);
+}
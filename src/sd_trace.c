@@ -0,0 +1,154 @@
+/**
+ * SPDX-License-Identifier: MIT
+ * Copyright (c) 2025 Aeybel Varghese
+ *
+ * @file sd_trace.c
+ * @brief Binary command trace ring buffer
+ */
+
+#include "sd_trace.h"
+
+#include "sd.h"
+#include "sd_host.h"
+#include "sd_types.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if SD_TRACE_ENABLE
+
+// ========== Bus driver and block API hooks ==========
+
+uint32_t sd_trace_now(sd_host_t *host)
+{
+    // Only pays for the time source while a ring is attached
+    if (!host->trace || !host->ops || !host->ops->get_time_us)
+        return 0;
+
+    return (uint32_t)host->ops->get_time_us();
+}
+
+void sd_trace_rec(sd_host_t *host,
+                  sd_trace_type_t type,
+                  uint8_t cmd,
+                  uint32_t arg,
+                  uint8_t r1,
+                  uint32_t bytes,
+                  sd_status_t status,
+                  uint32_t start_us)
+{
+    sd_trace_t *t = host->trace;
+    if (!t)
+        return;
+
+    // The host lock makes this the only writer, the slot is filled before it is published
+    uint32_t i = atomic_load_explicit(&t->head, memory_order_relaxed);
+    sd_trace_rec_t *r = &t->recs[i & t->mask];
+    uint32_t now = sd_trace_now(host);
+
+    r->time_us = start_us;
+    r->dur_us = now - start_us;
+    r->arg = arg;
+    r->bytes = bytes;
+    r->type = (uint8_t)type;
+    r->cmd = cmd;
+    r->r1 = r1;
+    r->status = (uint8_t)status;
+
+    atomic_store_explicit(&t->head, i + 1, memory_order_release);
+}
+
+void sd_trace_cmd(sd_host_t *host,
+                  const sd_request_t *rq,
+                  uint8_t r1,
+                  sd_status_t status,
+                  uint32_t start_us)
+{
+    if (!host->trace)
+        return;
+
+    // Data only counts once the whole transfer went through
+    uint32_t bytes = status ? 0 : rq->blocks * rq->block_size;
+    if (rq->dir == SD_DATA_NONE)
+        bytes = 0;
+
+    sd_trace_rec(host, SD_TRACE_CMD, rq->cmd, rq->arg, r1, bytes, status, start_us);
+}
+
+#endif
+
+// ========== libsd API ==========
+
+sd_status_t sd_trace_init(sd_trace_t *t, sd_trace_rec_t *recs, uint32_t size)
+{
+    if (!t || !recs || !size || (size & (size - 1)))
+        return SD_ERR_PARAM;
+
+    t->recs = recs;
+    t->mask = size - 1;
+    atomic_init(&t->head, 0);
+
+    return SD_OK;
+}
+
+size_t sd_trace_dump(sd_trace_t *t, void *out, size_t len)
+{
+    if (!t || !out || len < sizeof(sd_trace_hdr_t))
+        return 0;
+
+    sd_trace_hdr_t hdr = {.magic = SD_TRACE_MAGIC,
+                          .version = SD_TRACE_VERSION,
+                          .rec_size = sizeof(sd_trace_rec_t)};
+    uint8_t *dst = (uint8_t *)out + sizeof(hdr);
+    uint32_t size = t->mask + 1;
+
+    // The newest records that fit, copied without stopping the writer
+    uint32_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+    uint32_t n = head < size ? head : size;
+    size_t fit = (len - sizeof(hdr)) / sizeof(sd_trace_rec_t);
+    if (n > fit)
+        n = (uint32_t)fit;
+
+    uint32_t first = head - n;
+    for (uint32_t i = 0; i < n; i++)
+        memcpy(dst + (size_t)i * sizeof(sd_trace_rec_t), &t->recs[(first + i) & t->mask],
+               sizeof(sd_trace_rec_t));
+
+    // Records the writer got to meanwhile may be torn, the slot of record head2 - size is the one
+    // it could have been filling
+    uint32_t head2 = atomic_load_explicit(&t->head, memory_order_acquire);
+    uint32_t torn = head2 - first >= size ? head2 - first - size + 1 : 0;
+    if (torn > n)
+        torn = n;
+    if (torn)
+        memmove(dst, dst + (size_t)torn * sizeof(sd_trace_rec_t),
+                (size_t)(n - torn) * sizeof(sd_trace_rec_t));
+
+    hdr.count = n - torn;
+    hdr.dropped = first + torn;
+    memcpy(out, &hdr, sizeof(hdr));
+
+    return sizeof(hdr) + (size_t)hdr.count * sizeof(sd_trace_rec_t);
+}
+
+sd_status_t sd_trace_attach(sd_host_t *host, sd_trace_t *trace)
+{
+    if (!host)
+        return SD_ERR_PARAM;
+
+#if SD_TRACE_ENABLE
+    // Swapped under the lock, so no record is being written to the old ring
+    if (host->ops && host->ops->lock)
+        host->ops->lock(host);
+    host->trace = trace;
+    if (host->ops && host->ops->unlock)
+        host->ops->unlock(host);
+
+    return SD_OK;
+#else
+    (void)trace;
+    return SD_ERR_UNSUPPORTED;
+#endif
+}
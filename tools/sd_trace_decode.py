@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2025 Aeybel Varghese
+# SPDX-License-Identifier: MIT
+
+"""
+Decodes a libsd trace dump (sd_trace_dump) into a timeline and a summary.
+
+    sd_trace_decode.py dump.bin
+    sd_trace_decode.py --summary dump.bin
+    sd_trace_decode.py --gap-ms 20 --top 5 dump.bin
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x52544453
+VERSION = 1
+HDR = "IHHII"
+REC = "IIIIBBBB"
+
+TYPES = ["CMD", "STREAM", "READ", "WRITE", "ERASE", "DISCARD"]
+
+STATUS = [
+    "OK",
+    "TIMEOUT",
+    "CRC",
+    "IO",
+    "PROTO",
+    "UNSUPPORTED",
+    "PARAM",
+    "NO_CARD",
+    "LOCKED",
+    "PENDING",
+]
+
+# Commands issued by libsd, ACMDs follow a CMD55
+CMDS = {
+    0: "GO_IDLE_STATE",
+    2: "ALL_SEND_CID",
+    3: "SEND_RELATIVE_ADDR",
+    6: "SWITCH_FUNC",
+    7: "SELECT_CARD",
+    8: "SEND_IF_COND",
+    9: "SEND_CSD",
+    10: "SEND_CID",
+    12: "STOP_TRANSMISSION",
+    13: "SEND_STATUS",
+    16: "SET_BLOCKLEN",
+    17: "READ_SINGLE_BLOCK",
+    18: "READ_MULTIPLE_BLOCK",
+    23: "SET_BLOCK_COUNT",
+    24: "WRITE_BLOCK",
+    25: "WRITE_MULTIPLE_BLOCK",
+    32: "ERASE_WR_BLK_START",
+    33: "ERASE_WR_BLK_END",
+    38: "ERASE",
+    55: "APP_CMD",
+    58: "READ_OCR",
+    59: "CRC_ON_OFF",
+}
+
+ACMDS = {
+    6: "SET_BUS_WIDTH",
+    13: "SD_STATUS",
+    23: "SET_WR_BLK_ERASE_COUNT",
+    41: "SD_SEND_OP_COND",
+    51: "SEND_SCR",
+}
+
+
+def load(path):
+    """
+    Reads a dump and unwraps the 32 bit timestamps
+    Args:
+        path (str): dump file
+
+    Returns: (dropped, records), records as dicts in start order with 64 bit start/end times
+
+    """
+    data = open(path, "rb").read()
+    if len(data) < struct.calcsize("<" + HDR):
+        sys.exit(f"{path}: too short for a trace header")
+
+    # The dump is in the byte order of the target, the magic tells which
+    order = "<"
+    if struct.unpack_from("<I", data)[0] != MAGIC:
+        order = ">"
+        if struct.unpack_from(">I", data)[0] != MAGIC:
+            sys.exit(f"{path}: not a libsd trace dump")
+
+    _, version, rec_size, count, dropped = struct.unpack_from(order + HDR, data)
+    if version != VERSION or rec_size != struct.calcsize(order + REC):
+        sys.exit(f"{path}: unsupported trace version {version} (record size {rec_size})")
+
+    off = struct.calcsize(order + HDR)
+    count = min(count, (len(data) - off) // rec_size)
+
+    # Records are appended as they complete, so end times only move forward
+    recs = []
+    end = None
+    prev_cmd = None
+    for i in range(count):
+        t, dur, arg, nbytes, typ, cmd, r1, status = struct.unpack_from(
+            order + REC, data, off + i * rec_size
+        )
+        raw_end = (t + dur) & 0xFFFFFFFF
+        end = raw_end if end is None else end + ((raw_end - end) & 0xFFFFFFFF)
+        rec = {"type": typ, "cmd": cmd}
+        rec["name"] = name(rec, prev_cmd)
+        if typ == 0:
+            prev_cmd = cmd
+
+        rec.update(
+            {
+                "seq": dropped + i,
+                "start": end - dur,
+                "end": end,
+                "dur": dur,
+                "arg": arg,
+                "r1": r1,
+                "bytes": nbytes,
+                "status": status,
+            }
+        )
+        recs.append(rec)
+
+    # Block API calls start before their commands, ties keep the call first
+    recs.sort(key=lambda r: (r["start"], r["type"] < 2, r["seq"]))
+    return dropped, recs
+
+
+def name(rec, prev_cmd):
+    """
+    Readable name of a record
+    Args:
+        rec (dict): record
+        prev_cmd (int): command index of the previous command record, ACMDs follow CMD55
+
+    Returns: name
+
+    """
+    typ = rec["type"]
+    if typ == 0:
+        if prev_cmd == 55 and rec["cmd"] in ACMDS:
+            return f"ACMD{rec['cmd']} {ACMDS[rec['cmd']]}"
+        return f"CMD{rec['cmd']} {CMDS.get(rec['cmd'], '')}".rstrip()
+    if typ == 1:
+        return "CMD18 stream"
+    return TYPES[typ] if typ < len(TYPES) else f"type{typ}"
+
+
+def status_str(status):
+    """
+    Readable status
+    Args:
+        status (int): sd_status_t value
+
+    Returns: name
+
+    """
+    return STATUS[status] if status < len(STATUS) else str(status)
+
+
+def timeline(recs, gap_ms):
+    """
+    Prints the records in start order, commands indented under the block API call they belong to
+    Args:
+        recs (list): records
+        gap_ms (float): idle time marked as a gap
+
+    """
+    if not recs:
+        return
+
+    t0 = recs[0]["start"]
+    prev_end = t0
+    outer_end = -1
+
+    print(f"{'time ms':>12} {'dur us':>9}  {'what':<34} {'arg':>10} {'r1':>4} {'bytes':>9}  status")
+    for r in recs:
+        if gap_ms and (r["start"] - prev_end) / 1000 >= gap_ms:
+            print(f"{'':>12} {'':>9}  --- idle {(r['start'] - prev_end) / 1000:.1f} ms ---")
+
+        inner = r["type"] < 2 and r["start"] < outer_end
+        if r["type"] >= 2:
+            outer_end = r["end"]
+
+        what = ("  " if inner else "") + r["name"]
+
+        r1 = f"0x{r['r1']:02x}" if r["type"] == 0 else ""
+        status = status_str(r["status"])
+        flag = "  <--" if r["status"] else ""
+        print(
+            f"{(r['start'] - t0) / 1000:12.3f} {r['dur']:9}  {what:<34} 0x{r['arg']:08x} "
+            f"{r1:>4} {r['bytes']:9}  {status}{flag}"
+        )
+        prev_end = max(prev_end, r["end"])
+
+
+def summary(dropped, recs, top):
+    """
+    Prints per command and per call totals, errors and the slowest records
+    Args:
+        dropped (int): records lost before the dump
+        recs (list): records
+        top (int): slowest records to list
+
+    """
+    groups = {}
+    for r in recs:
+        g = groups.setdefault(r["name"], {"n": 0, "err": 0, "total": 0, "max": 0, "bytes": 0})
+        g["n"] += 1
+        g["err"] += 1 if r["status"] else 0
+        g["total"] += r["dur"]
+        g["max"] = max(g["max"], r["dur"])
+        # Erases cover bytes without transferring them
+        if r["type"] < 4:
+            g["bytes"] += r["bytes"]
+
+    span = (recs[-1]["end"] - recs[0]["start"]) if recs else 0
+    print(f"\n{len(recs)} records over {span / 1000:.1f} ms, {dropped} earlier not in the dump")
+    print(
+        f"{'what':<32} {'count':>7} {'errors':>6} {'avg us':>9} {'max us':>9} "
+        f"{'bytes':>11} {'KB/s':>9}"
+    )
+    for key, g in sorted(groups.items(), key=lambda kv: -kv[1]["total"]):
+        rate = g["bytes"] / 1024 / (g["total"] / 1e6) if g["total"] and g["bytes"] else 0
+        print(
+            f"{key:<32} {g['n']:7} {g['err']:6} {g['total'] / g['n']:9.1f} {g['max']:9} "
+            f"{g['bytes']:11} {rate:9.0f}"
+        )
+
+    errors = [r for r in recs if r["status"]]
+    if errors:
+        counts = {}
+        for r in errors:
+            counts[status_str(r["status"])] = counts.get(status_str(r["status"]), 0) + 1
+        print("\nerrors: " + ", ".join(f"{k} {v}" for k, v in sorted(counts.items())))
+
+    if top and recs:
+        t0 = recs[0]["start"]
+        print(f"\nslowest {top}:")
+        for r in sorted(recs, key=lambda r: -r["dur"])[:top]:
+            print(
+                f"  {(r['start'] - t0) / 1000:12.3f} ms  {r['dur']:9} us  {r['name']:<28} "
+                f"0x{r['arg']:08x}  {status_str(r['status'])}"
+            )
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a libsd trace dump")
+    ap.add_argument("dump", help="file written from sd_trace_dump")
+    ap.add_argument("--summary", action="store_true", help="only print the summary")
+    ap.add_argument("--gap-ms", type=float, default=100, help="mark idle gaps this long (0: off)")
+    ap.add_argument("--top", type=int, default=10, help="slowest records to list")
+    args = ap.parse_args()
+
+    dropped, recs = load(args.dump)
+    if not args.summary:
+        timeline(recs, args.gap_ms)
+    summary(dropped, recs, args.top)
+
+
+if __name__ == "__main__":
+    main()